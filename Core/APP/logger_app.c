@@ -6,10 +6,21 @@
 
 #include "FreeRTOS.h"
 #include "FreeRTOSConfig.h"
+#include "arena.h"
+#include "capture.h"
+#include "clock.h"
 #include "cmsis_os.h"
+#include "config.h"
 #include "console.h"
+#include "dedup.h"
 #include "define.h"
+#include "filter.h"
+#include "flush.h"
+#include "framing.h"
 #include "gpio_config.h"
+#include "ingest.h"
+#include "power.h"
+#include "profile.h"
 #include "sd.h"
 #include "spi_fram.h"
 #include "timer.h"
@@ -20,13 +31,6 @@ static const LOGGER_DATA_T initial_logger_data =
 {
     .state = INITIALIZATION,
     .ram_addr = 0u,
-    .rx_buffer = {0u},
-    .config = 
-    {
-        .usb_ms = false,
-        .mode = LINEAR_BUFFER,    
-        .baudrate = 115200u,
-    },
 };
 
 /*Blink LEDs when system receive error based on error type*/
@@ -55,54 +59,257 @@ static void data_received(bool is_received)
     }
 }
 
-static bool logger_app_init(void)
+/* Every power cycle logs into a new file, the previous one is only reopened to finish a flush */
+static uint16_t logger_next_file_id(void)
 {
-    bool ret = true;
+    uint8_t number[2u] = { 0u };
+    fram_read(LOCATION_FILE_NUMBER_LSB, number, sizeof(number));
+
+    uint16_t file_id = (uint16_t)(number[0u] | (number[1u] << 8u));
+    file_id = (file_id >= 65533u) ? 0u : file_id + 1u;
+
+    number[0u] = (uint8_t)file_id;
+    number[1u] = (uint8_t)(file_id >> 8u);
+    fram_write(LOCATION_FILE_NUMBER_LSB, number, sizeof(number));
 
-    memset(&logger_data, &initial_logger_data, sizeof(initial_logger_data));
+    return file_id;
+}
 
-    if (fram_init())
+/* The card and FatFs only run at CLOCK_HIGH, capture stays on CLOCK_LOW in between */
+static bool logger_sd_open(void)
+{
+    clock_set(CLOCK_HIGH);
+    sd_power_on();
+    if (!sd_init())
     {
-        log_info("SD Logger by PL v.%d.%d\r\n", VERSION_MAJOR, VERSION_MINOR);
-        log_info("Current RAM addr: %d\r\n", logger_data.ram_addr);
+        sd_power_off();
+        clock_set(CLOCK_LOW);
+        return false;
     }
-    else
+
+    return true;
+}
+
+static void logger_sd_close(void)
+{
+    sd_deinit();
+    sd_power_off();
+    clock_set(CLOCK_LOW);
+}
+
+static uint8_t logger_container(void)
+{
+    return (logger_data.config.container == CONTAINER_BLOCKS) ? FLUSH_CONTAINER : 0u;
+}
+
+/* Finish an interrupted flush if any, then flush what is buffered. The card must be mounted. */
+static bool logger_flush(uint16_t file_id)
+{
+    bool ret = flush_resume();
+
+    logger_data.ram_addr = ingest_flush_addr();
+    if (ret && (flush_pending(logger_data.ram_addr) > 0u))
+    {
+        /* Read after the write address: the ingest switches format only with an empty ring (in trigger mode by dropping
+           the armed history, never with a window pending), so all pending data has this one */
+        const uint8_t flags = (ingest_compressed()                                     ? FLUSH_FRAMED
+                               : (logger_data.config.compression == COMPRESSION_FLUSH) ? FLUSH_COMPRESSED
+                                                                                       : 0u) |
+                              (ingest_stamped() ? FLUSH_RECORDS : 0u) | logger_container();
+        ret = flush_run(file_id, logger_data.ram_addr, flags);
+    }
+
+    return ret;
+}
+
+/* One trigger window into its own CAPxxxxx file, numbered like the logs. The card must be mounted. */
+static bool logger_flush_capture(uint32_t end)
+{
+    const uint8_t flags = FLUSH_CAPTURE | ((logger_data.config.compression != COMPRESSION_NONE) ? FLUSH_COMPRESSED : 0u) |
+                          (ingest_stamped() ? FLUSH_RECORDS : 0u) | logger_container();
+
+    return flush_resume() && flush_run(logger_next_file_id(), end, flags);
+}
+
+/* In trigger mode the FRAM ring is a history, only closed capture windows are flushed. Frames left by the ingest
+   compression are flushed as a log first, the capture waits for the text ring. */
+static bool logger_capturing(void)
+{
+    return (logger_data.config.mode == TRIGGER_BUFFER) && !ingest_compressed();
+}
+
+/* Apply a configuration read from FRAM or config.txt; the capture already runs at the stored baudrate */
+static void logger_apply_config(void)
+{
+    if ((logger_data.config.baudrate != 0u) && (logger_data.config.baudrate != ingest_baudrate()))
+    {
+        ingest_set_baudrate(logger_data.config.baudrate);
+    }
+    ingest_set_compression((logger_data.config.compression == COMPRESSION_INGEST) && (logger_data.config.mode != TRIGGER_BUFFER));
+    ingest_set_timestamps(logger_data.config.timestamps == TIMESTAMPS_RECORDS);
+    ingest_set_line_stamps(logger_data.config.timestamps == TIMESTAMPS_TEXT);
+    ingest_set_overwrite(logger_data.config.mode == RING_BUFFER);
+    ingest_set_dedup(logger_data.config.dedup);
+    ingest_set_framing(logger_data.config.framing != FRAMING_NONE,
+                       (logger_data.config.framing == FRAMING_SLIP) ? FRAMING_SLIP_END : FRAMING_COBS_DELIMITER);
+    ingest_set_filter(logger_data.config.filter);
+    ingest_set_capture(logger_data.config.mode == TRIGGER_BUFFER,
+                       logger_data.config.trigger,
+                       logger_data.config.pre_trigger_kb * 1024u,
+                       logger_data.config.post_trigger_kb * 1024u);
+    power_set_idle(logger_data.config.sleep_idle_ms);
+}
+
+static bool logger_app_init(void)
+{
+    memcpy(&logger_data, &initial_logger_data, sizeof(initial_logger_data));
+
+    if (!fram_init())
     {
         log_info("SPI FRAM initialization failed.\r\n");
+        return false;
     }
 
+    logger_data.ram_addr = ingest_flush_addr();
+    logger_data.file_id = logger_next_file_id();
+    if (!config_restore(&logger_data.config))
+    {
+        log_info("No cached config, using defaults\r\n");
+    }
+    logger_apply_config();
+
+    log_info("SD Logger by PL v.%d.%d\r\n", VERSION_MAJOR, VERSION_MINOR);
+    log_info("Capture armed %lu us after reset at %lu bps\r\n", ingest_boot_latency_us(), ingest_baudrate());
+    log_info("Current RAM addr: %lu, log file: %u\r\n", logger_data.ram_addr, logger_data.file_id);
+
+    /* Capture is already running, the card is only needed for config and recovery */
+    logger_data.state = CONFIG_PROCESS;
+
     return true;
 }
 
 static void logger_app_proc(void)
 {
+    uint32_t pending = 0u;
+    uint32_t capture_end = 0u;
+    bool capturing = false;
+    bool ok = false;
+
     switch (logger_data.state)
     {
         case INITIALIZATION:
             /* Should not be in here */
             break;
-        case FRAM_PROCESS:
-
+        case CONFIG_PROCESS:
+            if (logger_sd_open())
+            {
+                /* Leftover data of the last power cycle goes to its own file, not to the new one. It is handled in the
+                   mode it was captured in: a trigger history is no log, only an interrupted window flush is finished. */
+                capturing = logger_capturing();
+                const bool changed = config_refresh(&logger_data.config);
+                ok = true;
+                if (capturing)
+                {
+                    ok = flush_resume();
+                }
+                else if (flush_interrupted() || (flush_pending(ingest_flush_addr()) > 0u))
+                {
+                    ok = logger_flush(flush_file_id());
+                }
+                if (!ok)
+                {
+                    log_info("Recovery flush failed\r\n");
+                }
+                if (changed)
+                {
+                    logger_apply_config();
+                }
+                logger_sd_close();
+            }
+            logger_data.state = IDLE;
+            break;
+        case IDLE:
+            if (logger_capturing())
+            {
+                if (capture_ready(NULL))
+                {
+                    logger_data.state = SD_PROCESS;
+                }
+                break;
+            }
+            if (ingest_flush_addr() != logger_data.ram_addr)
+            {
+                logger_data.ram_addr = ingest_flush_addr();
+                logger_data.flush_deadline = timer_deadline_ms(logger_data.config.flush_idle_ms);
+            }
+            pending = flush_pending(logger_data.ram_addr);
+            if ((pending >= logger_data.config.flush_bytes) ||
+                ((pending > 0u) && (logger_data.config.flush_idle_ms != 0u) && timer_expired(logger_data.flush_deadline)))
+            {
+                logger_data.state = SD_PROCESS;
+            }
+            break;
+        case SD_PROCESS:
+            capturing = logger_capturing() && capture_ready(&capture_end);
+            if (!logger_sd_open() || !(capturing ? logger_flush_capture(capture_end) : logger_flush(logger_data.file_id)))
+            {
+                system_error(SD_ERROR);
+            }
+            logger_sd_close();
+#ifdef DEBUG
+            log_info("STOP entries %lu, wake %lu us (max %lu us)\r\n", power_stop_count(), power_wake_us(), power_wake_max_us());
+            log_info("Repeated lines dropped: %lu bytes\r\n", dedup_suppressed());
+            filter_report();
+            framing_report();
+            log_info("Capture triggers: %lu\r\n", capture_triggers());
+            arena_report();
+            profile_report();
+#endif
+            logger_data.state = IDLE;
+            break;
         default:
             break;
     }
 }
 
+/* Block in IDLE until the ingest task stores data or the idle flush deadline passes */
+static void logger_wait_event(void)
+{
+    TickType_t timeout = portMAX_DELAY;
+    uint32_t events = 0u;
+
+    if (!logger_capturing() && (logger_data.config.flush_idle_ms != 0u) && (flush_pending(logger_data.ram_addr) > 0u))
+    {
+        timeout = pdMS_TO_TICKS(timer_remaining_ms(logger_data.flush_deadline));
+    }
+
+    xTaskNotifyWait(0u, UINT32_MAX, &events, timeout);
+}
+
 static void logger_app_task(void* arg)
 {
+    ingest_subscribe(xTaskGetCurrentTaskHandle());
+
+    if (!logger_app_init())
+    {
+        system_error(FRAM_ERROR);
+    }
+
     while (true)
     {
-        task_delay(1u);
+        logger_app_proc();
+        if (logger_data.state == IDLE)
+        {
+            logger_wait_event();
+        }
     }
 }
 
 void logger_app_task_entry(void)
 {
-    BaseType_t xReturned;
-    TaskHandle_t logger_app_handle = NULL;
-    xReturned = xTaskCreate(logger_app_task, "main task", LOGGER_APP_STACK, NULL, LOGGER_APP_PRIORITY, &logger_app_handle);
+    TaskHandle_t logger_app_handle = arena_create_task(logger_app_task, "main task", LOGGER_APP_STACK, LOGGER_APP_PRIORITY);
 
-    if (xReturned != pdPASS)
+    if (logger_app_handle == NULL)
     {
         log_info("logger main task initialization failed\r\n");
     }
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "config.h"
 #include "define.h"
 #include "main.h"
 
@@ -27,26 +28,13 @@ typedef enum
     CONFIG_ERROR
 } LOGGER_ERROR_T;
 
-typedef enum
-{
-    LINEAR_BUFFER = 0u,
-    RING_BUFFER,
-} LOGGER_MODE_T;
-
-typedef struct
-{
-    bool usb_ms; /**< USB mass storage function */
-    uint32_t baudrate;
-    LOGGER_MODE_T mode;
-} LOGGER_CONFIG_T;
-
 typedef struct
 {
     LOGGER_STATE_T state;
     LOGGER_CONFIG_T config;
     uint32_t ram_addr; /**< Address of the current position of FRAM */
-    uint8_t rx_buffer[2048u];
-    uint32_t timer; /**< logger timer */
+    uint16_t file_id;  /**< Log file of this power cycle */
+    uint64_t flush_deadline; /**< Idle flush is due, armed by every new data, kept on the microsecond clock */
 } LOGGER_DATA_T;
 
 void logger_app_task_entry(void);
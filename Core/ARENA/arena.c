@@ -0,0 +1,100 @@
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compress.h"
+#include "compress_dict.h"
+
+#include "FreeRTOS.h"
+#include "FreeRTOSConfig.h"
+#include "console.h"
+#include "define.h"
+#include "main.h"
+#include "task.h"
+
+#define ARENA_ROUND(size) ((((uint32_t)(size)) + ARENA_ALIGN - 1u) & ~(ARENA_ALIGN - 1u))
+
+/**< One array per slice in its own input section, the linker map then shows every slice by name */
+#define ARENA_SLICE(name, region, size) \
+    static uint8_t arena_##name[ARENA_ROUND(size)] __attribute__((aligned(ARENA_ALIGN), section(region "." #name)))
+
+#define ARENA_RTOS_SIZE \
+    (((INGEST_STACK + CONSOLE_STACK + LOGGER_APP_STACK) * sizeof(StackType_t)) + (ARENA_TASKS * ARENA_ROUND(sizeof(StaticTask_t))))
+
+/**< compress_init() window and match finder plus one frame */
+#define ARENA_ENCODER_SIZE(history, block) \
+    (ARENA_ROUND((1u << COMPRESS_HASH_BITS) * sizeof(uint16_t)) + ARENA_ROUND((history) + (block)) + ARENA_ROUND(COMPRESS_FRAME_SIZE(block)))
+
+#define ARENA_INGEST_SIZE \
+    (ARENA_ROUND(INGEST_RX_SIZE) + ARENA_ENCODER_SIZE(sizeof(COMPRESS_DICTIONARY) - 1u, INGEST_BLOCK_SIZE) + (2u * ARENA_ROUND(DEDUP_LINE_MAX)) + \
+     ARENA_ROUND(FILTER_STATES * FILTER_CLASSES) + ARENA_ROUND(FILTER_LINE_MAX) + ARENA_ROUND(INGEST_RECORD_SIZE))
+#define ARENA_COMPRESS_SIZE ARENA_ENCODER_SIZE(0u, COMPRESS_BLOCK_SIZE)
+
+typedef struct
+{
+    uint8_t* base;
+    uint32_t size;
+    uint32_t used;
+    const char* name;
+} ARENA_SLICE_T;
+
+ARENA_SLICE(ingest, ARENA_INGEST_REGION, ARENA_INGEST_SIZE);
+ARENA_SLICE(flush, ARENA_FLUSH_REGION, FLUSH_TRANSFER_SIZE);
+ARENA_SLICE(console, ARENA_CONSOLE_REGION, CONSOLE_TX_SIZE);
+ARENA_SLICE(rtos, ARENA_RTOS_REGION, ARENA_RTOS_SIZE);
+ARENA_SLICE(compress, ARENA_COMPRESS_REGION, ARENA_COMPRESS_SIZE);
+
+static ARENA_SLICE_T slices[ARENA_OWNERS] = {
+    [ARENA_INGEST] = { arena_ingest, sizeof(arena_ingest), 0u, "ingest" },
+    [ARENA_FLUSH] = { arena_flush, sizeof(arena_flush), 0u, "flush" },
+    [ARENA_CONSOLE] = { arena_console, sizeof(arena_console), 0u, "console" },
+    [ARENA_RTOS] = { arena_rtos, sizeof(arena_rtos), 0u, "rtos" },
+    [ARENA_COMPRESS] = { arena_compress, sizeof(arena_compress), 0u, "compress" },
+};
+
+static TaskHandle_t tasks[ARENA_TASKS];
+static uint32_t task_count;
+
+void* arena_alloc(ARENA_OWNER_T owner, uint32_t size)
+{
+    ARENA_SLICE_T* slice = &slices[owner];
+    const uint32_t length = ARENA_ROUND(size);
+
+    if (length > slice->size - slice->used)
+    {
+        Error_Handler();
+    }
+
+    void* buffer = &slice->base[slice->used];
+    slice->used += length;
+
+    return buffer;
+}
+
+TaskHandle_t arena_create_task(TaskFunction_t task, const char* name, uint32_t stack_words, UBaseType_t priority)
+{
+    StackType_t* stack = arena_alloc(ARENA_RTOS, stack_words * sizeof(StackType_t));
+    StaticTask_t* tcb = arena_alloc(ARENA_RTOS, sizeof(StaticTask_t));
+    TaskHandle_t handle = xTaskCreateStatic(task, name, stack_words, NULL, priority, stack, tcb);
+
+    if ((handle != NULL) && (task_count < ARENA_TASKS))
+    {
+        tasks[task_count++] = handle;
+    }
+
+    return handle;
+}
+
+void arena_report(void)
+{
+    for (uint32_t index = 0u; index < ARENA_OWNERS; index++)
+    {
+        log_info("[arena] %s %lu/%lu bytes\r\n", slices[index].name, slices[index].used, slices[index].size);
+    }
+    for (uint32_t index = 0u; index < task_count; index++)
+    {
+        log_info("[arena] %s stack %lu words free\r\n", pcTaskGetName(tasks[index]), uxTaskGetStackHighWaterMark(tasks[index]));
+    }
+    log_info("[arena] heap %lu bytes free, %lu minimum\r\n", xPortGetFreeHeapSize(), xPortGetMinimumEverFreeHeapSize());
+}
@@ -0,0 +1,48 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**< Every subsystem draws from its own slice, sized and placed in SRAM1 or SRAM2 in define.h */
+typedef enum
+{
+    ARENA_INGEST = 0u, /**< USART2 RX DMA ring, ingest compression and line filter */
+    ARENA_FLUSH,       /**< FRAM to SD transfer buffer */
+    ARENA_CONSOLE,     /**< USART2 TX DMA ring */
+    ARENA_RTOS,        /**< Task stacks and control blocks */
+    ARENA_COMPRESS,    /**< Raw block, frame and match finder of the flush compression */
+    ARENA_OWNERS,
+} ARENA_OWNER_T;
+
+/**
+ * @brief Hand out a buffer from the owner's slice, aligned to ARENA_ALIGN. Nothing is ever freed.
+ *        Memory is not cleared. Call during init, before osKernelStart() or from the owner's task.
+ *        A slice that runs out is a budget error in define.h and stops in Error_Handler().
+ *
+ * @param owner subsystem the memory is charged to
+ * @param size bytes
+ * @return void* buffer, never NULL
+ */
+void* arena_alloc(ARENA_OWNER_T owner, uint32_t size);
+
+/**
+ * @brief Create a task with its stack and control block taken from ARENA_RTOS
+ *
+ * @param task task function
+ * @param name task name
+ * @param stack_words stack depth in words
+ * @param priority task priority
+ * @return TaskHandle_t handle, NULL on failure
+ */
+TaskHandle_t arena_create_task(TaskFunction_t task, const char* name, uint32_t stack_words, UBaseType_t priority);
+
+/**
+ * @brief Print the bytes used of each slice and the unused stack of every task
+ */
+void arena_report(void);
+
+#endif // !_ARENA_H_
@@ -0,0 +1,244 @@
+#include "capture.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "console.h"
+#include "define.h"
+#include "flush.h"
+#include "main.h"
+#include "spi_fram.h"
+#include "timer.h"
+
+typedef enum
+{
+    CAPTURE_OFF = 0u, /**< Normal logging */
+    CAPTURE_ARMED,    /**< History only, waiting for the trigger */
+    CAPTURE_POST,     /**< Triggered, collecting the post-trigger window */
+    CAPTURE_READY,    /**< Window closed, waiting for the logger task to flush it */
+} CAPTURE_STATE_T;
+
+static volatile CAPTURE_STATE_T state;
+static volatile uint32_t window_end; /**< FRAM address one past the window, the start is the flush read address */
+static bool enabled;
+static uint32_t pre_limit;
+static uint32_t post_limit;
+static uint64_t post_deadline; /**< The post-trigger window closes at the latest, timer_now_us() */
+static uint32_t triggers;
+
+/* Trigger pattern, matched with its border table (Knuth-Morris-Pratt) across received chunks */
+static char pattern[CAPTURE_TRIGGER_MAX];
+static uint8_t border[CAPTURE_TRIGGER_MAX]; /**< Longest proper prefix of pattern[0..i] that is also its suffix */
+static uint32_t pattern_length;
+static uint32_t matched;
+
+/* State byte and the 24-bit window end, so a window closed before a power loss is still flushed */
+static void capture_save(void)
+{
+    const uint8_t record[4u] = { (uint8_t)state, (uint8_t)(window_end >> 16u), (uint8_t)(window_end >> 8u), (uint8_t)window_end };
+    fram_write(CAPTURE_LOCATION, record, sizeof(record));
+}
+
+static void capture_compile(const char* trigger)
+{
+    strncpy(pattern, trigger, sizeof(pattern) - 1u);
+    pattern[sizeof(pattern) - 1u] = '\0';
+    pattern_length = strlen(pattern);
+    matched = 0u;
+
+    uint32_t length = 0u;
+    border[0] = 0u;
+    for (uint32_t index = 1u; index < pattern_length; index++)
+    {
+        while ((length > 0u) && (pattern[index] != pattern[length]))
+        {
+            length = border[length - 1u];
+        }
+        if (pattern[index] == pattern[length])
+        {
+            length++;
+        }
+        border[index] = (uint8_t)length;
+    }
+}
+
+/* Keep at most pre_limit bytes of history in front of write_addr */
+static void capture_trim(uint32_t write_addr, bool persist)
+{
+    if (flush_pending(write_addr) > pre_limit)
+    {
+        flush_discard(flush_ring_advance(write_addr, LOCATION_BUFFER_SIZE - pre_limit), persist);
+    }
+}
+
+static void capture_close(uint32_t end)
+{
+    window_end = end;
+    state = CAPTURE_READY;
+    capture_save();
+    log_info("Capture closed, %lu bytes\r\n", flush_pending(end));
+}
+
+void capture_init(uint32_t write_addr)
+{
+    uint8_t record[4u] = { 0u };
+    fram_read(CAPTURE_LOCATION, record, sizeof(record));
+
+    const uint32_t end = ((uint32_t)record[1u] << 16u) | ((uint32_t)record[2u] << 8u) | record[3u];
+    if (((record[0u] == CAPTURE_POST) || (record[0u] == CAPTURE_READY)) && (end >= LOCATION_BUFFER_START) && (end < LOCATION_BUFFER_END))
+    {
+        /* A window still open at the power loss ends with what made it into FRAM */
+        window_end = (flush_pending(end) <= flush_pending(write_addr)) ? end : write_addr;
+        state = CAPTURE_READY;
+    }
+}
+
+void capture_configure(bool enable, const char* trigger, uint32_t pre_bytes, uint32_t post_bytes)
+{
+    /* The ring has to hold a whole window plus one DMA ring of new data while the window is flushed */
+    const uint32_t limit = LOCATION_BUFFER_SIZE - INGEST_RX_SIZE;
+
+    pre_limit = (pre_bytes < limit) ? pre_bytes : limit;
+    post_limit = (post_bytes < limit - pre_limit) ? post_bytes : limit - pre_limit;
+    capture_compile(trigger);
+
+    enabled = enable;
+    if (enable && (state == CAPTURE_OFF))
+    {
+        state = CAPTURE_ARMED;
+    }
+    else if (!enable && (state != CAPTURE_READY) && (state != CAPTURE_OFF))
+    {
+        state = CAPTURE_OFF;
+        capture_save();
+    }
+}
+
+bool capture_active(void)
+{
+    return state != CAPTURE_OFF;
+}
+
+bool capture_drop_history(uint32_t write_addr)
+{
+    if (state != CAPTURE_ARMED)
+    {
+        return false;
+    }
+    flush_discard(write_addr, true);
+
+    return true;
+}
+
+__RAM_FUNC void capture_feed(const uint8_t* data, uint32_t length, uint32_t write_addr, uint64_t now_us)
+{
+    if (pattern_length == 0u)
+    {
+        return;
+    }
+
+    const uint8_t* end = data + length;
+    while (data < end)
+    {
+        if (matched == 0u)
+        {
+            /* Most bytes cannot start the pattern, skip to the next candidate */
+            data = memchr(data, pattern[0], (size_t)(end - data));
+            if (data == NULL)
+            {
+                return;
+            }
+        }
+
+        const char byte = (char)*data++;
+        while ((matched > 0u) && (pattern[matched] != byte))
+        {
+            matched = border[matched - 1u];
+        }
+        if (pattern[matched] == byte)
+        {
+            matched++;
+        }
+        if (matched < pattern_length)
+        {
+            continue;
+        }
+
+        matched = border[matched - 1u];
+        triggers++;
+        if (state == CAPTURE_ARMED)
+        {
+            /* Freeze the history: the flush read address becomes the window start and survives a power loss */
+            capture_trim(write_addr, true);
+            window_end = flush_ring_advance(write_addr, post_limit);
+            post_deadline = now_us + (uint64_t)CAPTURE_POST_MS * 1000u;
+            state = CAPTURE_POST;
+            capture_save();
+            log_info("Trigger at FRAM %lu\r\n", write_addr);
+        }
+    }
+}
+
+bool capture_update(uint32_t write_addr, uint64_t now_us)
+{
+    switch (state)
+    {
+        case CAPTURE_ARMED:
+            capture_trim(write_addr, false);
+            break;
+        case CAPTURE_POST:
+            if (flush_pending(write_addr) >= flush_pending(window_end))
+            {
+                capture_close(window_end);
+                return true;
+            }
+            if (now_us >= post_deadline)
+            {
+                capture_close(write_addr);
+                return true;
+            }
+            break;
+        case CAPTURE_READY:
+            if (flush_pending(window_end) == 0u)
+            {
+                /* Flushed, what came in meanwhile is the new history */
+                state = enabled ? CAPTURE_ARMED : CAPTURE_OFF;
+                capture_save();
+                if (enabled)
+                {
+                    capture_trim(write_addr, false);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+uint64_t capture_deadline(void)
+{
+    return (state == CAPTURE_POST) ? post_deadline : TIMER_NEVER;
+}
+
+bool capture_ready(uint32_t* end)
+{
+    /* Until the ingest task re-arms, a flushed window is no longer pending */
+    if ((state != CAPTURE_READY) || (flush_pending(window_end) == 0u))
+    {
+        return false;
+    }
+    if (end != NULL)
+    {
+        *end = window_end;
+    }
+
+    return true;
+}
+
+uint32_t capture_triggers(void)
+{
+    return triggers;
+}
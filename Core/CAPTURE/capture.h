@@ -0,0 +1,84 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**< Trigger capture (mode=trigger): the FRAM ring is an overwriting history of the last pre-trigger bytes.
+ *   When the trigger pattern shows up in the received bytes the history is frozen, the next post-trigger bytes are
+ *   added to it and the whole window is flushed into its own CAPxxxxx file. Nothing else reaches the card.
+ *   A post-trigger window that does not fill is closed CAPTURE_POST_MS after the trigger.
+ *   The window end is kept at CAPTURE_LOCATION, a window closed before a power loss is still flushed after it.
+ *   Runs in the ingest task, only capture_ready() is called from the logger task. */
+
+/**
+ * @brief Load a window left by the last power cycle. Call once on boot after flush_restore().
+ *
+ * @param write_addr FRAM write address of the ingest side
+ */
+void capture_init(uint32_t write_addr);
+
+/**
+ * @brief Arm or stop the trigger. A window waiting for its flush is kept either way.
+ *
+ * @param enable keep a history and wait for the trigger
+ * @param trigger pattern, at most CAPTURE_TRIGGER_MAX - 1 bytes, empty never triggers
+ * @param pre_bytes history kept in front of the trigger
+ * @param post_bytes bytes captured after the trigger
+ */
+void capture_configure(bool enable, const char* trigger, uint32_t pre_bytes, uint32_t post_bytes);
+
+/**
+ * @brief true while received bytes have to go through capture_feed() and capture_update()
+ */
+bool capture_active(void);
+
+/**
+ * @brief Drop the whole history while armed, so a new ring format can start on an empty ring. Ingest task.
+ *
+ * @param write_addr FRAM write address, the new read address
+ * @return true if the capture was armed and the history is gone, false while a window is open or waits for its flush
+ */
+bool capture_drop_history(uint32_t write_addr);
+
+/**
+ * @brief Look for the trigger in received bytes, before they are filtered or stored
+ *
+ * @param data received bytes
+ * @param length bytes
+ * @param write_addr FRAM write address before these bytes are stored, the trigger position
+ * @param now_us arrival time, timer_now_us()
+ */
+void capture_feed(const uint8_t* data, uint32_t length, uint32_t write_addr, uint64_t now_us);
+
+/**
+ * @brief Drop history older than the pre-trigger window, close a full window and re-arm after its flush.
+ *        Call after the received bytes are stored.
+ *
+ * @param write_addr FRAM write address of the ingest side
+ * @param now_us timer_now_us()
+ * @return true if a window was closed and waits for the logger task
+ */
+bool capture_update(uint32_t write_addr, uint64_t now_us);
+
+/**
+ * @brief When an open post-trigger window is closed
+ *
+ * @return uint64_t deadline (timer.h), TIMER_NEVER without an open window
+ */
+uint64_t capture_deadline(void);
+
+/**
+ * @brief A closed window waits for its flush, it runs from the flush read address up to end. Logger task.
+ *
+ * @param end FRAM address one past the window, may be NULL
+ * @return true if a window is ready
+ */
+bool capture_ready(uint32_t* end);
+
+/**
+ * @brief Trigger hits since boot, also those ignored while a window was open or waiting
+ */
+uint32_t capture_triggers(void);
+
+#endif // !_CAPTURE_H_
@@ -0,0 +1,99 @@
+#include "clock.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "FreeRTOSConfig.h"
+#include "define.h"
+#include "main.h"
+#include "spi_fram.h"
+#include "task.h"
+#include "timer.h"
+
+static CLOCK_LEVEL_T level = CLOCK_HIGH; // SystemClock_Config()
+
+static bool clock_switch_low(void)
+{
+    RCC_ClkInitTypeDef clk = { 0 };
+
+    __HAL_RCC_MSI_RANGE_CONFIG(RCC_MSIRANGE_8); // 16 MHz, MSI is not the system clock yet
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+    clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = RCC_HCLK_DIV1;
+    clk.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_2) != HAL_OK) // 2 wait states cover 16 MHz in range 2
+    {
+        return false;
+    }
+
+    __HAL_RCC_PLL_DISABLE();
+    __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_MSI);
+
+    return HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE2) == HAL_OK;
+}
+
+static bool clock_switch_high(void)
+{
+    RCC_ClkInitTypeDef clk = { 0 };
+
+    if (HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1) != HAL_OK)
+    {
+        return false;
+    }
+
+    /* PLL settings of SystemClock_Config() are kept while it is off */
+    __HAL_RCC_PLL_ENABLE();
+    while (!__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY))
+    {
+    }
+
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = RCC_HCLK_DIV1;
+    clk.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_4) != HAL_OK)
+    {
+        return false;
+    }
+
+    __HAL_RCC_MSI_RANGE_CONFIG(RCC_MSIRANGE_11); // 48 MHz again for USB
+    __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_HSI);
+
+    return true;
+}
+
+bool clock_set(CLOCK_LEVEL_T new_level)
+{
+    if (new_level == level)
+    {
+        return true;
+    }
+
+    /* Interrupts keep running: the USART2 DMA capture does not depend on SYSCLK */
+    vTaskSuspendAll();
+    const bool ret = (new_level == CLOCK_HIGH) ? clock_switch_high() : clock_switch_low();
+    if (ret)
+    {
+        level = new_level;
+    }
+
+    /* HAL_RCC_ClockConfig() updated SystemCoreClock and the HAL time base, the RTOS tick follows here */
+    taskENTER_CRITICAL();
+    SysTick->LOAD = (SystemCoreClock / configTICK_RATE_HZ) - 1u;
+    SysTick->VAL = 0u;
+    taskEXIT_CRITICAL();
+    xTaskResumeAll();
+
+    fram_set_spi_clock(HAL_RCC_GetPCLK2Freq());
+    timer_us_clock_changed();
+
+    return ret;
+}
+
+CLOCK_LEVEL_T clock_level(void)
+{
+    return level;
+}
@@ -0,0 +1,28 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    CLOCK_LOW = 0u, /**< MSI 16 MHz, voltage range 2: buffering into FRAM */
+    CLOCK_HIGH,     /**< PLL 80 MHz from HSI16, voltage range 1: SD flush, USB */
+} CLOCK_LEVEL_T;
+
+/**
+ * @brief Switch the system clock to an operating point. The RTOS tick, the HAL time base, the SPI1 prescaler
+ *        and the STOP wakeup clock follow. USART2 runs from HSI16 at every level, its BRR never changes and the
+ *        capture keeps running. Call from a task, not from an ISR.
+ *
+ * @param level operating point
+ * @return true on success
+ */
+bool clock_set(CLOCK_LEVEL_T level);
+
+/**
+ * @brief Current operating point
+ */
+CLOCK_LEVEL_T clock_level(void);
+
+#endif // !_CLOCK_H_
@@ -0,0 +1,195 @@
+#include "compress.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "compress_dict.h"
+#include "define.h"
+#include "main.h"
+#include "profile.h"
+
+#define MIN_MATCH     4u  /**< Shortest match, encoded as 0 in the token */
+#define LAST_LITERALS 5u  /**< LZ4 block rule: the last 5 bytes are always literals */
+#define MATCH_LIMIT   12u /**< LZ4 block rule: no match starts in the last 12 bytes */
+#define RUN_MASK      15u
+#define SKIP_SHIFT    6u  /**< Step grows by one every 64 bytes without a match, incompressible data passes quickly */
+
+#define HASH_SIZE (1u << COMPRESS_HASH_BITS)
+#define DICTIONARY_SIZE (sizeof(COMPRESS_DICTIONARY) - 1u)
+
+static inline uint32_t read32(const uint8_t* src)
+{
+    uint32_t value;
+    memcpy(&value, src, sizeof(value)); // Unaligned word load on the M4
+
+    return value;
+}
+
+static inline uint32_t hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32u - COMPRESS_HASH_BITS);
+}
+
+/* Length beyond the token nibble: 255 per byte, the last byte below 255 */
+static __RAM_FUNC uint8_t* put_length(uint8_t* dst, uint32_t length)
+{
+    while (length >= 255u)
+    {
+        *dst++ = 255u;
+        length -= 255u;
+    }
+    *dst++ = (uint8_t)length;
+
+    return dst;
+}
+
+/* One LZ4 sequence: token, literals, then the match unless this is the last sequence (match_length 0).
+   Returns NULL if the output would pass end. */
+static uint8_t* put_sequence(uint8_t* dst, const uint8_t* end, const uint8_t* literals, uint32_t literal_length, uint32_t offset,
+                             uint32_t match_length)
+{
+    /* Worst case: token, literal length bytes, literals, offset, match length bytes */
+    if ((uint32_t)(end - dst) < 1u + literal_length / 255u + 1u + literal_length + 2u + match_length / 255u + 1u)
+    {
+        return NULL;
+    }
+
+    uint8_t* token = dst++;
+    *token = (uint8_t)(((literal_length < RUN_MASK) ? literal_length : RUN_MASK) << 4u);
+    if (literal_length >= RUN_MASK)
+    {
+        dst = put_length(dst, literal_length - RUN_MASK);
+    }
+    memcpy(dst, literals, literal_length);
+    dst += literal_length;
+
+    if (match_length != 0u)
+    {
+        *dst++ = (uint8_t)offset;
+        *dst++ = (uint8_t)(offset >> 8u);
+        match_length -= MIN_MATCH;
+        *token |= (uint8_t)((match_length < RUN_MASK) ? match_length : RUN_MASK);
+        if (match_length >= RUN_MASK)
+        {
+            dst = put_length(dst, match_length - RUN_MASK);
+        }
+    }
+
+    return dst;
+}
+
+/* Greedy LZ4 block encoder over src[start..end), matches reach back to src[0]. The history in front of start is only
+   indexed, never emitted. Returns 0 if the result is not smaller than limit. */
+static __RAM_FUNC uint32_t lz_encode(uint16_t* table, const uint8_t* src, uint32_t start, uint32_t end, uint8_t* dst, uint32_t limit)
+{
+    const uint8_t* const out_end = dst + limit;
+    uint8_t* out = dst;
+    uint32_t anchor = start;
+    uint32_t pos = start;
+
+    memset(table, 0, HASH_SIZE * sizeof(uint16_t));
+    for (uint32_t index = 0u; index + MIN_MATCH <= start; index++)
+    {
+        table[hash(read32(&src[index]))] = (uint16_t)index;
+    }
+
+    if (end - start > MATCH_LIMIT)
+    {
+        const uint32_t search_end = end - MATCH_LIMIT;
+        const uint32_t match_end = end - LAST_LITERALS;
+
+        while (pos < search_end)
+        {
+            const uint32_t sequence = read32(&src[pos]);
+            const uint32_t slot = hash(sequence);
+            uint32_t ref = table[slot];
+            table[slot] = (uint16_t)pos;
+
+            if ((ref >= pos) || (read32(&src[ref]) != sequence))
+            {
+                pos += 1u + ((pos - anchor) >> SKIP_SHIFT);
+                continue;
+            }
+
+            uint32_t match_length = MIN_MATCH;
+            while ((pos + match_length < match_end) && (src[ref + match_length] == src[pos + match_length]))
+            {
+                match_length++;
+            }
+            while ((pos > anchor) && (ref > 0u) && (src[pos - 1u] == src[ref - 1u]))
+            {
+                pos--;
+                ref--;
+                match_length++;
+            }
+
+            out = put_sequence(out, out_end, &src[anchor], pos - anchor, pos - ref, match_length);
+            if (out == NULL)
+            {
+                return 0u;
+            }
+            pos += match_length;
+            anchor = pos;
+
+            /* Seed the table with the end of the match, repeated lines then match from their first byte */
+            if (pos < search_end)
+            {
+                table[hash(read32(&src[pos - 2u]))] = (uint16_t)(pos - 2u);
+            }
+        }
+    }
+
+    out = put_sequence(out, out_end, &src[anchor], end - anchor, 0u, 0u);
+    if ((out == NULL) || (out == out_end))
+    {
+        return 0u;
+    }
+
+    return (uint32_t)(out - dst);
+}
+
+void compress_init(COMPRESS_T* compress, ARENA_OWNER_T owner, uint32_t block_size, bool dictionary)
+{
+    compress->history = dictionary ? DICTIONARY_SIZE : 0u;
+    compress->block_size = block_size;
+    compress->table = arena_alloc(owner, HASH_SIZE * sizeof(uint16_t));
+
+    uint8_t* window = arena_alloc(owner, compress->history + block_size);
+    memcpy(window, COMPRESS_DICTIONARY, compress->history);
+    compress->block = &window[compress->history];
+}
+
+__RAM_FUNC uint32_t compress_block(COMPRESS_T* compress, uint32_t length, uint8_t* frame)
+{
+    const uint32_t cycles = profile_start();
+    COMPRESS_FRAME_T header = { .magic = COMPRESS_MAGIC, .raw_length = (uint16_t)length, .flags = 0u };
+    uint8_t* payload = frame + sizeof(COMPRESS_FRAME_T);
+    const uint8_t* window = compress->block - compress->history;
+
+    uint32_t packed = lz_encode(compress->table, window, compress->history, compress->history + length, payload, length);
+    if (packed == 0u)
+    {
+        memcpy(payload, compress->block, length);
+        packed = length;
+        header.flags = COMPRESS_STORED;
+    }
+    else if (compress->history != 0u)
+    {
+        header.flags = (uint8_t)(COMPRESS_DICT | (COMPRESS_DICTIONARY_ID << COMPRESS_DICT_SHIFT));
+    }
+    header.packed_length = (uint16_t)packed;
+
+    const uint8_t* bytes = (const uint8_t*)&header;
+    for (uint32_t index = 0u; index < offsetof(COMPRESS_FRAME_T, check); index++)
+    {
+        header.check += bytes[index];
+    }
+    memcpy(frame, &header, sizeof(header));
+
+    profile_stop(PROFILE_COMPRESS, cycles);
+
+    return sizeof(COMPRESS_FRAME_T) + packed;
+}
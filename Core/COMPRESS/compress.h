@@ -0,0 +1,59 @@
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/**< A compressed log (LOGxxxxx.LZB) is a sequence of frames, each one expands on its own.
+ *   The payload is an LZ4 block (64K window, here bounded by the block size) or the raw bytes when they do not shrink.
+ *   All fields are little endian, Tools/lz_expand turns a file back into text. */
+
+#define COMPRESS_MAGIC      0x5a4cu /**< "LZ" */
+#define COMPRESS_STORED     0x01u   /**< Payload holds the raw bytes */
+#define COMPRESS_DICT       0x02u   /**< Matches may reach back into the static dictionary, its id is in the high nibble */
+#define COMPRESS_DICT_SHIFT 4u
+
+typedef struct
+{
+    uint16_t magic;
+    uint16_t raw_length;    /**< Bytes after expansion */
+    uint16_t packed_length; /**< Payload bytes following the header */
+    uint8_t flags;
+    uint8_t check; /**< Sum of the 7 bytes above, lets the expander tell a frame from garbage */
+} COMPRESS_FRAME_T;
+
+/**< Largest frame for a block: a stored block never grows beyond its header */
+#define COMPRESS_FRAME_SIZE(block_size) (sizeof(COMPRESS_FRAME_T) + (block_size))
+
+/**< One encoder: its match finder and the window the block is gathered in */
+typedef struct
+{
+    uint16_t* table;     /**< Last position of each hashed 4-byte sequence */
+    uint8_t* block;      /**< Raw bytes to compress, block_size bytes right after the history */
+    uint32_t history;    /**< Dictionary bytes in front of block */
+    uint32_t block_size; /**< At most COMPRESS_BLOCK_SIZE */
+} COMPRESS_T;
+
+/**
+ * @brief Take the window and the match finder of an encoder from an arena slice. Call once on boot.
+ *
+ * @param compress encoder
+ * @param owner slice the memory is charged to
+ * @param block_size largest block
+ * @param dictionary prime every block with the static dictionary (compress_dict.h)
+ */
+void compress_init(COMPRESS_T* compress, ARENA_OWNER_T owner, uint32_t block_size, bool dictionary);
+
+/**
+ * @brief Compress the first length bytes of compress->block into a frame
+ *
+ * @param compress encoder
+ * @param length bytes, at most block_size
+ * @param frame output, COMPRESS_FRAME_SIZE(block_size) bytes
+ * @return uint32_t frame size (header and payload)
+ */
+uint32_t compress_block(COMPRESS_T* compress, uint32_t length, uint8_t* frame);
+
+#endif // !_COMPRESS_H_
@@ -0,0 +1,21 @@
+#ifndef _COMPRESS_DICT_H_
+#define _COMPRESS_DICT_H_
+
+/**< Static dictionary of the ingest compression, shared by the firmware and Tools/lz_expand.
+ *   Each ingest block is encoded as if this text came right before it, so even a block holding a single line finds
+ *   matches. Built from the line formats of our QA serial logs: most frequent strings last, they stay in the match
+ *   finder. Changing it makes existing LOGxxxxx.LZB files unreadable, bump COMPRESS_DICTIONARY_ID with it. */
+
+#define COMPRESS_DICTIONARY_ID 1u
+
+#define COMPRESS_DICTIONARY                                                                                                     \
+    "0123456789abcdefABCDEF 0x00000000 0xffffffff 100.0% -1 "                                                                 \
+    "Mon Tue Wed Thu Fri Sat Sun Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec "                                              \
+    "temperature=humidity=pressure=voltage=current=power=speed=rpm=count=value=result=expected=actual=id=addr=len=crc="      \
+    " mV mA mW degC ms us Hz kHz MHz bytes "                                                                                   \
+    "Timeout timeout Retry retry Reset reset Init init Start start Stop stop Done done Ready ready Busy busy Error error "    \
+    "[DEBUG] [TRACE] [WARN] WARNING: Warning: [ERROR] ERROR: Error: [FAIL] FAIL [PASS] PASS [ OK ] OK\r\n"                     \
+    "Test case  test  step  passed\r\n failed\r\n status=OK\r\n status=FAIL\r\n"                                             \
+    "2026-01-01 00:00:00.000 [INFO] \r\n"
+
+#endif // !_COMPRESS_DICT_H_
@@ -0,0 +1,367 @@
+#include "config.h"
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+#include "define.h"
+#include "main.h"
+#include "sd.h"
+#include "spi_fram.h"
+
+#define CONFIG_MAGIC 0x4743u /**< "CG" */
+
+typedef struct
+{
+    uint16_t magic;
+    uint16_t version;   /**< CONFIG_VERSION */
+    uint16_t length;    /**< sizeof(CONFIG_CACHE_T) */
+    uint16_t file_date; /**< config.txt directory entry */
+    uint16_t file_time;
+    uint16_t reserved;
+    uint32_t file_size;
+    uint32_t file_hash; /**< FNV-1a of the parsed config.txt content */
+    LOGGER_CONFIG_T config;
+    uint32_t crc; /**< hcrc over all the fields above */
+} CONFIG_CACHE_T;
+
+typedef enum
+{
+    KEY_U32 = 0u,
+    KEY_BOOL,
+    KEY_MODE,
+    KEY_FRAMING,
+    KEY_COMPRESSION,
+    KEY_TIMESTAMPS,
+    KEY_CONTAINER,
+    KEY_INCLUDE, /**< Appends a rule, the key may repeat */
+    KEY_EXCLUDE,
+    KEY_TRIGGER,
+} CONFIG_KEY_TYPE_T;
+
+typedef struct
+{
+    const char* name;
+    CONFIG_KEY_TYPE_T type;
+    size_t offset;
+} CONFIG_KEY_T;
+
+static const CONFIG_KEY_T config_keys[] = {
+    { "baud", KEY_U32, offsetof(LOGGER_CONFIG_T, baudrate) },
+    { "mode", KEY_MODE, offsetof(LOGGER_CONFIG_T, mode) },
+    { "flush_bytes", KEY_U32, offsetof(LOGGER_CONFIG_T, flush_bytes) },
+    { "flush_idle_ms", KEY_U32, offsetof(LOGGER_CONFIG_T, flush_idle_ms) },
+    { "sleep_idle_ms", KEY_U32, offsetof(LOGGER_CONFIG_T, sleep_idle_ms) },
+    { "framing", KEY_FRAMING, offsetof(LOGGER_CONFIG_T, framing) },
+    { "timestamps", KEY_TIMESTAMPS, offsetof(LOGGER_CONFIG_T, timestamps) },
+    { "compression", KEY_COMPRESSION, offsetof(LOGGER_CONFIG_T, compression) },
+    { "container", KEY_CONTAINER, offsetof(LOGGER_CONFIG_T, container) },
+    { "dedup", KEY_BOOL, offsetof(LOGGER_CONFIG_T, dedup) },
+    { "include", KEY_INCLUDE, offsetof(LOGGER_CONFIG_T, filter) },
+    { "exclude", KEY_EXCLUDE, offsetof(LOGGER_CONFIG_T, filter) },
+    { "trigger", KEY_TRIGGER, offsetof(LOGGER_CONFIG_T, trigger) },
+    { "pre_trigger_kb", KEY_U32, offsetof(LOGGER_CONFIG_T, pre_trigger_kb) },
+    { "post_trigger_kb", KEY_U32, offsetof(LOGGER_CONFIG_T, post_trigger_kb) },
+};
+
+static const char* const mode_names[] = { "linear", "ring", "trigger" };
+static const char* const framing_names[] = { "none", "cobs", "slip" };
+static const char* const compression_names[] = { "none", "flush", "ingest" }; // 0 and 1 of the old boolean key still match
+static const char* const timestamps_names[] = { "none", "records", "text" };  // Same for the old boolean key
+static const char* const container_names[] = { "none", "blocks" };
+
+static CONFIG_CACHE_T cache;
+static bool cache_valid;
+static char text[CONFIG_FILE_MAX + 1u]; // Too big for the task stack
+
+static uint32_t config_crc(void)
+{
+    return HAL_CRC_Calculate(&hcrc, (uint32_t*)&cache, offsetof(CONFIG_CACHE_T, crc));
+}
+
+static uint32_t config_hash(const char* data, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t index = 0u; index < length; index++)
+    {
+        hash = (hash ^ (uint8_t)data[index]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static void config_store(void)
+{
+    cache.magic = CONFIG_MAGIC;
+    cache.version = CONFIG_VERSION;
+    cache.length = sizeof(CONFIG_CACHE_T);
+    cache.crc = config_crc();
+    cache_valid = fram_write(LOCATION_CONFIG_CACHE, (const uint8_t*)&cache, sizeof(cache));
+}
+
+static int config_lookup(const char* value, const char* const* names, uint32_t count)
+{
+    for (uint32_t index = 0u; index < count; index++)
+    {
+        if (strcmp(value, names[index]) == 0)
+        {
+            return (int)index;
+        }
+    }
+
+    return isdigit((unsigned char)value[0]) ? atoi(value) : -1;
+}
+
+static char* config_trim(char* str)
+{
+    while (isspace((unsigned char)*str))
+    {
+        str++;
+    }
+
+    char* end = str + strlen(str);
+    while ((end > str) && isspace((unsigned char)end[-1]))
+    {
+        *--end = '\0';
+    }
+
+    return str;
+}
+
+static void config_add_rule(char* rules, char kind, const char* pattern)
+{
+    const uint32_t used = strlen(rules);
+    const uint32_t length = strlen(pattern);
+
+    if ((length == 0u) || (used + length + 2u >= FILTER_RULES_SIZE))
+    {
+        log_info("config: filter rule %s ignored\r\n", pattern);
+        return;
+    }
+
+    rules[used] = kind;
+    memcpy(&rules[used + 1u], pattern, length);
+    rules[used + 1u + length] = '\n';
+    rules[used + 2u + length] = '\0';
+}
+
+static void config_set(LOGGER_CONFIG_T* config, const char* key, const char* value)
+{
+    for (uint32_t index = 0u; index < sizeof(config_keys) / sizeof(config_keys[0]); index++)
+    {
+        const CONFIG_KEY_T* entry = &config_keys[index];
+        if (strcmp(key, entry->name) != 0)
+        {
+            continue;
+        }
+
+        uint8_t* field = (uint8_t*)config + entry->offset;
+        int choice;
+        switch (entry->type)
+        {
+            case KEY_U32:
+                *(uint32_t*)field = strtoul(value, NULL, 0);
+                break;
+            case KEY_BOOL:
+                *(bool*)field = (value[0] == '1') || (value[0] == 'y') || (value[0] == 't');
+                break;
+            case KEY_MODE:
+                choice = config_lookup(value, mode_names, sizeof(mode_names) / sizeof(mode_names[0]));
+                if ((choice >= 0) && (choice < (int)(sizeof(mode_names) / sizeof(mode_names[0]))))
+                {
+                    *(LOGGER_MODE_T*)field = (LOGGER_MODE_T)choice;
+                }
+                break;
+            case KEY_FRAMING:
+                choice = config_lookup(value, framing_names, sizeof(framing_names) / sizeof(framing_names[0]));
+                if ((choice >= 0) && (choice < (int)(sizeof(framing_names) / sizeof(framing_names[0]))))
+                {
+                    *(LOGGER_FRAMING_T*)field = (LOGGER_FRAMING_T)choice;
+                }
+                break;
+            case KEY_COMPRESSION:
+                choice = config_lookup(value, compression_names, sizeof(compression_names) / sizeof(compression_names[0]));
+                if ((choice >= 0) && (choice < (int)(sizeof(compression_names) / sizeof(compression_names[0]))))
+                {
+                    *(LOGGER_COMPRESSION_T*)field = (LOGGER_COMPRESSION_T)choice;
+                }
+                break;
+            case KEY_TIMESTAMPS:
+                choice = config_lookup(value, timestamps_names, sizeof(timestamps_names) / sizeof(timestamps_names[0]));
+                if ((choice >= 0) && (choice < (int)(sizeof(timestamps_names) / sizeof(timestamps_names[0]))))
+                {
+                    *(LOGGER_TIMESTAMPS_T*)field = (LOGGER_TIMESTAMPS_T)choice;
+                }
+                break;
+            case KEY_CONTAINER:
+                choice = config_lookup(value, container_names, sizeof(container_names) / sizeof(container_names[0]));
+                if ((choice >= 0) && (choice < (int)(sizeof(container_names) / sizeof(container_names[0]))))
+                {
+                    *(LOGGER_CONTAINER_T*)field = (LOGGER_CONTAINER_T)choice;
+                }
+                break;
+            case KEY_INCLUDE:
+                config_add_rule((char*)field, '+', value);
+                break;
+            case KEY_EXCLUDE:
+                config_add_rule((char*)field, '-', value);
+                break;
+            case KEY_TRIGGER:
+                strncpy((char*)field, value, CAPTURE_TRIGGER_MAX - 1u);
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+
+    log_info("config: unknown key %s\r\n", key);
+}
+
+/* key=value lines, '#' starts a comment. The old "baud,mode,..." single line is still accepted. */
+static void config_parse(char* data, LOGGER_CONFIG_T* config)
+{
+    if (isdigit((unsigned char)data[0]))
+    {
+        char* save = NULL;
+        const char* baud = strtok_r(data, ",\r\n", &save);
+        const char* mode = strtok_r(NULL, ",\r\n", &save);
+        config->baudrate = (baud != NULL) ? strtoul(baud, NULL, 10) : config->baudrate;
+        config->mode = ((mode != NULL) && (mode[0] == '1')) ? RING_BUFFER : LINEAR_BUFFER;
+        return;
+    }
+
+    char* save = NULL;
+    for (char* line = strtok_r(data, "\r\n", &save); line != NULL; line = strtok_r(NULL, "\r\n", &save))
+    {
+        char* value = strchr(line, '=');
+        if ((line[0] == '#') || (value == NULL))
+        {
+            continue;
+        }
+        *value++ = '\0';
+        config_set(config, config_trim(line), config_trim(value));
+    }
+}
+
+static bool config_write_file(const LOGGER_CONFIG_T* config)
+{
+    int length = snprintf(
+        text,
+        sizeof(text),
+        "# SD Logger configuration, key=value\r\n"
+        "baud=%lu\r\nmode=%s\r\nflush_bytes=%lu\r\nflush_idle_ms=%lu\r\nsleep_idle_ms=%lu\r\n"
+        "framing=%s\r\ntimestamps=%s\r\ncompression=%s\r\ncontainer=%s\r\ndedup=%u\r\ntrigger=%s\r\npre_trigger_kb=%lu\r\npost_trigger_kb=%lu\r\n",
+        (unsigned long)config->baudrate,
+        mode_names[config->mode],
+        (unsigned long)config->flush_bytes,
+        (unsigned long)config->flush_idle_ms,
+        (unsigned long)config->sleep_idle_ms,
+        framing_names[config->framing],
+        timestamps_names[config->timestamps],
+        compression_names[config->compression],
+        container_names[config->container],
+        config->dedup,
+        config->trigger,
+        (unsigned long)config->pre_trigger_kb,
+        (unsigned long)config->post_trigger_kb);
+
+    /* The rules go back in file order, "+pattern\n" as include=pattern */
+    const char* rule = config->filter;
+    while ((*rule != '\0') && (length > 0) && (length < (int)sizeof(text)))
+    {
+        const char* end = strchr(rule, '\n');
+        const int size = (end != NULL) ? (int)(end - rule) : (int)strlen(rule);
+        length += snprintf(&text[length], sizeof(text) - (uint32_t)length, "%s=%.*s\r\n", (rule[0] == '+') ? "include" : "exclude", size - 1,
+                           &rule[1]);
+        rule += size + ((end != NULL) ? 1 : 0);
+    }
+
+    return (length > 0) && (length < (int)sizeof(text)) && sd_write_file(CONFIG_FILE, text, (uint32_t)length);
+}
+
+void config_default(LOGGER_CONFIG_T* config)
+{
+    memset(config, 0, sizeof(LOGGER_CONFIG_T));
+    config->baudrate = DEFAULT_BAUDRATE;
+    config->mode = LINEAR_BUFFER;
+    config->flush_bytes = BUFFER_MAX;
+    config->flush_idle_ms = 0u;
+    config->sleep_idle_ms = MAX_IDLE_TIME_MSEC;
+    config->framing = FRAMING_NONE;
+    config->timestamps = TIMESTAMPS_NONE;
+    config->compression = COMPRESSION_NONE;
+    config->container = CONTAINER_NONE;
+    config->dedup = false;
+    config->pre_trigger_kb = CAPTURE_PRE_KB;
+    config->post_trigger_kb = CAPTURE_POST_KB;
+}
+
+bool config_restore(LOGGER_CONFIG_T* config)
+{
+    cache_valid = fram_read(LOCATION_CONFIG_CACHE, (uint8_t*)&cache, sizeof(cache)) && (cache.magic == CONFIG_MAGIC) &&
+                  (cache.version == CONFIG_VERSION) && (cache.length == sizeof(CONFIG_CACHE_T)) && (cache.crc == config_crc());
+
+    if (cache_valid)
+    {
+        memcpy(config, &cache.config, sizeof(LOGGER_CONFIG_T));
+    }
+    else
+    {
+        config_default(config);
+        memset(&cache, 0, sizeof(cache));
+    }
+
+    return cache_valid;
+}
+
+bool config_refresh(LOGGER_CONFIG_T* config)
+{
+    uint32_t size = 0u;
+    uint16_t date = 0u;
+    uint16_t time = 0u;
+
+    if (!sd_stat_file(CONFIG_FILE, &size, &date, &time))
+    {
+        log_info("No config found - creating default!\r\n");
+        if (!config_write_file(config) || !sd_stat_file(CONFIG_FILE, &size, &date, &time))
+        {
+            return false;
+        }
+    }
+    else if (cache_valid && (size == cache.file_size) && (date == cache.file_date) && (time == cache.file_time))
+    {
+        return false; // Unchanged directory entry, the cached config is current
+    }
+
+    memset(text, 0, sizeof(text));
+    if (!sd_read_file(CONFIG_FILE, text, CONFIG_FILE_MAX))
+    {
+        return false;
+    }
+    const uint32_t length = strlen(text);
+
+    bool changed = false;
+    const uint32_t hash = config_hash(text, length);
+    if (!cache_valid || (hash != cache.file_hash))
+    {
+        LOGGER_CONFIG_T parsed;
+        config_default(&parsed);
+        config_parse(text, &parsed);
+        changed = memcmp(&parsed, config, sizeof(LOGGER_CONFIG_T)) != 0;
+        memcpy(config, &parsed, sizeof(LOGGER_CONFIG_T));
+        log_info("config.txt parsed%s\r\n", changed ? ", settings changed" : "");
+    }
+
+    cache.file_size = size;
+    cache.file_date = date;
+    cache.file_time = time;
+    cache.file_hash = hash;
+    memcpy(&cache.config, config, sizeof(LOGGER_CONFIG_T));
+    config_store();
+
+    return changed;
+}
@@ -0,0 +1,83 @@
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+
+typedef enum
+{
+    LINEAR_BUFFER = 0u,
+    RING_BUFFER,
+    TRIGGER_BUFFER, /**< FRAM keeps a history, only the windows around the trigger are written to CAPxxxxx files */
+} LOGGER_MODE_T;
+
+typedef enum
+{
+    FRAMING_NONE = 0u, /**< Raw bytes / text lines */
+    FRAMING_COBS,
+    FRAMING_SLIP,
+} LOGGER_FRAMING_T;
+
+typedef enum
+{
+    COMPRESSION_NONE = 0u, /**< Text to LOGxxxxx.TXT */
+    COMPRESSION_FLUSH,     /**< FRAM holds text, the flush compresses it into LOGxxxxx.LZB */
+    COMPRESSION_INGEST,    /**< The ingest compresses blocks before FRAM, the flush copies them into LOGxxxxx.LZB */
+} LOGGER_COMPRESSION_T;
+
+typedef enum
+{
+    TIMESTAMPS_NONE = 0u, /**< Received bytes are stored as they are */
+    TIMESTAMPS_RECORDS,   /**< Chunks are stored behind a header with their arrival time (ingest_record.h) */
+    TIMESTAMPS_TEXT,      /**< Every line is stored behind its arrival time as text (Core/STAMP) */
+} LOGGER_TIMESTAMPS_T;
+
+typedef enum
+{
+    CONTAINER_NONE = 0u, /**< The log file is the data as it is */
+    CONTAINER_BLOCKS,    /**< The data goes into CRC'd 512-byte blocks, LOGxxxxx.BLK (flush_block.h) */
+} LOGGER_CONTAINER_T;
+
+typedef struct
+{
+    uint32_t baudrate;
+    LOGGER_MODE_T mode;     /**< ring: a full FRAM ring drops its oldest bytes instead of the new ones */
+    uint32_t flush_bytes;   /**< Buffered bytes that start an SD flush */
+    uint32_t flush_idle_ms; /**< Flush buffered bytes after this long without input, 0 = never */
+    uint32_t sleep_idle_ms; /**< Enter STOP only after this long without input, 0 = whenever all tasks wait */
+    LOGGER_FRAMING_T framing;
+    LOGGER_TIMESTAMPS_T timestamps;
+    LOGGER_COMPRESSION_T compression;
+    LOGGER_CONTAINER_T container;
+    bool dedup; /**< Replace repeated lines with a summary */
+    char filter[FILTER_RULES_SIZE]; /**< include= and exclude= rules in file order, "+pattern\n" and "-pattern\n" */
+    char trigger[CAPTURE_TRIGGER_MAX]; /**< Pattern that starts a capture in TRIGGER_BUFFER mode */
+    uint32_t pre_trigger_kb;           /**< History kept in front of the trigger */
+    uint32_t post_trigger_kb;          /**< Captured after the trigger */
+} LOGGER_CONFIG_T;
+
+/**
+ * @brief Fill a configuration with the build defaults
+ */
+void config_default(LOGGER_CONFIG_T* config);
+
+/**
+ * @brief Load the configuration cached in FRAM, no SD access. Defaults are used if the cache is invalid.
+ *
+ * @param config output configuration
+ * @return true if the cache was valid
+ */
+bool config_restore(LOGGER_CONFIG_T* config);
+
+/**
+ * @brief Compare the directory entry of config.txt with the cached one and parse the file only if it changed.
+ *        A missing file is created with the current settings. The SD card must be mounted.
+ *
+ * @param config current configuration, updated in place
+ * @return true if the configuration changed
+ */
+bool config_refresh(LOGGER_CONFIG_T* config);
+
+#endif // !_CONFIG_H_
@@ -5,22 +5,252 @@
 
 #include "FreeRTOS.h"
 #include "FreeRTOSConfig.h"
+#include "arena.h"
 #include "cmsis_os.h"
 #include "console.h"
 #include "define.h"
 #include "main.h"
 #include "timer.h"
 
-void log_info(const char* fmt, ...)
+#define CONSOLE_TX_MASK (CONSOLE_TX_SIZE - 1u)
+
+/**< Deferred message, fmt is written last and marks the slot as complete */
+typedef struct
+{
+    const char* volatile fmt;
+    uint32_t tick;  /**< HAL tick when the message was queued */
+    uint32_t count; /**< Stored arguments */
+    uint32_t texts; /**< Bit n set if argument n is a string, from log_info(): fmt is not read on the target */
+    uint32_t args[CONSOLE_ARGS_MAX];
+    char text[CONSOLE_TEXT_MAX]; /**< Copies of the %s arguments, each one terminated, the args point here */
+} CONSOLE_RECORD_T;
+
+static CONSOLE_RECORD_T records[CONSOLE_RECORDS];
+static uint32_t record_head;          /**< Next slot to reserve, shared by all producers */
+static uint32_t record_tail;          /**< Next slot to format, console task only */
+static uint32_t dropped;
+static uint32_t dropped_reported;
+
+static uint8_t* tx_ring;             /**< CONSOLE_TX_SIZE bytes from ARENA_CONSOLE */
+static volatile uint16_t tx_head;    /**< Written by the console task only */
+static volatile uint16_t tx_tail;    /**< Advanced when a DMA transfer completes */
+static volatile uint16_t tx_sending; /**< Length of the running DMA transfer, 0 when idle */
+static volatile bool tx_waiting;     /**< Console task blocks until a transfer completes */
+static volatile bool tx_retry;       /**< The last kick found huart2 busy, the console task kicks again */
+static char line[CONSOLE_LINE_MAX]; /**< Formatted text or encoded binary record */
+
+static TaskHandle_t console_handle = NULL;
+
+static bool console_in_isr(void)
+{
+    return __get_IPSR() != 0u;
+}
+
+/* Start the next DMA transfer from the TX ring, called with the DMA interrupt masked or from it.
+   huart2 is shared with the ingest: a completion interrupt that lands while the ingest re-arms the RX DMA finds the
+   handle locked (HAL_BUSY). The console task runs below the ingest, when it retries the lock is free again. */
+static __RAM_FUNC void console_kick(void)
+{
+    const uint16_t used = (uint16_t)(tx_head - tx_tail);
+
+    if ((tx_sending != 0u) || (used == 0u))
+    {
+        tx_retry = false;
+        return;
+    }
+
+    const uint16_t offset = tx_tail & CONSOLE_TX_MASK;
+    const uint16_t length = (used < CONSOLE_TX_SIZE - offset) ? used : (uint16_t)(CONSOLE_TX_SIZE - offset);
+
+    tx_retry = HAL_UART_Transmit_DMA(&huart2, &tx_ring[offset], length) != HAL_OK;
+    if (!tx_retry)
+    {
+        tx_sending = length;
+    }
+}
+
+/* A UART re-init for a new baudrate aborts the transfer without a completion callback */
+static void console_recover(void)
+{
+    taskENTER_CRITICAL();
+    if ((tx_sending != 0u) && (huart2.gState == HAL_UART_STATE_READY))
+    {
+        tx_tail = (uint16_t)(tx_tail + tx_sending);
+        tx_sending = 0u;
+    }
+    console_kick();
+    taskEXIT_CRITICAL();
+}
+
+/* Copy a formatted line into the TX ring, waits for the DMA if there is no room */
+static void console_write(const char* data, uint16_t length)
+{
+    while (length > 0u)
+    {
+        const uint16_t space = (uint16_t)(CONSOLE_TX_SIZE - (uint16_t)(tx_head - tx_tail));
+        const uint16_t offset = tx_head & CONSOLE_TX_MASK;
+        uint16_t chunk = (length < space) ? length : space;
+        chunk = (chunk < CONSOLE_TX_SIZE - offset) ? chunk : (uint16_t)(CONSOLE_TX_SIZE - offset);
+
+        if (chunk == 0u)
+        {
+            tx_waiting = true;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONSOLE_TX_TIMEOUT_MS));
+            tx_waiting = false;
+            console_recover();
+            continue;
+        }
+
+        memcpy(&tx_ring[offset], data, chunk);
+        tx_head = (uint16_t)(tx_head + chunk);
+        data += chunk;
+        length = (uint16_t)(length - chunk);
+
+        taskENTER_CRITICAL();
+        console_kick();
+        taskEXIT_CRITICAL();
+    }
+}
+
+/* The caller's strings may be gone (or reused) by the time the console task formats, keep copies in the record */
+static void console_copy_strings(CONSOLE_RECORD_T* record)
+{
+    uint32_t used = 0u;
+
+    for (uint32_t index = 0u; index < record->count; index++)
+    {
+        if (((record->texts >> index) & 1u) == 0u)
+        {
+            continue;
+        }
+
+        const char* text = (const char*)(uintptr_t)record->args[index];
+        char* copy = &record->text[(used < CONSOLE_TEXT_MAX) ? used : (CONSOLE_TEXT_MAX - 1u)];
+        const uint32_t length = ((text != NULL) && (used < CONSOLE_TEXT_MAX)) ? strnlen(text, CONSOLE_TEXT_MAX - 1u - used) : 0u;
+
+        memcpy(copy, text, length); // Cut at the end of the slot
+        copy[length] = '\0';
+        record->args[index] = (uint32_t)(uintptr_t)copy;
+        used += length + 1u;
+    }
+}
+
+void console_log(const char* fmt, uint32_t count, uint32_t texts, ...)
 {
-    static char buffer[500];
+    uint32_t slot = __atomic_load_n(&record_head, __ATOMIC_RELAXED);
+
+    do
+    {
+        if (slot - __atomic_load_n(&record_tail, __ATOMIC_ACQUIRE) >= CONSOLE_RECORDS)
+        {
+            __atomic_fetch_add(&dropped, 1u, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&record_head, &slot, slot + 1u, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    CONSOLE_RECORD_T* record = &records[slot % CONSOLE_RECORDS];
+    record->tick = HAL_GetTick();
+    record->count = (count < CONSOLE_ARGS_MAX) ? count : CONSOLE_ARGS_MAX;
+    record->texts = texts;
     va_list args;
-    va_start(args, fmt);
-    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_start(args, texts);
+    for (uint32_t index = 0u; index < record->count; index++)
+    {
+        record->args[index] = va_arg(args, uint32_t);
+    }
     va_end(args);
+    console_copy_strings(record);
+    __atomic_store_n(&record->fmt, fmt, __ATOMIC_RELEASE);
+
+    if ((console_handle != NULL) && (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED))
+    {
+        if (console_in_isr())
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(console_handle, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+        else
+        {
+            xTaskNotifyGive(console_handle);
+        }
+    }
+}
 
-    int len = strlen(buffer);
-    HAL_UART_Transmit(&huart2, (uint8_t*)buffer, len, -1);
+uint32_t console_dropped(void)
+{
+    return dropped;
+}
+
+static void console_put32(uint8_t* dst, uint32_t value)
+{
+    dst[0u] = (uint8_t)value;
+    dst[1u] = (uint8_t)(value >> 8u);
+    dst[2u] = (uint8_t)(value >> 16u);
+    dst[3u] = (uint8_t)(value >> 24u);
+}
+
+/* Turn a record into console bytes in line[], returns the length */
+static uint16_t console_render(const CONSOLE_RECORD_T* record)
+{
+#ifdef CONSOLE_BINARY
+    const uint16_t id = (uint16_t)(uintptr_t)record->fmt; // .log_fmt is linked at address 0, behind a pad byte
+    uint8_t* out = (uint8_t*)line;
+    uint16_t length = (uint16_t)(CONSOLE_RECORD_HEADER + record->count * 4u);
+
+    out[0u] = CONSOLE_SYNC;
+    out[1u] = (uint8_t)record->count;
+    out[2u] = (uint8_t)id;
+    out[3u] = (uint8_t)(id >> 8u);
+    console_put32(&out[4u], record->tick);
+    for (uint32_t index = 0u; index < record->count; index++)
+    {
+        uint32_t value = record->args[index];
+        if (((record->texts >> index) & 1u) != 0u)
+        {
+            /* The string follows the arguments, the argument is its length */
+            const char* text = (const char*)(uintptr_t)value;
+            value = strlen(text);
+            memcpy(&out[length], text, value);
+            length = (uint16_t)(length + value);
+        }
+        console_put32(&out[CONSOLE_RECORD_HEADER + index * 4u], value);
+    }
+
+    return length;
+#else
+    const int length = snprintf(line, sizeof(line), record->fmt, record->args[0u], record->args[1u], record->args[2u], record->args[3u]);
+
+    return (length <= 0) ? 0u : (length < (int)sizeof(line)) ? (uint16_t)length : (uint16_t)(sizeof(line) - 1u);
+#endif
+}
+
+/* Format every completed record in order, a reserved but unfinished slot stops the walk */
+static void console_drain(void)
+{
+    static const char dropped_fmt[] CONSOLE_FMT_SECTION = "[console] %lu messages dropped\r\n";
+
+    while (record_tail != __atomic_load_n(&record_head, __ATOMIC_ACQUIRE))
+    {
+        CONSOLE_RECORD_T* record = &records[record_tail % CONSOLE_RECORDS];
+        if (__atomic_load_n(&record->fmt, __ATOMIC_ACQUIRE) == NULL)
+        {
+            break;
+        }
+
+        const uint16_t length = console_render(record);
+        record->fmt = NULL;
+        __atomic_store_n(&record_tail, record_tail + 1u, __ATOMIC_RELEASE);
+        console_write(line, length);
+    }
+
+    const uint32_t lost = dropped;
+    if (lost != dropped_reported)
+    {
+        const CONSOLE_RECORD_T report = { .fmt = dropped_fmt, .tick = HAL_GetTick(), .count = 1u, .args = { lost - dropped_reported } };
+        dropped_reported = lost;
+        console_write(line, console_render(&report));
+    }
 }
 
 static void console_task(void* arg)
@@ -29,18 +259,38 @@ static void console_task(void* arg)
 
     while (true)
     {
-        task_delay(1u);
+        /* Sleep until log_info() queues a message, a running transfer is checked for an abort now and then,
+           a refused one is started again on the next tick */
+        ulTaskNotifyTake(pdTRUE, tx_retry ? 1u : (tx_sending != 0u) ? pdMS_TO_TICKS(CONSOLE_TX_TIMEOUT_MS) : portMAX_DELAY);
+        console_drain();
+        console_recover();
     }
 }
 
 void console_task_entry(void)
 {
-    BaseType_t xReturned;
-    TaskHandle_t console_handle = NULL;
-    xReturned = xTaskCreate(console_task, "console", CONSOLE_STACK, NULL, CONSOLE_PRIORITY, &console_handle);
+    tx_ring = arena_alloc(ARENA_CONSOLE, CONSOLE_TX_SIZE);
+    console_handle = arena_create_task(console_task, "console", CONSOLE_STACK, CONSOLE_PRIORITY);
 
-    if (xReturned != pdPASS)
+    if (console_handle == NULL)
     {
         log_info("Console task initialization failed\r\n");
     }
-}
\ No newline at end of file
+}
+
+__RAM_FUNC void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
+{
+    if (huart->Instance == USART2)
+    {
+        tx_tail = (uint16_t)(tx_tail + tx_sending);
+        tx_sending = 0u;
+        console_kick();
+
+        if ((tx_waiting || tx_retry) && (console_handle != NULL))
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(console_handle, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+    }
+}
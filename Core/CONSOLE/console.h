@@ -2,14 +2,65 @@
 #define CONSOLE_H
 
 #include <stdarg.h> //for va_list var arg functions
+#include <stdint.h>
+
+#include "define.h"
+
+#define CONSOLE_ARGS_MAX 4u    /**< Conversions kept per message */
+#define CONSOLE_SYNC     0xa5u /**< First byte of a binary console record */
+
+/**< Binary console record: CONSOLE_SYNC, argument count, format id (LE16), HAL tick in ms (LE32), arguments (LE32),
+ *   then the bytes of the %s arguments in order, whose arguments hold their length instead of the pointer.
+ *   The format id is the offset of the format string in the .log_fmt section, which is not loaded on the target;
+ *   the section starts with a pad byte so no id is 0.
+ *   The build dumps the section into $(TARGET).fmt and Tools/log_decode turns a capture back into text. */
+#define CONSOLE_RECORD_HEADER 8u
+
+#define CONSOLE_NARGS(...)                                   CONSOLE_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define CONSOLE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+/**< Bit n set if argument n is a string, taken from the argument types at compile time. With CONSOLE_BINARY the
+ *   format lives in the unloaded .log_fmt section, the target never reads it to find the %s arguments. */
+#define CONSOLE_TEXT(arg)                                    _Generic((arg), char*: 1u, const char*: 1u, default: 0u)
+#define CONSOLE_TEXTS(...)                                   CONSOLE_TEXTS_(0, ##__VA_ARGS__, 0, 0, 0, 0)
+#define CONSOLE_TEXTS_(_0, _1, _2, _3, _4, ...)              (CONSOLE_TEXT(_1) | (CONSOLE_TEXT(_2) << 1u) | (CONSOLE_TEXT(_3) << 2u) | (CONSOLE_TEXT(_4) << 3u))
+
+#ifdef CONSOLE_BINARY
+    #define CONSOLE_FMT_SECTION __attribute__((section(".log_fmt"), used))
+#else
+    #define CONSOLE_FMT_SECTION
+#endif
 
 /**
- * @brief Custom console log function using UART
+ * @brief Queue a console message, safe from tasks and ISRs and never blocks.
+ *        Only fmt and up to CONSOLE_ARGS_MAX 32-bit arguments are stored, the console task
+ *        formats (or encodes, CONSOLE_BINARY) and sends them over USART2 TX DMA later.
+ *        String arguments (char pointers, %s) are copied into the message, CONSOLE_TEXT_MAX bytes for all of them
+ *        together, longer ones are cut. The message is dropped and counted if the queue is full.
  *
- * @param fmt arguments
+ * @param fmt string literal
  * @param ...
  */
-void log_info(const char* fmt, ...);
+#define log_info(fmt, ...)                                                                                                                                     \
+    do                                                                                                                                                         \
+    {                                                                                                                                                          \
+        static const char console_fmt[] CONSOLE_FMT_SECTION = fmt;                                                                                             \
+        console_log(console_fmt, CONSOLE_NARGS(__VA_ARGS__), CONSOLE_TEXTS(__VA_ARGS__), ##__VA_ARGS__);                                                       \
+    } while (0)
+
+/**
+ * @brief Backend of log_info(), use the macro so the format lands in the format table
+ *
+ * @param fmt format string
+ * @param count number of 32-bit arguments that follow
+ * @param texts CONSOLE_TEXTS() of the arguments, bit n set if argument n is a string
+ */
+void console_log(const char* fmt, uint32_t count, uint32_t texts, ...);
+
+/**
+ * @brief Messages dropped because the console queue was full
+ */
+uint32_t console_dropped(void);
 
 void console_task_entry(void);
 
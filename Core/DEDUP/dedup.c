@@ -0,0 +1,224 @@
+#include "dedup.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "define.h"
+#include "main.h"
+#include "timer.h"
+
+#define FNV_OFFSET  2166136261u
+#define FNV_PRIME   16777619u
+#define SUMMARY_MAX 80u
+
+static DEDUP_EMIT_T output;
+
+static uint8_t* line;         /**< Current line, DEDUP_LINE_MAX bytes from ARENA_INGEST */
+static uint32_t line_length;  /**< Bytes of the current line, also those already passed on */
+static uint32_t line_hash;    /**< FNV-1a of the current line so far */
+static bool line_passed;      /**< Current line already went out (too long or partial on idle), it is no repeat */
+
+static uint8_t* prev;        /**< Previous line, DEDUP_LINE_MAX bytes from ARENA_INGEST, swapped with line */
+static uint32_t prev_hash;
+static uint32_t prev_length; /**< 0 when the previous line cannot be repeated */
+
+static uint32_t repeats; /**< Dropped repeats of the open run */
+static uint64_t first_us;
+static uint64_t last_us;
+static uint32_t suppressed;
+
+static char* put_u32(char* dst, uint32_t value)
+{
+    char digits[10u];
+    uint32_t count = 0u;
+
+    do
+    {
+        digits[count++] = (char)('0' + (value % 10u));
+        value /= 10u;
+    } while (value != 0u);
+
+    while (count > 0u)
+    {
+        *dst++ = digits[--count];
+    }
+
+    return dst;
+}
+
+/* Seconds with milliseconds, "12.345" */
+static char* put_time(char* dst, uint64_t us)
+{
+    const uint32_t fraction = (uint32_t)((us / 1000u) % 1000u);
+
+    dst = put_u32(dst, (uint32_t)(us / 1000000u));
+    *dst++ = '.';
+    *dst++ = (char)('0' + fraction / 100u);
+    *dst++ = (char)('0' + (fraction / 10u) % 10u);
+    *dst++ = (char)('0' + fraction % 10u);
+
+    return dst;
+}
+
+static char* put_text(char* dst, const char* text)
+{
+    const uint32_t length = strlen(text);
+    memcpy(dst, text, length);
+
+    return dst + length;
+}
+
+/* "[dedup] last line repeated N times, 12.345 s .. 67.890 s" */
+static void dedup_close_run(void)
+{
+    if (repeats == 0u)
+    {
+        return;
+    }
+
+    char summary[SUMMARY_MAX];
+    char* end = put_text(summary, "[dedup] last line repeated ");
+    end = put_u32(end, repeats);
+    end = put_text(end, (repeats == 1u) ? " time, " : " times, ");
+    end = put_time(end, first_us);
+    end = put_text(end, " s .. ");
+    end = put_time(end, last_us);
+    end = put_text(end, " s\r\n");
+    output((const uint8_t*)summary, (uint32_t)(end - summary));
+
+    repeats = 0u;
+}
+
+/* Send what is held of the current line on, from now on its bytes pass straight through */
+static __RAM_FUNC void dedup_pass_line(void)
+{
+    dedup_close_run();
+    output(line, line_length);
+    line_passed = true;
+}
+
+static __RAM_FUNC void dedup_append(const uint8_t* data, uint32_t length)
+{
+    uint32_t hash = line_hash;
+    for (uint32_t index = 0u; index < length; index++)
+    {
+        hash = (hash ^ data[index]) * FNV_PRIME;
+    }
+    line_hash = hash;
+
+    if (!line_passed && (line_length + length > DEDUP_LINE_MAX))
+    {
+        dedup_pass_line();
+    }
+    if (line_passed)
+    {
+        output(data, length);
+    }
+    else
+    {
+        memcpy(&line[line_length], data, length);
+    }
+    line_length += length;
+}
+
+/* The hash only rules a repeat out, a line that matches it is compared with the one kept */
+static __RAM_FUNC void dedup_line_end(uint64_t now_us)
+{
+    if (!line_passed && (line_length == prev_length) && (line_hash == prev_hash) && (memcmp(line, prev, line_length) == 0))
+    {
+        if (repeats == 0u)
+        {
+            first_us = now_us;
+        }
+        repeats++;
+        last_us = now_us;
+        suppressed += line_length;
+    }
+    else
+    {
+        if (!line_passed)
+        {
+            dedup_close_run();
+            output(line, line_length);
+        }
+        prev_hash = line_hash;
+        prev_length = line_passed ? 0u : line_length;
+
+        uint8_t* kept = prev;
+        prev = line;
+        line = kept;
+    }
+
+    line_length = 0u;
+    line_hash = FNV_OFFSET;
+    line_passed = false;
+}
+
+void dedup_init(DEDUP_EMIT_T emit)
+{
+    output = emit;
+    line = arena_alloc(ARENA_INGEST, DEDUP_LINE_MAX);
+    prev = arena_alloc(ARENA_INGEST, DEDUP_LINE_MAX);
+    line_hash = FNV_OFFSET;
+}
+
+__RAM_FUNC void dedup_feed(const uint8_t* data, uint32_t length, uint64_t now_us)
+{
+    while (length > 0u)
+    {
+        const uint8_t* newline = memchr(data, '\n', length);
+        const uint32_t part = (newline != NULL) ? (uint32_t)(newline - data) + 1u : length;
+
+        dedup_append(data, part);
+        if (newline != NULL)
+        {
+            dedup_line_end(now_us);
+        }
+        data += part;
+        length -= part;
+    }
+}
+
+void dedup_idle(void)
+{
+    if (dedup_holding())
+    {
+        dedup_pass_line();
+    }
+}
+
+uint64_t dedup_poll(uint64_t now_us)
+{
+    if (repeats == 0u)
+    {
+        return TIMER_NEVER;
+    }
+
+    const uint64_t deadline = first_us + (uint64_t)DEDUP_RUN_MS * 1000u;
+    if (now_us >= deadline)
+    {
+        dedup_close_run();
+        return TIMER_NEVER;
+    }
+
+    return deadline;
+}
+
+void dedup_flush(void)
+{
+    dedup_close_run();
+    dedup_idle();
+    prev_length = 0u;
+}
+
+bool dedup_holding(void)
+{
+    return (line_length != 0u) && !line_passed;
+}
+
+uint32_t dedup_suppressed(void)
+{
+    return suppressed;
+}
@@ -0,0 +1,61 @@
+#ifndef _DEDUP_H_
+#define _DEDUP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**< Duplicate line suppression on the ingest path. Each complete line is hashed while it streams in and compared
+ *   with the previous one; repeats are dropped and counted. When the run ends (another line, a partial line going out
+ *   on idle, or DEDUP_RUN_MS after its first repeat) one summary line with the count and the times of the first and
+ *   the last dropped repeat is emitted in its place. Lines longer than DEDUP_LINE_MAX pass unfiltered. */
+
+/**
+ * @brief Output of the filter, the ingest stores it in FRAM
+ */
+typedef void (*DEDUP_EMIT_T)(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Take the current and previous line buffers from ARENA_INGEST. Call once on boot.
+ *
+ * @param emit output for passed lines and summaries
+ */
+void dedup_init(DEDUP_EMIT_T emit);
+
+/**
+ * @brief Filter received bytes
+ *
+ * @param data received bytes
+ * @param length bytes
+ * @param now_us arrival time, timer_now_us()
+ */
+void dedup_feed(const uint8_t* data, uint32_t length, uint64_t now_us);
+
+/**
+ * @brief The input went quiet: a held partial line goes out, it can no longer be a repeat
+ */
+void dedup_idle(void);
+
+/**
+ * @brief End a run that is DEDUP_RUN_MS old, call on every ingest wake
+ *
+ * @param now_us timer_now_us()
+ * @return uint64_t deadline of the open run (timer.h), TIMER_NEVER without a run
+ */
+uint64_t dedup_poll(uint64_t now_us);
+
+/**
+ * @brief Emit the pending summary and the held partial line, before the filter is switched off
+ */
+void dedup_flush(void);
+
+/**
+ * @brief true while a partial line waits in the line buffer, dedup_idle() has to run after INGEST_SEAL_MS
+ */
+bool dedup_holding(void);
+
+/**
+ * @brief Bytes dropped as repeats since boot
+ */
+uint32_t dedup_suppressed(void);
+
+#endif // !_DEDUP_H_
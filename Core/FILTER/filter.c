@@ -0,0 +1,406 @@
+#include "filter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "console.h"
+#include "define.h"
+#include "main.h"
+
+#define FILTER_NONE 0xffu /**< No state, no piece */
+
+typedef enum
+{
+    LINE_HOLD = 0u, /**< Undecided, bytes are held */
+    LINE_PASS,      /**< Kept, the rest of the line goes straight out */
+    LINE_DROP,      /**< Dropped, the rest of the line is skipped */
+} FILTER_LINE_T;
+
+/**< A piece of a pattern between '*', one keyword of the automaton */
+typedef struct
+{
+    uint8_t rule;
+    uint8_t index;  /**< Position of the piece in its pattern */
+    uint8_t length;
+    uint8_t next;   /**< Next piece ending in the same state */
+} FILTER_PIECE_T;
+
+typedef struct
+{
+    const char* pattern; /**< In rules_text, for the report */
+    uint8_t pieces;
+    bool anchored;
+} FILTER_RULE_T;
+
+static FILTER_EMIT_T output;
+
+/* Automaton */
+static uint8_t* delta;                   /**< FILTER_STATES x FILTER_CLASSES next states from ARENA_INGEST */
+static uint8_t class_map[256u];          /**< Byte to class, 0 for bytes in no pattern */
+static uint8_t class_count;
+static uint8_t state_count;
+static uint8_t out_first[FILTER_STATES]; /**< First piece ending in a state */
+static uint8_t out_link[FILTER_STATES];  /**< Nearest state on the failure chain with pieces */
+static bool hit[FILTER_STATES];          /**< A piece ends in this state or on its failure chain */
+static uint8_t fail[FILTER_STATES];
+static uint8_t queue[FILTER_STATES];
+
+/* Rules */
+static char rules_text[FILTER_RULES_SIZE];
+static FILTER_RULE_T rules[FILTER_RULES];
+static FILTER_PIECE_T pieces[FILTER_PIECES];
+static uint8_t rule_count;
+static uint8_t piece_count;
+static uint8_t include_mask;
+static uint8_t exclude_mask;
+static uint8_t always_mask; /**< Rules without pieces ("*") match every line */
+static uint32_t dropped[FILTER_RULES];
+static uint32_t unmatched; /**< Lines dropped because no include rule matched */
+
+/* Current line */
+static uint8_t* line; /**< FILTER_LINE_MAX bytes from ARENA_INGEST */
+static uint32_t line_length;
+static uint32_t position;
+static uint8_t state;
+static uint8_t matched;
+static uint8_t next_piece[FILTER_RULES];
+static uint32_t min_start[FILTER_RULES];
+static FILTER_LINE_T decision;
+
+static uint8_t filter_class(uint8_t byte)
+{
+    if ((class_map[byte] == 0u) && (class_count < FILTER_CLASSES))
+    {
+        class_map[byte] = class_count++;
+    }
+
+    return class_map[byte];
+}
+
+static bool filter_add_piece(uint8_t rule, uint8_t index, const char* text, uint32_t length)
+{
+    if ((piece_count == FILTER_PIECES) || (length > UINT8_MAX))
+    {
+        return false;
+    }
+
+    uint8_t current = 0u;
+    for (uint32_t offset = 0u; offset < length; offset++)
+    {
+        const uint8_t cls = filter_class((uint8_t)text[offset]);
+        if (cls == 0u)
+        {
+            return false; // More distinct bytes than FILTER_CLASSES
+        }
+
+        uint8_t* next = &delta[current * FILTER_CLASSES + cls];
+        if (*next == FILTER_NONE)
+        {
+            if (state_count == FILTER_STATES)
+            {
+                return false;
+            }
+            *next = state_count++;
+        }
+        current = *next;
+    }
+
+    pieces[piece_count] = (FILTER_PIECE_T){ .rule = rule, .index = index, .length = (uint8_t)length, .next = out_first[current] };
+    out_first[current] = piece_count++;
+
+    return true;
+}
+
+/* "^abc*def": optional anchor, pieces split at '*', empty pieces skipped */
+static bool filter_add_rule(char kind, const char* pattern)
+{
+    if (rule_count == FILTER_RULES)
+    {
+        return false;
+    }
+
+    const uint8_t rule = rule_count++;
+    rules[rule] = (FILTER_RULE_T){ .pattern = pattern, .pieces = 0u, .anchored = pattern[0] == '^' };
+    if (kind == '+')
+    {
+        include_mask |= (uint8_t)(1u << rule);
+    }
+    else
+    {
+        exclude_mask |= (uint8_t)(1u << rule);
+    }
+
+    const char* text = rules[rule].anchored ? pattern + 1 : pattern;
+    while (*text != '\0')
+    {
+        const char* star = strchr(text, '*');
+        const uint32_t length = (star != NULL) ? (uint32_t)(star - text) : strlen(text);
+
+        if (length != 0u)
+        {
+            if (!filter_add_piece(rule, rules[rule].pieces, text, length))
+            {
+                return false;
+            }
+            rules[rule].pieces++;
+        }
+        else if (rules[rule].pieces == 0u)
+        {
+            rules[rule].anchored = false; // "^*abc" is "abc"
+        }
+        text += length + ((star != NULL) ? 1u : 0u);
+    }
+
+    if (rules[rule].pieces == 0u)
+    {
+        always_mask |= (uint8_t)(1u << rule);
+    }
+
+    return true;
+}
+
+/* Failure links in breadth first order, missing transitions are filled in from the failure state */
+static void filter_build(void)
+{
+    uint32_t head = 0u;
+    uint32_t tail = 0u;
+
+    for (uint32_t cls = 0u; cls < class_count; cls++)
+    {
+        const uint8_t child = delta[cls];
+        if (child == FILTER_NONE)
+        {
+            delta[cls] = 0u;
+        }
+        else
+        {
+            fail[child] = 0u;
+            out_link[child] = FILTER_NONE;
+            queue[tail++] = child;
+        }
+    }
+
+    while (head < tail)
+    {
+        const uint8_t current = queue[head++];
+        hit[current] = (out_first[current] != FILTER_NONE) || (out_link[current] != FILTER_NONE);
+
+        for (uint32_t cls = 0u; cls < class_count; cls++)
+        {
+            uint8_t* next = &delta[current * FILTER_CLASSES + cls];
+            const uint8_t fallback = delta[fail[current] * FILTER_CLASSES + cls];
+            if (*next == FILTER_NONE)
+            {
+                *next = fallback;
+                continue;
+            }
+
+            const uint8_t child = *next;
+            fail[child] = fallback;
+            out_link[child] = (out_first[fallback] != FILTER_NONE) ? fallback : out_link[fallback];
+            queue[tail++] = child;
+        }
+    }
+}
+
+static __RAM_FUNC void filter_line_reset(void)
+{
+    line_length = 0u;
+    position = 0u;
+    state = 0u;
+    matched = always_mask;
+    memset(next_piece, 0, sizeof(next_piece));
+    memset(min_start, 0, sizeof(min_start));
+    decision = LINE_HOLD;
+}
+
+/* Pieces ending at the current position advance their rule if they come in order and do not overlap */
+static __RAM_FUNC void filter_match(void)
+{
+    for (uint8_t current = state; current != FILTER_NONE; current = out_link[current])
+    {
+        for (uint8_t index = out_first[current]; index != FILTER_NONE; index = pieces[index].next)
+        {
+            const FILTER_PIECE_T* piece = &pieces[index];
+            const uint8_t rule = piece->rule;
+            const uint32_t start = position + 1u - piece->length;
+
+            if (((matched >> rule) & 1u) || (piece->index != next_piece[rule]) || (start < min_start[rule]) ||
+                ((piece->index == 0u) && rules[rule].anchored && (start != 0u)))
+            {
+                continue;
+            }
+
+            min_start[rule] = position + 1u;
+            if (++next_piece[rule] == rules[rule].pieces)
+            {
+                matched |= (uint8_t)(1u << rule);
+            }
+        }
+    }
+}
+
+/* Decide with what was seen of the line, a kept line goes out and its remaining bytes follow unfiltered */
+static __RAM_FUNC void filter_decide(void)
+{
+    const uint8_t excluded = matched & exclude_mask;
+
+    if (excluded != 0u)
+    {
+        dropped[__builtin_ctz(excluded)]++;
+        decision = LINE_DROP;
+    }
+    else if ((include_mask != 0u) && ((matched & include_mask) == 0u))
+    {
+        unmatched++;
+        decision = LINE_DROP;
+    }
+    else
+    {
+        output(line, line_length);
+        decision = LINE_PASS;
+    }
+}
+
+static __RAM_FUNC void filter_scan(const uint8_t* data, uint32_t length)
+{
+    if (decision == LINE_HOLD)
+    {
+        for (uint32_t index = 0u; index < length; index++, position++)
+        {
+            state = delta[state * FILTER_CLASSES + class_map[data[index]]];
+            if (hit[state])
+            {
+                filter_match();
+            }
+        }
+
+        if (((matched & exclude_mask) != 0u) || ((exclude_mask == 0u) && ((matched & include_mask) != 0u)))
+        {
+            filter_decide(); // Settled early: an exclude rule hit, or an include rule hit and nothing can exclude
+        }
+        else if (line_length + length > FILTER_LINE_MAX)
+        {
+            filter_decide();
+        }
+        else
+        {
+            memcpy(&line[line_length], data, length);
+            line_length += length;
+            return;
+        }
+    }
+
+    if (decision == LINE_PASS)
+    {
+        output(data, length);
+    }
+}
+
+void filter_init(FILTER_EMIT_T emit)
+{
+    output = emit;
+    delta = arena_alloc(ARENA_INGEST, FILTER_STATES * FILTER_CLASSES);
+    line = arena_alloc(ARENA_INGEST, FILTER_LINE_MAX);
+}
+
+bool filter_compile(const char* text)
+{
+    filter_idle();
+
+    rule_count = 0u;
+    piece_count = 0u;
+    include_mask = 0u;
+    exclude_mask = 0u;
+    always_mask = 0u;
+    class_count = 1u;
+    state_count = 1u;
+    memset(class_map, 0, sizeof(class_map));
+    memset(delta, FILTER_NONE, FILTER_STATES * FILTER_CLASSES);
+    memset(out_first, FILTER_NONE, sizeof(out_first));
+    memset(out_link, FILTER_NONE, sizeof(out_link));
+    memset(hit, 0, sizeof(hit));
+    memset(dropped, 0, sizeof(dropped));
+    unmatched = 0u;
+
+    strncpy(rules_text, text, sizeof(rules_text) - 1u);
+    rules_text[sizeof(rules_text) - 1u] = '\0';
+
+    bool ok = true;
+    char* save = NULL;
+    for (char* rule = strtok_r(rules_text, "\r\n", &save); ok && (rule != NULL); rule = strtok_r(NULL, "\r\n", &save))
+    {
+        if (((rule[0] == '+') || (rule[0] == '-')) && (rule[1] != '\0'))
+        {
+            ok = filter_add_rule(rule[0], &rule[1]);
+        }
+    }
+
+    if (!ok)
+    {
+        rule_count = 0u;
+    }
+    if (rule_count != 0u)
+    {
+        filter_build();
+    }
+    filter_line_reset();
+
+    return ok;
+}
+
+bool filter_active(void)
+{
+    return rule_count != 0u;
+}
+
+__RAM_FUNC void filter_feed(const uint8_t* data, uint32_t length)
+{
+    while (length > 0u)
+    {
+        const uint8_t* newline = memchr(data, '\n', length);
+        const uint32_t part = (newline != NULL) ? (uint32_t)(newline - data) + 1u : length;
+
+        filter_scan(data, part);
+        if (newline != NULL)
+        {
+            if (decision == LINE_HOLD)
+            {
+                filter_decide();
+            }
+            filter_line_reset();
+        }
+        data += part;
+        length -= part;
+    }
+}
+
+void filter_idle(void)
+{
+    if (filter_holding())
+    {
+        filter_decide();
+    }
+}
+
+bool filter_holding(void)
+{
+    return (decision == LINE_HOLD) && (line_length != 0u);
+}
+
+void filter_report(void)
+{
+    for (uint32_t rule = 0u; rule < rule_count; rule++)
+    {
+        if ((exclude_mask >> rule) & 1u)
+        {
+            log_info("[filter] exclude %s: %lu lines dropped\r\n", rules[rule].pattern, dropped[rule]);
+        }
+    }
+    if (include_mask != 0u)
+    {
+        log_info("[filter] no include rule matched: %lu lines dropped\r\n", unmatched);
+    }
+}
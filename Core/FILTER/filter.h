@@ -0,0 +1,60 @@
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**< Line filter on the ingest path, rules from config.txt:
+ *     include=<pattern>  keep only lines matching one of the include rules (all lines if there is none)
+ *     exclude=<pattern>  drop lines matching the pattern, wins over include
+ *   A pattern is a substring, '^' anchors it to the start of the line and '*' matches anything in between
+ *   ("^[DBG]*retry"). All pattern pieces are compiled into one Aho-Corasick automaton with a complete transition
+ *   table over byte classes, so the cost per received byte is one table lookup whatever the rules.
+ *   Lines are held until they are decided, lines longer than FILTER_LINE_MAX are decided on their first bytes. */
+
+/**
+ * @brief Output of the filter, kept lines go on to the next ingest stage
+ */
+typedef void (*FILTER_EMIT_T)(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Take the transition table and the line buffer from ARENA_INGEST. Call once on boot.
+ *
+ * @param emit output for kept lines
+ */
+void filter_init(FILTER_EMIT_T emit);
+
+/**
+ * @brief Replace the rules, a held line is decided with the old ones first. Not safe against filter_feed().
+ *
+ * @param rules one rule per line, '+' include or '-' exclude followed by the pattern
+ * @return true if the rules fit into the automaton, otherwise the filter passes everything
+ */
+bool filter_compile(const char* rules);
+
+/**
+ * @brief true if rules are compiled, otherwise the ingest bypasses the filter
+ */
+bool filter_active(void);
+
+/**
+ * @brief Filter received bytes
+ */
+void filter_feed(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief The input went quiet: decide a held partial line with what was seen of it
+ */
+void filter_idle(void);
+
+/**
+ * @brief true while an undecided partial line waits in the line buffer
+ */
+bool filter_holding(void);
+
+/**
+ * @brief Print the lines dropped by every rule
+ */
+void filter_report(void);
+
+#endif // !_FILTER_H_
@@ -0,0 +1,825 @@
+#include "flush.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "compress.h"
+#include "console.h"
+#include "define.h"
+#include "flush_block.h"
+#include "flush_index.h"
+#include "ingest.h"
+#include "ingest_record.h"
+#include "main.h"
+#include "profile.h"
+#include "sd.h"
+#include "spi_fram.h"
+
+#define CHECKPOINT_MAGIC 0x4b43u /**< "CK" */
+#define APPEND_TO_END    UINT32_MAX
+#define FLUSH_PACKED     (FLUSH_COMPRESSED | FLUSH_FRAMED)
+#define CRC32_POLYNOMIAL 0x04c11db7u
+
+static FLUSH_CHECKPOINT_T checkpoint;
+static uint8_t* transfer_buffer; /**< FLUSH_TRANSFER_SIZE bytes from ARENA_FLUSH */
+static COMPRESS_T compress;      /**< Gathers one raw chunk and compresses it, from ARENA_COMPRESS */
+static uint8_t* frame_buffer;    /**< Its compressed frame from ARENA_COMPRESS */
+static FLUSH_INDEX_SUMMARY_T summary;    /**< Of the log file being flushed, lines are counted as they are written */
+static bool index_open;                  /**< The index of the log file is open, it is given up after an error */
+static bool index_dirty;                 /**< Entries or a filter written since the last sync of the index */
+static uint8_t bloom[FLUSH_INDEX_BLOOM]; /**< Word filter of index entry bloom_entry, stored when its stride is complete */
+static uint32_t bloom_entry;             /**< Entry of the last byte of the last piece */
+static uint32_t block_offset;            /**< File offset of the open block of a BLK log, the write pointer stays there */
+static uint32_t block_fill;              /**< Payload bytes in the open block, they wait in transfer_buffer */
+static uint64_t block_us;                /**< first_us of the open block */
+static uint32_t block_fram;              /**< FRAM address the open block is rebuilt from, its first byte or the chunk of its first frame */
+static uint16_t block_skip;              /**< Bytes of that frame in sealed blocks */
+static uint16_t block_chunk;             /**< Raw length of that chunk, 0 for text */
+static uint32_t rebuilt_offset;          /**< Block rebuilt from FRAM with its index entry in place, UINT32_MAX if none */
+static uint32_t counted;                 /**< Bytes still to copy into the rebuilt block that the summary and filter hold */
+
+/**< CRC unit registers of hcrc while it computes a CRC-32 */
+typedef struct
+{
+    uint32_t cr;
+    uint32_t init;
+    uint32_t pol;
+} FLUSH_CRC_SAVE_T;
+
+/**< Word being hashed for the filter, carried from piece to piece and from flush to flush */
+typedef struct
+{
+    uint32_t hash; /**< FNV-1a of the word so far, in lower case */
+    bool active;   /**< Inside a word */
+    bool number;   /**< The word starts with a digit, it is not filtered */
+    uint8_t skip;  /**< Record header bytes still to skip */
+} FLUSH_WORD_T;
+
+static FLUSH_WORD_T word;
+
+static __RAM_FUNC uint32_t checkpoint_crc(const FLUSH_CHECKPOINT_T* cp)
+{
+    const uint32_t cycles = profile_start();
+    const uint32_t crc = HAL_CRC_Calculate(&hcrc, (uint32_t*)cp, offsetof(FLUSH_CHECKPOINT_T, crc));
+    profile_stop(PROFILE_CRC, cycles);
+
+    return crc;
+}
+
+static bool checkpoint_load(FLUSH_CHECKPOINT_T* cp, uint32_t addr)
+{
+    if (!fram_read(addr, (uint8_t*)cp, sizeof(FLUSH_CHECKPOINT_T)))
+    {
+        return false;
+    }
+
+    return (cp->magic == CHECKPOINT_MAGIC) && (cp->crc == checkpoint_crc(cp));
+}
+
+/* Slots are written alternately so a power loss during the store keeps the previous checkpoint */
+static bool checkpoint_store(void)
+{
+    checkpoint.magic = CHECKPOINT_MAGIC;
+    checkpoint.sequence++;
+    checkpoint.crc = checkpoint_crc(&checkpoint);
+
+    const uint32_t addr = (checkpoint.sequence & 1u) ? LOCATION_CHECKPOINT_B : LOCATION_CHECKPOINT_A;
+
+    return fram_write(addr, (const uint8_t*)&checkpoint, sizeof(checkpoint));
+}
+
+static const char* flush_prefix(uint8_t flags)
+{
+    return ((flags & FLUSH_CAPTURE) != 0u) ? "CAP" : "LOG";
+}
+
+static const char* flush_extension(uint8_t flags)
+{
+    if ((flags & FLUSH_CONTAINER) != 0u)
+    {
+        return "BLK";
+    }
+
+    return ((flags & FLUSH_PACKED) != 0u) ? "LZB" : ((flags & FLUSH_RECORDS) != 0u) ? "TSR" : "TXT";
+}
+
+/* The CRC unit is set up for the 16-bit checkpoint CRC (hcrc): take it over for the standard CRC-32 and put it back.
+   Bit reversal by word feeds every little endian word byte by byte, least significant bit first, like zlib. */
+static __RAM_FUNC void crc32_begin(FLUSH_CRC_SAVE_T* save)
+{
+    save->cr = CRC->CR;
+    save->init = CRC->INIT;
+    save->pol = CRC->POL;
+
+    CRC->POL = CRC32_POLYNOMIAL;
+    CRC->INIT = UINT32_MAX;
+    CRC->CR = CRC_CR_REV_IN | CRC_CR_REV_OUT | CRC_CR_RESET; // 32-bit polynomial
+}
+
+static __RAM_FUNC void crc32_words(const uint32_t* words, uint32_t count)
+{
+    for (uint32_t index = 0u; index < count; index++)
+    {
+        CRC->DR = words[index];
+    }
+}
+
+static __RAM_FUNC uint32_t crc32_end(const FLUSH_CRC_SAVE_T* save)
+{
+    const uint32_t crc = ~CRC->DR;
+
+    CRC->POL = save->pol;
+    CRC->INIT = save->init;
+    CRC->CR = save->cr;
+
+    return crc;
+}
+
+static __RAM_FUNC uint32_t flush_block_crc(const uint8_t* block)
+{
+    FLUSH_CRC_SAVE_T save;
+
+    crc32_begin(&save);
+    crc32_words((const uint32_t*)block, offsetof(FLUSH_BLOCK_T, crc) / sizeof(uint32_t));
+    crc32_words((const uint32_t*)&block[sizeof(FLUSH_BLOCK_T)], FLUSH_BLOCK_PAYLOAD / sizeof(uint32_t));
+
+    return crc32_end(&save);
+}
+
+static uint32_t flush_summary_crc(const FLUSH_INDEX_SUMMARY_T* index_summary)
+{
+    FLUSH_CRC_SAVE_T save;
+
+    crc32_begin(&save);
+    crc32_words((const uint32_t*)index_summary, offsetof(FLUSH_INDEX_SUMMARY_T, crc) / sizeof(uint32_t));
+
+    return crc32_end(&save);
+}
+
+static uint8_t flush_block_content(void)
+{
+    return (((checkpoint.flags & FLUSH_PACKED) != 0u) ? FLUSH_BLOCK_PACKED : 0u) | (((checkpoint.flags & FLUSH_RECORDS) != 0u) ? FLUSH_BLOCK_RECORDS : 0u);
+}
+
+static uint32_t ring_distance(uint32_t from, uint32_t to)
+{
+    return (to >= from) ? (to - from) : (LOCATION_BUFFER_SIZE - (from - to));
+}
+
+/* Size of a BLK log with its open block */
+static uint32_t flush_block_size(void)
+{
+    return block_offset + ((block_fill != 0u) ? FLUSH_BLOCK_SIZE : 0u);
+}
+
+/* Wrap the open block in its header and write it where it starts. A full block is done and the next one is opened, a
+   partly filled one stays open: the write pointer goes back and its next write replaces it on the same sector. */
+static __RAM_FUNC bool flush_block_write(void)
+{
+    FLUSH_BLOCK_T* block = (FLUSH_BLOCK_T*)transfer_buffer;
+
+    memset(&transfer_buffer[sizeof(FLUSH_BLOCK_T) + block_fill], 0, FLUSH_BLOCK_PAYLOAD - block_fill);
+    *block = (FLUSH_BLOCK_T){
+        .sync = FLUSH_BLOCK_SYNC,
+        .sequence = block_offset / FLUSH_BLOCK_SIZE,
+        .first_us = block_us,
+        .length = (uint16_t)block_fill,
+        .content = flush_block_content(),
+    };
+    block->crc = flush_block_crc(transfer_buffer);
+
+    if (!sd_log_write(transfer_buffer, FLUSH_BLOCK_SIZE))
+    {
+        return false;
+    }
+    if (block_fill < FLUSH_BLOCK_PAYLOAD)
+    {
+        return sd_log_seek(block_offset);
+    }
+    block_offset += FLUSH_BLOCK_SIZE;
+    block_fill = 0u;
+
+    return true;
+}
+
+/* A BLK log goes on in its last block while that one is partly filled, so flushes that bring a few bytes each share a
+   sector. The open block is not committed: its bytes stay in the FRAM ring until it is full, the log is cut in front of
+   it and the block is rebuilt from there (rebuild), or it is left as written when another log was flushed in between.
+   A file size off the block grid (card edited elsewhere) is padded up to it. */
+static bool flush_block_open(bool rebuild)
+{
+    const uint32_t held = ring_distance(checkpoint.fram_open, checkpoint.fram_read);
+
+    /* The file is shorter than committed (card edited elsewhere), continue from its end */
+    if (sd_log_size() < checkpoint.sd_offset)
+    {
+        checkpoint.sd_offset = sd_log_size();
+    }
+    if (!rebuild)
+    {
+        checkpoint.fram_open = checkpoint.fram_read;
+        checkpoint.open_skip = 0u;
+        checkpoint.open_chunk = 0u;
+    }
+    counted = rebuild ? held : 0u;
+    rebuilt_offset = rebuild ? checkpoint.sd_offset : UINT32_MAX;
+    block_offset = checkpoint.sd_offset;
+    block_fill = 0u;
+
+    const uint32_t cut = checkpoint.sd_offset % FLUSH_BLOCK_SIZE;
+    if (((checkpoint.flags & FLUSH_CONTAINER) == 0u) || (cut == 0u))
+    {
+        return true;
+    }
+    memset(transfer_buffer, 0, FLUSH_BLOCK_SIZE - cut);
+    if (!sd_log_write(transfer_buffer, FLUSH_BLOCK_SIZE - cut))
+    {
+        return false;
+    }
+    checkpoint.sd_offset += FLUSH_BLOCK_SIZE - cut;
+    block_offset = checkpoint.sd_offset;
+    counted = 0u;
+    rebuilt_offset = UINT32_MAX;
+
+    return true;
+}
+
+__RAM_FUNC uint32_t flush_ring_advance(uint32_t addr, uint32_t length)
+{
+    addr += length;
+    if (addr >= LOCATION_BUFFER_END)
+    {
+        addr -= LOCATION_BUFFER_SIZE;
+    }
+
+    return addr;
+}
+
+/* Read across the end of the ring */
+static __RAM_FUNC bool flush_ring_read(uint32_t* addr, uint8_t* buffer, uint32_t length)
+{
+    while (length > 0u)
+    {
+        uint32_t part = length;
+        if (part > LOCATION_BUFFER_END - *addr)
+        {
+            part = LOCATION_BUFFER_END - *addr;
+        }
+        if (!fram_read(*addr, buffer, (uint16_t)part))
+        {
+            return false;
+        }
+        *addr = flush_ring_advance(*addr, part);
+        buffer += part;
+        length -= part;
+    }
+
+    return true;
+}
+
+static __RAM_FUNC uint32_t flush_count_lines(const uint8_t* data, uint32_t length)
+{
+    const uint8_t* const end = data + length;
+    uint32_t lines = 0u;
+
+    for (const uint8_t* next = memchr(data, '\n', length); next != NULL; next = memchr(next, '\n', (size_t)(end - next)))
+    {
+        next++;
+        lines++;
+    }
+
+    return lines;
+}
+
+static void flush_index_fail(void)
+{
+    log_info("[flush] index of %s%05u given up\r\n", flush_prefix(checkpoint.flags), checkpoint.file_id);
+    sd_index_close();
+    index_open = false;
+}
+
+/* Frames compressed by the ingest cannot be read, their filters match every word */
+static void flush_bloom_clear(void)
+{
+    memset(bloom, ((checkpoint.flags & FLUSH_FRAMED) != 0u) ? UINT8_MAX : 0u, sizeof(bloom));
+}
+
+/* Continue the filter of the entry the next byte goes to, the words of the first size bytes of the log are in it. The
+   last flush stored it if it ended cleanly right here, after a power loss it is only on the card up to the last
+   complete stride. */
+static void flush_bloom_open(uint32_t size, bool stored)
+{
+    bloom_entry = checkpoint.sd_offset / FLUSH_INDEX_STRIDE;
+    if (size == 0u)
+    {
+        memset(&word, 0, sizeof(word));
+    }
+
+    flush_bloom_clear();
+    if (index_open && (size > bloom_entry * FLUSH_INDEX_STRIDE) &&
+        (!stored || !sd_index_read(bloom_entry * sizeof(FLUSH_INDEX_ENTRY_T) + offsetof(FLUSH_INDEX_ENTRY_T, bloom), bloom, sizeof(bloom))))
+    {
+        memset(bloom, UINT8_MAX, sizeof(bloom)); // Lost, whatever the entry held has to match
+    }
+}
+
+static __RAM_FUNC void flush_bloom_add(uint32_t hash)
+{
+    const uint32_t step = (hash >> FLUSH_INDEX_ROTATE) | (hash << (32u - FLUSH_INDEX_ROTATE)) | 1u;
+
+    for (uint32_t probe = 0u; probe < FLUSH_INDEX_PROBES; probe++)
+    {
+        const uint32_t bit = (hash + probe * step) & (FLUSH_INDEX_BLOOM * 8u - 1u);
+        bloom[bit / 8u] |= (uint8_t)(1u << (bit % 8u));
+    }
+}
+
+/* Hash the words of content bytes as they go by; record headers are skipped without ending the word around them */
+static __RAM_FUNC void flush_bloom_words(const uint8_t* data, uint32_t length)
+{
+    const bool records = (checkpoint.flags & FLUSH_RECORDS) != 0u;
+    FLUSH_WORD_T state = word;
+
+    for (uint32_t index = 0u; index < length; index++)
+    {
+        const uint8_t byte = data[index];
+        const bool letter = (uint8_t)((byte | 0x20u) - 'a') < 26u;
+        const bool digit = (uint8_t)(byte - '0') < 10u;
+
+        if (state.skip > 0u)
+        {
+            state.skip--;
+        }
+        else if (records && (byte == INGEST_RECORD_MAGIC))
+        {
+            state.skip = sizeof(INGEST_RECORD_T) - 1u;
+        }
+        else if (letter || digit || (byte == '_') || ((byte >= 0x80u) && (byte < INGEST_RECORD_MAGIC)))
+        {
+            if (!state.active)
+            {
+                state.active = true;
+                state.number = digit;
+                state.hash = FLUSH_INDEX_HASH_BASIS;
+            }
+            state.hash = (state.hash ^ (letter ? (byte | 0x20u) : byte)) * FLUSH_INDEX_HASH_PRIME;
+        }
+        else if (state.active)
+        {
+            if (!state.number)
+            {
+                flush_bloom_add(state.hash);
+            }
+            state.active = false;
+        }
+    }
+    word = state;
+}
+
+static __RAM_FUNC void flush_bloom_store(void)
+{
+    if (!sd_index_write(bloom_entry * sizeof(FLUSH_INDEX_ENTRY_T) + offsetof(FLUSH_INDEX_ENTRY_T, bloom), bloom, sizeof(bloom)))
+    {
+        flush_index_fail();
+    }
+    index_dirty = true;
+}
+
+/* Words of the piece ending at end of the log file, they go to the entry of its last byte */
+static __RAM_FUNC void flush_bloom_piece(const uint8_t* data, uint32_t length, uint32_t end)
+{
+    const uint32_t entry_index = (end - 1u) / FLUSH_INDEX_STRIDE;
+
+    if (!index_open)
+    {
+        return;
+    }
+    if (entry_index != bloom_entry)
+    {
+        flush_bloom_store();
+        flush_bloom_clear();
+        bloom_entry = entry_index;
+    }
+    if ((checkpoint.flags & FLUSH_FRAMED) == 0u)
+    {
+        flush_bloom_words(data, length);
+    }
+}
+
+/* Carry on with the summary the last clean flush left if it describes the file as committed plus the rebuilt block,
+   otherwise count again from the committed size */
+static void flush_index_open(void)
+{
+    FLUSH_INDEX_SUMMARY_T last;
+
+    index_open = sd_index_open(flush_prefix(checkpoint.flags), checkpoint.file_id);
+    const uint32_t size = index_open ? sd_index_size() : 0u;
+    const uint32_t bytes = checkpoint.sd_offset + ((rebuilt_offset != UINT32_MAX) ? FLUSH_BLOCK_SIZE : 0u);
+    const bool valid = (size >= sizeof(last)) && sd_index_read(size - sizeof(last), &last, sizeof(last)) &&
+                       (last.magic == FLUSH_INDEX_MAGIC) && (last.crc == flush_summary_crc(&last));
+    const bool clean = valid && (last.bytes == bytes) && (last.stride == FLUSH_INDEX_STRIDE);
+
+    index_dirty = false;
+    if (clean)
+    {
+        summary = last;
+    }
+    else
+    {
+        memset(&summary, 0, sizeof(summary));
+        summary.first_us = valid ? last.first_us : 0u;
+        summary.flags = (((checkpoint.flags & (FLUSH_FRAMED | FLUSH_RECORDS)) == 0u) ? FLUSH_INDEX_LINES : 0u) |
+                        ((checkpoint.sd_offset != 0u) ? FLUSH_INDEX_PARTIAL : 0u);
+        counted = 0u;
+        rebuilt_offset = UINT32_MAX;
+    }
+    flush_bloom_open(clean ? bytes : checkpoint.sd_offset, clean);
+}
+
+/* Entry k for every offset k * FLUSH_INDEX_STRIDE in the piece [start, end) of the log just written from addr */
+static __RAM_FUNC void flush_index_piece(uint32_t start, uint32_t end, uint32_t addr)
+{
+    uint32_t entry_index = (start + FLUSH_INDEX_STRIDE - 1u) / FLUSH_INDEX_STRIDE;
+
+    if (!index_open || (entry_index * FLUSH_INDEX_STRIDE >= end))
+    {
+        return;
+    }
+
+    const FLUSH_INDEX_PIECE_T entry = { .offset = start, .lines = summary.lines, .us = ingest_time_at(addr) };
+    if (start == 0u)
+    {
+        summary.first_us = entry.us;
+    }
+    for (; entry_index * FLUSH_INDEX_STRIDE < end; entry_index++) // A frame may hold several
+    {
+        if (!sd_index_write(entry_index * sizeof(FLUSH_INDEX_ENTRY_T), &entry, sizeof(entry)))
+        {
+            flush_index_fail();
+            return;
+        }
+    }
+    index_dirty = true;
+}
+
+/* The summary goes right after the entries of the committed bytes, whatever an earlier longer index left is cut off */
+static void flush_index_close(bool ret)
+{
+    if (!index_open)
+    {
+        return;
+    }
+
+    if (ret)
+    {
+        /* A word cut by the end of the flush goes in as far as it got, in case the log ends there */
+        if (word.active && !word.number && ((checkpoint.flags & FLUSH_FRAMED) == 0u))
+        {
+            flush_bloom_add(word.hash);
+        }
+        flush_bloom_store();
+    }
+    if (ret && index_open)
+    {
+        const uint64_t last_us = ingest_time_at(flush_ring_advance(checkpoint.fram_read, LOCATION_BUFFER_SIZE - 1u));
+        const uint32_t bytes = ((checkpoint.flags & FLUSH_CONTAINER) != 0u) ? flush_block_size() : checkpoint.sd_offset;
+        const uint32_t entries = (bytes + FLUSH_INDEX_STRIDE - 1u) / FLUSH_INDEX_STRIDE;
+
+        summary.magic = FLUSH_INDEX_MAGIC;
+        summary.bytes = bytes;
+        summary.dropped = ingest_dropped();
+        summary.last_us = (last_us != 0u) ? last_us : summary.last_us;
+        summary.stride = FLUSH_INDEX_STRIDE;
+        summary.crc = flush_summary_crc(&summary);
+        if (!sd_index_write(entries * sizeof(FLUSH_INDEX_ENTRY_T), &summary, sizeof(summary)) || !sd_index_truncate())
+        {
+            log_info("[flush] index summary of %s%05u not written\r\n", flush_prefix(checkpoint.flags), checkpoint.file_id);
+        }
+    }
+    if (index_open)
+    {
+        sd_index_close();
+        index_open = false;
+    }
+}
+
+/* A new open block: its first_us, its index entry unless the rebuilt block has it already, and where it is rebuilt
+   from: the chunk at addr, skip bytes of its frame went to sealed blocks */
+static __RAM_FUNC void flush_block_start(uint32_t addr, uint32_t skip, uint32_t chunk)
+{
+    block_us = ingest_time_at(addr);
+    block_fram = addr;
+    block_skip = (uint16_t)skip;
+    block_chunk = (uint16_t)chunk;
+    if (block_offset != rebuilt_offset)
+    {
+        flush_index_piece(block_offset, block_offset + FLUSH_BLOCK_SIZE, addr);
+    }
+}
+
+/* Of the bytes copied again into the rebuilt block, the ones the summary and the filter already hold are not counted */
+static __RAM_FUNC uint32_t flush_counted(uint32_t length)
+{
+    const uint32_t skip = (counted < length) ? counted : length;
+
+    counted -= skip;
+
+    return skip;
+}
+
+/* A compressed frame into the open block and as many more as it takes, from byte skip on (the ones already in sealed
+   blocks when the block is rebuilt). The blocks it opens get the time of its chunk at addr. */
+static bool flush_frame_blocks(uint32_t length, uint32_t skip, uint32_t addr, uint32_t chunk)
+{
+    for (uint32_t done = skip; done < length;)
+    {
+        const uint32_t room = FLUSH_BLOCK_PAYLOAD - block_fill;
+        const uint32_t part = (length - done < room) ? length - done : room;
+
+        if (block_fill == 0u)
+        {
+            flush_block_start(addr, done, chunk);
+        }
+        memcpy(&transfer_buffer[sizeof(FLUSH_BLOCK_T) + block_fill], &frame_buffer[done], part);
+        block_fill += part;
+        done += part;
+        if ((block_fill == FLUSH_BLOCK_PAYLOAD) && !flush_block_write())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Copy FLUSH_CHUNK_SIZE bytes at a time, commit them to the card, then move the checkpoint.
+   FLUSH_COMPRESSED gathers each chunk in RAM and writes it as one frame, so every checkpoint ends on a frame boundary.
+   Frames compressed by the ingest (FLUSH_FRAMED) are copied like text. With FLUSH_CONTAINER the bytes written go into
+   blocks; a chunk that ends in a partly filled block writes it as it is and the next chunk fills it up in place. The
+   checkpoint keeps that block's bytes in the ring (fram_open) until it is full, a rebuilt block starts over from there
+   with the chunk its first frame was made of. */
+static __RAM_FUNC bool flush_copy(void)
+{
+    const bool compressed = (checkpoint.flags & FLUSH_COMPRESSED) != 0u;
+    const bool blocks = (checkpoint.flags & FLUSH_CONTAINER) != 0u;
+    const uint32_t chunk_max = compressed ? COMPRESS_BLOCK_SIZE : FLUSH_CHUNK_SIZE;
+    const bool lines = (summary.flags & FLUSH_INDEX_LINES) != 0u;
+    uint32_t read = checkpoint.fram_open; // fram_read stays as stored until the next commit, it tells the rebuilt bytes
+    uint32_t skip = checkpoint.open_skip;
+    uint32_t first = checkpoint.open_chunk;
+
+    while (read != checkpoint.fram_end)
+    {
+        uint32_t chunk = ring_distance(read, checkpoint.fram_end);
+        if (chunk > chunk_max)
+        {
+            chunk = chunk_max;
+        }
+        if (first != 0u)
+        {
+            chunk = first; // The frame the rebuilt block starts in has to come out as it did
+            first = 0u;
+        }
+
+        uint32_t addr = read;
+        uint32_t written = 0u;
+        if (compressed)
+        {
+            if (!flush_ring_read(&addr, compress.block, chunk))
+            {
+                return false;
+            }
+        }
+        for (uint32_t remaining = compressed ? 0u : chunk; remaining > 0u;)
+        {
+            const uint32_t room = blocks ? FLUSH_BLOCK_PAYLOAD - block_fill : FLUSH_TRANSFER_SIZE;
+            const uint32_t length = (remaining > room) ? room : remaining;
+            const uint32_t piece_addr = addr;
+            uint8_t* const piece = blocks ? &transfer_buffer[sizeof(FLUSH_BLOCK_T) + block_fill] : transfer_buffer;
+
+            if (!flush_ring_read(&addr, piece, length))
+            {
+                return false;
+            }
+            if (blocks)
+            {
+                const uint32_t seen = flush_counted(length);
+
+                if (block_fill == 0u)
+                {
+                    flush_block_start(piece_addr, 0u, 0u);
+                }
+                block_fill += length;
+                flush_bloom_piece(&piece[seen], length - seen, block_offset + FLUSH_BLOCK_SIZE);
+                summary.lines += lines ? flush_count_lines(&piece[seen], length - seen) : 0u;
+                if ((block_fill == FLUSH_BLOCK_PAYLOAD) && !flush_block_write())
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                if (!sd_log_write(piece, length))
+                {
+                    return false;
+                }
+                written += length;
+                flush_index_piece(checkpoint.sd_offset + written - length, checkpoint.sd_offset + written, piece_addr);
+                flush_bloom_piece(piece, length, checkpoint.sd_offset + written);
+                summary.lines += lines ? flush_count_lines(piece, length) : 0u;
+            }
+            remaining -= length;
+        }
+
+        if (compressed)
+        {
+            const uint32_t packed = compress_block(&compress, chunk, frame_buffer);
+            const uint32_t seen = flush_counted(chunk);
+
+            if (blocks ? !flush_frame_blocks(packed, skip, read, chunk) : !sd_log_write(frame_buffer, packed))
+            {
+                return false;
+            }
+            skip = 0u;
+            if (!blocks)
+            {
+                written = packed;
+                flush_index_piece(checkpoint.sd_offset, checkpoint.sd_offset + written, read);
+            }
+            flush_bloom_piece(&compress.block[seen], chunk - seen, blocks ? flush_block_size() : checkpoint.sd_offset + written);
+            summary.lines += lines ? flush_count_lines(&compress.block[seen], chunk - seen) : 0u;
+        }
+
+        if ((blocks && (block_fill != 0u) && !flush_block_write()) || !sd_log_sync())
+        {
+            return false;
+        }
+        /* The index is synced once per stride, a power loss in between leaves entries a resumed flush writes again */
+        if (index_open && index_dirty)
+        {
+            index_dirty = false;
+            if (!sd_index_sync())
+            {
+                flush_index_fail();
+            }
+        }
+
+        checkpoint.sd_offset = blocks ? block_offset : checkpoint.sd_offset + written;
+        checkpoint.fram_read = addr;
+        checkpoint.fram_open = (block_fill != 0u) ? block_fram : addr;
+        checkpoint.open_skip = (block_fill != 0u) ? block_skip : 0u;
+        checkpoint.open_chunk = (block_fill != 0u) ? block_chunk : 0u;
+        if (!checkpoint_store())
+        {
+            return false;
+        }
+        read = addr;
+    }
+
+    return true;
+}
+
+static bool flush_finish(bool ret)
+{
+    flush_index_close(ret);
+    sd_log_close();
+
+    if (ret)
+    {
+        checkpoint.state = FLUSH_STATE_IDLE;
+        ret = checkpoint_store();
+    }
+
+    return ret;
+}
+
+bool flush_restore(void)
+{
+    transfer_buffer = arena_alloc(ARENA_FLUSH, FLUSH_TRANSFER_SIZE);
+    compress_init(&compress, ARENA_COMPRESS, COMPRESS_BLOCK_SIZE, false);
+    frame_buffer = arena_alloc(ARENA_COMPRESS, COMPRESS_FRAME_SIZE(COMPRESS_BLOCK_SIZE));
+
+    FLUSH_CHECKPOINT_T slot_a;
+    FLUSH_CHECKPOINT_T slot_b;
+    const bool valid_a = checkpoint_load(&slot_a, LOCATION_CHECKPOINT_A);
+    const bool valid_b = checkpoint_load(&slot_b, LOCATION_CHECKPOINT_B);
+
+    if (valid_a && valid_b)
+    {
+        memcpy(&checkpoint, ((int16_t)(slot_b.sequence - slot_a.sequence) > 0) ? &slot_b : &slot_a, sizeof(checkpoint));
+    }
+    else if (valid_a)
+    {
+        memcpy(&checkpoint, &slot_a, sizeof(checkpoint));
+    }
+    else if (valid_b)
+    {
+        memcpy(&checkpoint, &slot_b, sizeof(checkpoint));
+    }
+
+    if ((!valid_a && !valid_b) || (checkpoint.fram_read < LOCATION_BUFFER_START) || (checkpoint.fram_read >= LOCATION_BUFFER_END) ||
+        (checkpoint.fram_end < LOCATION_BUFFER_START) || (checkpoint.fram_end >= LOCATION_BUFFER_END) ||
+        (checkpoint.fram_open < LOCATION_BUFFER_START) || (checkpoint.fram_open >= LOCATION_BUFFER_END))
+    {
+        /* First boot, both slots damaged or the ring was resized: start from an empty ring */
+        memset(&checkpoint, 0, sizeof(checkpoint));
+        checkpoint.fram_read = LOCATION_BUFFER_START;
+        checkpoint.fram_end = LOCATION_BUFFER_START;
+        checkpoint.fram_open = LOCATION_BUFFER_START;
+    }
+
+    return checkpoint.state == FLUSH_STATE_ACTIVE;
+}
+
+bool flush_resume(void)
+{
+    if (checkpoint.state != FLUSH_STATE_ACTIVE)
+    {
+        return true;
+    }
+
+    log_info("Resume flush of %s%05u at %lu, FRAM %lu..%lu\r\n", flush_prefix(checkpoint.flags), checkpoint.file_id, checkpoint.sd_offset,
+             checkpoint.fram_open, checkpoint.fram_end);
+
+    if (!sd_log_open(flush_prefix(checkpoint.flags), checkpoint.file_id, flush_extension(checkpoint.flags), checkpoint.sd_offset))
+    {
+        return false;
+    }
+    if (!flush_block_open(checkpoint.fram_open != checkpoint.fram_read))
+    {
+        sd_log_close();
+        return false;
+    }
+    flush_index_open();
+
+    return flush_finish(flush_copy());
+}
+
+bool flush_run(uint16_t file_id, uint32_t fram_end, uint8_t flags)
+{
+    /* The open block of the same log is rebuilt, any other log goes on after whatever its file holds */
+    const bool rebuild = (checkpoint.fram_open != checkpoint.fram_read) && (checkpoint.file_id == file_id) && (checkpoint.flags == flags);
+
+    /* Active before the card is touched: the ingest preempts this task and drops the oldest bytes in ring mode,
+       flush_discard() leaves them alone from here on */
+    checkpoint.state = FLUSH_STATE_ACTIVE;
+    if (!sd_log_open(flush_prefix(flags), file_id, flush_extension(flags), rebuild ? checkpoint.sd_offset : APPEND_TO_END))
+    {
+        checkpoint.state = FLUSH_STATE_IDLE;
+        return false;
+    }
+
+    checkpoint.flags = flags;
+    checkpoint.file_id = file_id;
+    checkpoint.sd_offset = rebuild ? checkpoint.sd_offset : sd_log_size();
+    checkpoint.fram_end = fram_end;
+    if (!flush_block_open(rebuild) || !checkpoint_store())
+    {
+        sd_log_close();
+        return false;
+    }
+    flush_index_open();
+
+    return flush_finish(flush_copy());
+}
+
+void flush_discard(uint32_t addr, bool persist)
+{
+    if (checkpoint.state != FLUSH_STATE_IDLE)
+    {
+        return;
+    }
+
+    checkpoint.fram_read = addr;
+    checkpoint.fram_end = addr;
+    checkpoint.fram_open = addr;
+    checkpoint.open_skip = 0u;
+    checkpoint.open_chunk = 0u;
+    if (persist)
+    {
+        checkpoint_store();
+    }
+}
+
+uint32_t flush_pending(uint32_t write_addr)
+{
+    return ring_distance(checkpoint.fram_read, write_addr);
+}
+
+uint32_t flush_held(uint32_t write_addr)
+{
+    return ring_distance(checkpoint.fram_open, write_addr);
+}
+
+bool flush_interrupted(void)
+{
+    return checkpoint.state == FLUSH_STATE_ACTIVE;
+}
+
+uint16_t flush_file_id(void)
+{
+    return checkpoint.file_id;
+}
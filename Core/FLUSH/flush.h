@@ -0,0 +1,112 @@
+#ifndef _FLUSH_H_
+#define _FLUSH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**< The FRAM buffer (LOCATION_BUFFER_START..LOCATION_BUFFER_END) is used as a ring.
+ *   The ingest side owns the write address, the flush side owns the read address which
+ *   is persisted in the checkpoint together with the log file and its committed size. */
+
+typedef enum
+{
+    FLUSH_STATE_IDLE = 0u, /**< No flush running, fram_read is the ring tail */
+    FLUSH_STATE_ACTIVE,    /**< Flush of fram_read..fram_end into file_id is running */
+} FLUSH_STATE_T;
+
+#define FLUSH_COMPRESSED 0x01u /**< Compress the FRAM data into LOGxxxxx.LZB */
+#define FLUSH_FRAMED     0x02u /**< FRAM already holds frames compressed by the ingest, copy them into LOGxxxxx.LZB */
+#define FLUSH_CAPTURE    0x04u /**< Trigger capture window, written to CAPxxxxx instead of LOGxxxxx */
+#define FLUSH_RECORDS    0x08u /**< FRAM holds timestamped records (ingest_record.h), uncompressed they go to LOGxxxxx.TSR */
+#define FLUSH_CONTAINER  0x10u /**< Write the file as CRC'd blocks (flush_block.h), LOGxxxxx.BLK whatever the content */
+
+typedef struct
+{
+    uint16_t magic;
+    uint16_t sequence;   /**< Incremented on every store, selects the slot */
+    uint8_t state;       /**< FLUSH_STATE_T */
+    uint8_t flags;       /**< FLUSH_COMPRESSED, FLUSH_FRAMED, FLUSH_CAPTURE, FLUSH_RECORDS, FLUSH_CONTAINER */
+    uint16_t file_id;    /**< LOGxxxxx.TXT being written */
+    uint32_t sd_offset;  /**< Committed size of the log file, with FLUSH_CONTAINER the partly filled last block is not part of it */
+    uint32_t fram_read;  /**< FRAM address of the next byte to copy */
+    uint32_t fram_end;   /**< FRAM address one past the last byte to copy */
+    uint32_t fram_open;  /**< FRAM address the partly filled last block is rebuilt from, fram_read if there is none */
+    uint16_t open_skip;  /**< Bytes of the first frame rebuilt from fram_open that are in sealed blocks */
+    uint16_t open_chunk; /**< Raw length of the chunk that frame was compressed from, 0 for uncompressed content */
+    uint32_t crc;        /**< hcrc over all the fields above */
+} FLUSH_CHECKPOINT_T;
+
+/**
+ * @brief Load the newest valid checkpoint from FRAM. Call once on boot before the capture starts.
+ *
+ * @return true if a flush was interrupted and flush_resume() has to run
+ */
+bool flush_restore(void);
+
+/**
+ * @brief Finish an interrupted flush into the same file, starting from the last checkpoint.
+ *        The SD card must be mounted.
+ *
+ * @return true on success
+ */
+bool flush_resume(void);
+
+/**
+ * @brief Copy the FRAM ring from the read address up to fram_end into a log file.
+ *        A checkpoint is stored after each committed chunk. The SD card must be mounted.
+ *        The time and word index next to the log (LOGxxxxx.IDX, flush_index.h) is kept up to date on the way.
+ *
+ * @param file_id log file to append to
+ * @param fram_end FRAM address one past the last buffered byte
+ * @param flags FLUSH_COMPRESSED or FLUSH_FRAMED write LOGxxxxx.LZB, 0 writes the text to LOGxxxxx.TXT,
+ *              FLUSH_RECORDS writes LOGxxxxx.TSR, FLUSH_CONTAINER LOGxxxxx.BLK, FLUSH_CAPTURE names the file CAPxxxxx
+ * @return true on success
+ */
+bool flush_run(uint16_t file_id, uint32_t fram_end, uint8_t flags);
+
+/**
+ * @brief Drop buffered bytes up to addr without writing them, for the trigger capture history and mode=ring.
+ *        Ignored while a flush runs; the capture never discards while the logger task flushes its window.
+ *
+ * @param addr new read address, at most the write address
+ * @param persist store the checkpoint, otherwise the read address is only kept in RAM until the next store
+ */
+void flush_discard(uint32_t addr, bool persist);
+
+/**
+ * @brief Number of buffered bytes not flushed yet
+ *
+ * @param write_addr current FRAM write address of the ingest side
+ * @return uint32_t pending bytes
+ */
+uint32_t flush_pending(uint32_t write_addr);
+
+/**
+ * @brief Number of bytes the ring still holds, the pending ones and the ones of a partly filled BLK block that is
+ *        rebuilt from them by the next flush
+ *
+ * @param write_addr current FRAM write address of the ingest side
+ * @return uint32_t bytes the ingest must not overwrite
+ */
+uint32_t flush_held(uint32_t write_addr);
+
+/**
+ * @brief true while a flush restored from FRAM still has to be finished by flush_resume()
+ */
+bool flush_interrupted(void);
+
+/**
+ * @brief Log file used by the last (or interrupted) flush
+ */
+uint16_t flush_file_id(void);
+
+/**
+ * @brief Advance an address inside the FRAM ring
+ *
+ * @param addr FRAM address
+ * @param length number of bytes
+ * @return uint32_t wrapped address
+ */
+uint32_t flush_ring_advance(uint32_t addr, uint32_t length);
+
+#endif // !_FLUSH_H_
@@ -0,0 +1,31 @@
+#ifndef _FLUSH_BLOCK_H_
+#define _FLUSH_BLOCK_H_
+
+#include <stdint.h>
+
+/**< With container=blocks a log file (LOGxxxxx.BLK, CAPxxxxx.BLK) is a sequence of FLUSH_BLOCK_SIZE blocks, one SD
+ *   sector each: this header, then up to FLUSH_BLOCK_PAYLOAD bytes of what would otherwise be the file content (text,
+ *   LZB frames or TSR records, see content), zero padded. A reader can start at any offset: it looks for the sync word
+ *   on a 4-byte boundary and accepts the block if the CRC matches. crc is the standard CRC-32 (zlib) of the header bytes
+ *   in front of it followed by the whole payload area, padding included. A partly filled last block is filled up in
+ *   place by the next flush, which rebuilds it from the bytes the FRAM ring keeps until the block is full. Shared with the host tools, little endian. */
+
+#define FLUSH_BLOCK_SIZE    512u
+#define FLUSH_BLOCK_SYNC    0x4b4c5aa5u /**< a5 5a "LK" in the file */
+#define FLUSH_BLOCK_PAYLOAD (FLUSH_BLOCK_SIZE - sizeof(FLUSH_BLOCK_T))
+
+#define FLUSH_BLOCK_PACKED  0x01u /**< content: payload continues a stream of LZB frames (Core/COMPRESS) */
+#define FLUSH_BLOCK_RECORDS 0x02u /**< content: the expanded stream is timestamped records (ingest_record.h) */
+
+typedef struct
+{
+    uint32_t sync;     /**< FLUSH_BLOCK_SYNC */
+    uint32_t sequence; /**< Block index in the file */
+    uint64_t first_us; /**< Arrival of the first payload byte's chunk, microseconds since boot, 0 if unknown */
+    uint16_t length;   /**< Payload bytes, the rest of the block is zero */
+    uint8_t content;   /**< FLUSH_BLOCK_PACKED, FLUSH_BLOCK_RECORDS, 0 for text */
+    uint8_t reserved;
+    uint32_t crc;
+} FLUSH_BLOCK_T;
+
+#endif // !_FLUSH_BLOCK_H_
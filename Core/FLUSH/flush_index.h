@@ -0,0 +1,62 @@
+#ifndef _FLUSH_INDEX_H_
+#define _FLUSH_INDEX_H_
+
+#include <stdint.h>
+
+#include "define.h"
+
+/**< Every log file gets a sparse index next to it, LOGxxxxx.IDX (CAPxxxxx.IDX), so a time range can be found without
+ *   reading the log. Entry k sits at k * sizeof(FLUSH_INDEX_ENTRY_T) and describes the piece of the log file that holds
+ *   offset k * FLUSH_INDEX_STRIDE: where that piece starts and when its first byte arrived (piece). A piece is what the
+ *   flush writes at once (a transfer, a frame or a block), so offset is where a reader starts decoding: frames and
+ *   blocks start there, text and records are resynchronised from there. Entries only depend on the data, a flush
+ *   resumed after a power loss writes the same ones again.
+ *   Each entry also carries a Bloom filter of the words in the pieces that end in its stride, k * FLUSH_INDEX_STRIDE
+ *   up to (k + 1) * FLUSH_INDEX_STRIDE, taken from the content before compression and without record headers. A word
+ *   is a run of ASCII letters, digits, '_' and UTF-8 bytes (0x80..0xf4), it belongs to the piece it ends in. Words that
+ *   start with a digit (numbers, counters, addresses) are left out, they would fill the filter. The hash is FNV-1a of
+ *   the word in lower case, probe i sets bit (hash + i * step) % (8 * FLUSH_INDEX_BLOOM), step being hash rotated
+ *   right by FLUSH_INDEX_ROTATE with the lowest bit set; bit n is bit n % 8 of byte n / 8. A filter of all ones
+ *   matches every word: the words could not be read (frames compressed by the ingest) or the filter was lost (the
+ *   flush stores it when its stride is complete or the flush ends, a power loss in between costs the stride's filter).
+ *   Every flush that ends cleanly puts a summary after the entries of the bytes it covers and cuts the file there, so
+ *   the last sizeof(FLUSH_INDEX_SUMMARY_T) bytes describe the whole log. Shared with the host tools, little endian. */
+
+#define FLUSH_INDEX_MAGIC 0x5844494cu /**< "LIDX" */
+
+#define FLUSH_INDEX_HASH_BASIS 0x811c9dc5u /**< FNV-1a 32-bit */
+#define FLUSH_INDEX_HASH_PRIME 0x01000193u
+#define FLUSH_INDEX_ROTATE     15u
+#define FLUSH_INDEX_PROBES     4u
+
+#define FLUSH_INDEX_LINES   0x01u /**< summary flags: the log is text, lines is the number of '\n' in it */
+#define FLUSH_INDEX_PARTIAL 0x02u /**< The summary before the last flush was lost (power loss): lines only counts since */
+
+typedef struct
+{
+    uint32_t offset; /**< Start of the piece in the log file */
+    uint32_t lines;  /**< '\n' in the log before offset, 0 unless FLUSH_INDEX_LINES */
+    uint64_t us;     /**< Arrival of the first byte of the piece, microseconds since boot, 0 if unknown */
+} FLUSH_INDEX_PIECE_T;
+
+typedef struct
+{
+    FLUSH_INDEX_PIECE_T piece;        /**< Written when the piece is, the filter when the stride is complete */
+    uint8_t bloom[FLUSH_INDEX_BLOOM]; /**< Words of the pieces ending in the stride */
+} FLUSH_INDEX_ENTRY_T;
+
+typedef struct
+{
+    uint32_t magic;      /**< FLUSH_INDEX_MAGIC */
+    uint32_t bytes;      /**< Size of the log file described */
+    uint32_t lines;      /**< '\n' in the log, 0 unless FLUSH_INDEX_LINES */
+    uint32_t dropped;    /**< Bytes lost to a full FRAM ring since boot, when the summary was written */
+    uint64_t first_us;   /**< Arrival of the first byte of the log, 0 if unknown */
+    uint64_t last_us;    /**< Arrival of the chunk holding its last byte, 0 if unknown */
+    uint32_t stride;     /**< FLUSH_INDEX_STRIDE of the entries */
+    uint8_t flags;       /**< FLUSH_INDEX_LINES, FLUSH_INDEX_PARTIAL */
+    uint8_t reserved[7]; /**< Zero, the CRC ends the struct without padding */
+    uint32_t crc;        /**< Standard CRC-32 of the fields above, as for the blocks (flush_block.h) */
+} FLUSH_INDEX_SUMMARY_T;
+
+#endif // !_FLUSH_INDEX_H_
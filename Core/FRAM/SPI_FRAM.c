@@ -31,14 +31,22 @@
 #include "console.h"
 #include "define.h"
 #include "main.h"
+#include "semphr.h"
+#include "spi_bus.h"
 #include "spi_fram.h"
 
 extern SPI_HandleTypeDef SPI_FRAM_HANDLE;
+#ifdef MB85RS2MTA
+SPI_FRAM spi_fram = { ._nAddressSizeBytes = 3u }; // Usable before fram_init() for the boot capture
+#else
 SPI_FRAM spi_fram;
+#endif
+static SemaphoreHandle_t fram_mutex; // SPI1 is shared by the ingest and the flush tasks
+static SemaphoreHandle_t fram_done;  // Given by the SPI1 completion callbacks
+static StaticSemaphore_t fram_mutex_buffer;
+static StaticSemaphore_t fram_done_buffer;
 
-/* Function prototype*/
-#define SPI1_CS_HIGH() HAL_GPIO_WritePin(FRAM_CS_GPIO_Port, FRAM_CS_Pin, GPIO_PIN_SET)
-#define SPI1_CS_LOW()  HAL_GPIO_WritePin(FRAM_CS_GPIO_Port, FRAM_CS_Pin, GPIO_PIN_RESET)
+#define FRAM_HEADER_MAX 5u /**< Opcode and up to 4 address bytes */
 
 /* Supported flash devices */
 const struct
@@ -84,13 +92,11 @@ static uint32_t check_supported_device(const uint8_t* manufID, const uint16_t* p
 
 static bool fram_get_id(uint8_t* manufacturerID, uint32_t* productID)
 {
-    uint8_t cmd = OPCODE_RDID;
     uint8_t a[4u] = { 0u };
 
-    SPI1_CS_LOW();
-    HAL_SPI_Transmit(&SPI_FRAM_HANDLE, &cmd, 1u, -1);
-    HAL_SPI_Receive(&SPI_FRAM_HANDLE, (uint8_t*)a, sizeof(a), -1);
-    SPI1_CS_HIGH();
+    spi_bus_select(&spi_bus_fram);
+    const bool ret = spi_bus_xchg(&spi_bus_fram, OPCODE_RDID, NULL) && spi_bus_transfer(&spi_bus_fram, NULL, a, sizeof(a));
+    spi_bus_deselect(&spi_bus_fram);
 
     if (a[1u] == 0x7fu)
     {
@@ -107,7 +113,7 @@ static bool fram_get_id(uint8_t* manufacturerID, uint32_t* productID)
         *productID = (a[1] << 8) + a[2u];
     }
 
-    return true;
+    return ret;
 }
 
 /*!
@@ -120,6 +126,64 @@ static void fram_set_addr_size(uint8_t nAddressSize)
     spi_fram._nAddressSizeBytes = nAddressSize;
 }
 
+/*!
+ *   @brief  Build the opcode and address phase of a memory access
+ *   @return number of header bytes
+ */
+static uint8_t fram_header(uint8_t* buffer, uint8_t opcode, uint32_t addr)
+{
+    uint8_t index = 0u;
+
+    buffer[index++] = opcode;
+    if (spi_fram._nAddressSizeBytes > 3u)
+    {
+        buffer[index++] = (uint8_t)(addr >> 24u);
+    }
+    if (spi_fram._nAddressSizeBytes > 2u)
+    {
+        buffer[index++] = (uint8_t)(addr >> 16u);
+    }
+    buffer[index++] = (uint8_t)(addr >> 8u);
+    buffer[index++] = (uint8_t)addr;
+
+    return index;
+}
+
+/*!
+ *   @brief  Serialize FRAM transactions between tasks, no-op before the scheduler runs
+ */
+static void fram_lock(void)
+{
+    if ((fram_mutex != NULL) && (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED))
+    {
+        xSemaphoreTake(fram_mutex, portMAX_DELAY);
+    }
+}
+
+static void fram_unlock(void)
+{
+    if ((fram_mutex != NULL) && (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED))
+    {
+        xSemaphoreGive(fram_mutex);
+    }
+}
+
+/*!
+ *   @brief  Block until the pending SPI transfer is finished and CS is released
+ */
+static void fram_wait_ready(void)
+{
+    const bool blocking = (fram_done != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && (__get_IPSR() == 0u);
+
+    while (HAL_SPI_GetState(&SPI_FRAM_HANDLE) != HAL_SPI_STATE_READY)
+    {
+        if (blocking)
+        {
+            xSemaphoreTake(fram_done, pdMS_TO_TICKS(FRAM_TIMEOUT_MS)); // A stale give only costs one more loop
+        }
+    }
+}
+
 bool fram_init(void)
 {
     bool ret = true;
@@ -139,7 +203,7 @@ bool fram_init(void)
     uint32_t prod_id;
 
     ret = fram_get_id(&manuf_id, &prod_id); // Check FRAM parameter
-    const uint32_t fram_size = check_supported_device(&manuf_id, &prod_id);
+    const uint32_t fram_size = ret ? check_supported_device(&manuf_id, &prod_id) : 0u;
     ret = fram_size != 0u;
 
     if (ret)
@@ -156,181 +220,166 @@ bool fram_init(void)
 
 bool fram_write_enable(bool enabled)
 {
-    uint8_t cmd;
-    if (enabled)
-    {
-        cmd = OPCODE_WREN;
-    }
-    else
-    {
-        cmd = OPCODE_WRDI;
-    }
-    SPI1_CS_LOW();
-    HAL_SPI_Transmit(&SPI_FRAM_HANDLE, &cmd, sizeof(cmd), -1);
-    SPI1_CS_HIGH();
+    spi_bus_select(&spi_bus_fram);
+    const bool ret = spi_bus_xchg(&spi_bus_fram, enabled ? OPCODE_WREN : OPCODE_WRDI, NULL);
+    spi_bus_deselect(&spi_bus_fram);
+
+    return ret;
 }
 
 bool fram_sleep_enable(bool enable)
 {
-    uint8_t cmd;
+    bool ret = true;
+
+    spi_bus_select(&spi_bus_fram);
     if (enable)
     {
-        cmd = OPCODE_SLEEP;
-        SPI1_CS_LOW();
-        HAL_SPI_Transmit_IT(&SPI_FRAM_HANDLE, &cmd, sizeof(cmd));
-        SPI1_CS_HIGH();
+        ret = spi_bus_xchg(&spi_bus_fram, OPCODE_SLEEP, NULL);
     }
     else
     {
-        SPI1_CS_LOW();
-        HAL_Delay(1);
-        SPI1_CS_HIGH();
+        HAL_Delay(1); // CS low for tREC wakes the device
     }
+    spi_bus_deselect(&spi_bus_fram);
+
+    return ret;
 }
 
 bool fram_write_8b(uint32_t addr, uint8_t value)
 {
-    bool ret = true;
-    uint8_t buffer[10];
-    uint8_t i = 0;
-
-    buffer[i++] = OPCODE_WRITE;
-    if (spi_fram._nAddressSizeBytes > 3)
-        buffer[i++] = (uint8_t)(addr >> 24);
-    if (spi_fram._nAddressSizeBytes > 2)
-        buffer[i++] = (uint8_t)(addr >> 16);
-    buffer[i++] = (uint8_t)(addr >> 8);
-    buffer[i++] = (uint8_t)(addr & 0xFF);
-    buffer[i++] = value;
-
-    SPI1_CS_LOW();
-    HAL_StatusTypeDef hal_stat = HAL_SPI_Transmit_IT(&SPI_FRAM_HANDLE, (uint8_t*)buffer, i);
-    if (hal_stat != HAL_OK)
-    {
-        log_info("spi failed err %d\r\n", hal_stat);
-        ret = false;
-    }
+    uint8_t header[FRAM_HEADER_MAX];
+    const uint8_t length = fram_header(header, OPCODE_WRITE, addr);
+
+    fram_lock();
+    spi_bus_select(&spi_bus_fram);
+    const bool ret = spi_bus_transfer(&spi_bus_fram, header, NULL, length) && spi_bus_xchg(&spi_bus_fram, value, NULL);
+    spi_bus_deselect(&spi_bus_fram);
+    fram_unlock();
 
     return ret;
 }
 
-bool fram_write(const uint32_t addr, const uint8_t* pData, uint8_t pLength)
+__RAM_FUNC bool fram_write(const uint32_t addr, const uint8_t* pData, uint16_t pLength)
 {
-    fram_write_enable(true);
     bool ret = true;
-    uint8_t buffer[10];
-    uint8_t index = 0;
-
-    buffer[index++] = OPCODE_WRITE;
-    if (spi_fram._nAddressSizeBytes > 3)
-    {
-        buffer[index++] = (uint8_t)(addr >> 24);
-    }
-    if (spi_fram._nAddressSizeBytes > 2)
-    {
-        buffer[index++] = (uint8_t)(addr >> 16);
-    }
-
-    buffer[index++] = (uint8_t)(addr >> 8);
-    buffer[index++] = (uint8_t)(addr & 0xFF);
+    uint8_t header[FRAM_HEADER_MAX];
+    const uint8_t length = fram_header(header, OPCODE_WRITE, addr);
 
-    SPI1_CS_LOW();
+    fram_lock();
+    ret = fram_write_enable(true);
+    spi_bus_select(&spi_bus_fram);
+    ret = ret && spi_bus_transfer(&spi_bus_fram, header, NULL, length);
 
-    if (HAL_SPI_Transmit(&SPI_FRAM_HANDLE, (uint8_t*)buffer, index, -1) != HAL_OK)
+    if (!ret || (pLength < FRAM_DMA_MIN))
     {
-        ret = false;
+        ret = ret && spi_bus_transfer(&spi_bus_fram, pData, NULL, pLength);
+        spi_bus_deselect(&spi_bus_fram);
     }
-    if (HAL_SPI_Transmit_DMA(&SPI_FRAM_HANDLE, pData, pLength) != HAL_OK)
+    else if (HAL_SPI_Transmit_DMA(&SPI_FRAM_HANDLE, (uint8_t*)pData, pLength) != HAL_OK)
     {
+        spi_bus_deselect(&spi_bus_fram);
         ret = false;
     }
+    fram_wait_ready();
+    fram_unlock();
 
     return ret;
 }
 
 uint8_t fram_read_8b(uint32_t addr)
 {
-    uint8_t buffer[10], val;
-    uint8_t i = 0;
-
-    buffer[i++] = OPCODE_READ;
-    if (spi_fram._nAddressSizeBytes > 3)
-        buffer[i++] = (uint8_t)(addr >> 24);
-    if (spi_fram._nAddressSizeBytes > 2)
-        buffer[i++] = (uint8_t)(addr >> 16);
-    buffer[i++] = (uint8_t)(addr >> 8);
-    buffer[i++] = (uint8_t)(addr & 0xFF);
-
-    SPI1_CS_LOW();
-    HAL_SPI_Transmit(&SPI_FRAM_HANDLE, (uint8_t*)buffer, i, -1);
-    HAL_SPI_Receive(&SPI_FRAM_HANDLE, &val, sizeof(val), -1);
-    SPI1_CS_HIGH();
+    uint8_t header[FRAM_HEADER_MAX];
+    const uint8_t length = fram_header(header, OPCODE_READ, addr);
+
+    uint8_t val = 0xffu; // What an absent device reads as
+
+    fram_lock();
+    spi_bus_select(&spi_bus_fram);
+    if (spi_bus_transfer(&spi_bus_fram, header, NULL, length))
+    {
+        spi_bus_xchg(&spi_bus_fram, 0xffu, &val);
+    }
+    spi_bus_deselect(&spi_bus_fram);
+    fram_unlock();
 
     return val;
 }
 
-bool fram_read(const uint32_t addr, uint8_t* pData, uint8_t pLength)
+__RAM_FUNC bool fram_read(const uint32_t addr, uint8_t* pData, uint16_t pLength)
 {
     bool ret = true;
-    uint8_t buffer[10];
-    uint8_t index = 0;
-
-    buffer[index++] = OPCODE_READ;
-    if (spi_fram._nAddressSizeBytes > 3)
-    {
-        buffer[index++] = (uint8_t)(addr >> 24);
-    }
-    if (spi_fram._nAddressSizeBytes > 2)
-    {
-        buffer[index++] = (uint8_t)(addr >> 16);
-    }
+    uint8_t header[FRAM_HEADER_MAX];
+    const uint8_t length = fram_header(header, OPCODE_READ, addr);
 
-    buffer[index++] = (uint8_t)(addr >> 8);
-    buffer[index++] = (uint8_t)(addr & 0xFF);
+    fram_lock();
+    spi_bus_select(&spi_bus_fram);
+    ret = spi_bus_transfer(&spi_bus_fram, header, NULL, length);
 
-    SPI1_CS_LOW();
-    if (HAL_SPI_Transmit(&SPI_FRAM_HANDLE, (uint8_t*)buffer, index, -1) != HAL_OK)
+    if (!ret || (pLength < FRAM_DMA_MIN))
     {
-        ret = false;
+        ret = ret && spi_bus_transfer(&spi_bus_fram, NULL, pData, pLength);
+        spi_bus_deselect(&spi_bus_fram);
     }
-    if (HAL_SPI_Receive_DMA(&SPI_FRAM_HANDLE, pData, pLength) != HAL_OK)
+    else if (HAL_SPI_Receive_DMA(&SPI_FRAM_HANDLE, pData, pLength) != HAL_OK)
     {
+        spi_bus_deselect(&spi_bus_fram);
         ret = false;
     }
+    fram_wait_ready();
+    fram_unlock();
 
     return ret;
 }
 
-static void fram_task(void* argument)
+void fram_set_spi_clock(uint32_t pclk_hz)
 {
-    if (!fram_init())
+    uint32_t prescaler = SPI_BAUDRATEPRESCALER_2;
+    uint32_t sck_hz = pclk_hz / 2u;
+
+    while ((sck_hz > FRAM_SPI_MAX_HZ) && (prescaler != SPI_BAUDRATEPRESCALER_256))
     {
-        log_info("FRAM initialization failed.\r\n");
+        prescaler += SPI_CR1_BR_0;
+        sck_hz /= 2u;
     }
-    while (true)
+
+    fram_lock();
+    __HAL_SPI_DISABLE(&SPI_FRAM_HANDLE); // BR must not change while enabled, the HAL enables it again per transfer
+    MODIFY_REG(SPI_FRAM_HANDLE.Instance->CR1, SPI_CR1_BR, prescaler);
+    SPI_FRAM_HANDLE.Init.BaudRatePrescaler = prescaler;
+    fram_unlock();
+}
+
+void fram_os_init(void)
+{
+    fram_mutex = xSemaphoreCreateMutexStatic(&fram_mutex_buffer);
+    fram_done = xSemaphoreCreateBinaryStatic(&fram_done_buffer);
+
+    if ((fram_mutex == NULL) || (fram_done == NULL))
     {
-        task_delay(1u);
+        log_info("fram semaphore creation failed\r\n");
     }
 }
 
-void fram_task_entry(void)
+static __RAM_FUNC void fram_transfer_done(SPI_HandleTypeDef* hspi)
 {
-    BaseType_t xReturned;
-    TaskHandle_t fram_handle = NULL;
-    xReturned = xTaskCreate(fram_task, "fram task", FRAM_STACK, NULL, FRAM_PRIORITY, &fram_handle);
-
-    if (xReturned != pdPASS)
+    if (hspi == &SPI_FRAM_HANDLE)
     {
-        log_info("fram task initialization failed\r\n");
+        spi_bus_deselect(&spi_bus_fram);
+        if ((fram_done != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING))
+        {
+            BaseType_t woken = pdFALSE;
+            xSemaphoreGiveFromISR(fram_done, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
     }
 }
 
-void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef* hspi)
+__RAM_FUNC void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef* hspi)
 {
-    SPI1_CS_HIGH();
+    fram_transfer_done(hspi);
 }
 
-void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi)
+__RAM_FUNC void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi)
 {
-    SPI1_CS_HIGH();
+    fram_transfer_done(hspi);
 }
@@ -78,8 +78,10 @@ bool fram_write_8b(uint32_t addr, uint8_t value);
  *           The 32-bit address to write to in FRAM memory
  *   @param values
  *           The pointer to an array of 8-bit values to write starting at addr
+ *   @param pLength
+ *           The number of bytes to write, the call returns once the transfer is done
  */
-bool fram_write(const uint32_t addr, const uint8_t* pData, uint8_t pLength);
+bool fram_write(const uint32_t addr, const uint8_t* pData, uint16_t pLength);
 
 /**
  *   @brief  Reads an 8-bit value from the specified FRAM address
@@ -98,7 +100,7 @@ uint8_t fram_read_8b(uint32_t addr);
  *   @param length
  *           The number of bytes to read
  */
-bool fram_read(const uint32_t addr, uint8_t* pData, uint8_t pLength);
+bool fram_read(const uint32_t addr, uint8_t* pData, uint16_t pLength);
 
 uint8_t getStatusRegister(void);
 
@@ -111,6 +113,16 @@ void setStatusRegister(uint8_t value);
  */
 bool fram_sleep_enable(bool enable);
 
-void fram_task_entry(void);
+/**
+ * @brief Pick the fastest SPI1 prescaler within FRAM_SPI_MAX_HZ for a new APB2 clock
+ * @param pclk_hz APB2 clock in Hz
+ */
+void fram_set_spi_clock(uint32_t pclk_hz);
+
+/**
+ * @brief Create the SPI1 mutex and the transfer completion semaphore. Call before the scheduler starts,
+ *        transfers then block the calling task until the DMA completion callback instead of spinning.
+ */
+void fram_os_init(void);
 
 #endif
@@ -0,0 +1,83 @@
+#include "framing.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "console.h"
+#include "main.h"
+
+static FRAMING_EMIT_T output;
+static FRAMING_BOUNDARY_T boundary_output;
+static bool enabled;
+static bool synced; /**< A delimiter was seen since the framing was switched on */
+static uint8_t end_byte;
+static uint32_t frames;
+static uint32_t skipped;
+
+void framing_init(FRAMING_EMIT_T emit, FRAMING_BOUNDARY_T boundary)
+{
+    output = emit;
+    boundary_output = boundary;
+}
+
+void framing_configure(bool enable, uint8_t delimiter)
+{
+    if ((enable != enabled) || (delimiter != end_byte))
+    {
+        synced = false;
+    }
+    enabled = enable;
+    end_byte = delimiter;
+}
+
+bool framing_active(void)
+{
+    return enabled;
+}
+
+__RAM_FUNC void framing_feed(const uint8_t* data, uint32_t length)
+{
+    const uint8_t* const end = data + length;
+    const uint8_t* last = NULL; /**< One past the last delimiter in data */
+
+    /* Delimiters are rare in frame data, memchr skips a word at a time between them */
+    for (const uint8_t* next = memchr(data, end_byte, length); next != NULL; next = memchr(next, end_byte, (size_t)(end - next)))
+    {
+        next++;
+        if (!synced)
+        {
+            /* The bytes before the first delimiter are the tail of a frame that started before us */
+            skipped += (uint32_t)(next - data);
+            data = next;
+            synced = true;
+            continue;
+        }
+        last = next;
+        frames++;
+    }
+
+    if (!synced)
+    {
+        skipped += length;
+        return;
+    }
+    if (last != NULL)
+    {
+        output(data, (uint32_t)(last - data));
+        boundary_output();
+        data = last;
+    }
+    if (data < end)
+    {
+        output(data, (uint32_t)(end - data));
+    }
+}
+
+void framing_report(void)
+{
+    if (enabled)
+    {
+        log_info("[framing] %lu frames, %lu bytes skipped for sync\r\n", frames, skipped);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef _FRAMING_H_
+#define _FRAMING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**< Framed binary input (framing=cobs or framing=slip): received bytes bypass the text stages (line filter, duplicate
+ *   suppression, line timestamps) and the position after every frame delimiter is reported to the ingest. The flush
+ *   only ever ends at such a boundary, so every log file holds whole frames and parses on its own.
+ *   After boot and after the framing is switched on the bytes up to the first delimiter are skipped, the sender may
+ *   have been in the middle of a frame. */
+
+#define FRAMING_COBS_DELIMITER 0x00u /**< Ends every COBS frame, never part of its encoding */
+#define FRAMING_SLIP_END       0xc0u /**< SLIP END, senders usually put it on both sides of a frame */
+
+/**
+ * @brief Output of the stage: frame bytes, or a boundary after the last delimiter passed on
+ */
+typedef void (*FRAMING_EMIT_T)(const uint8_t* data, uint32_t length);
+typedef void (*FRAMING_BOUNDARY_T)(void);
+
+/**
+ * @brief Set the outputs. Call once on boot.
+ *
+ * @param emit next ingest stage
+ * @param boundary called every time the bytes passed on so far end with a delimiter
+ */
+void framing_init(FRAMING_EMIT_T emit, FRAMING_BOUNDARY_T boundary);
+
+/**
+ * @brief Switch the framing, on (again) it waits for the next delimiter
+ *
+ * @param enable received bytes are frames
+ * @param delimiter FRAMING_COBS_DELIMITER or FRAMING_SLIP_END
+ */
+void framing_configure(bool enable, uint8_t delimiter);
+
+/**
+ * @brief true if received bytes have to go through framing_feed()
+ */
+bool framing_active(void);
+
+/**
+ * @brief Pass received bytes on, with a boundary after the last delimiter in them
+ */
+void framing_feed(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Print the frames seen and the bytes skipped while waiting for a delimiter
+ */
+void framing_report(void);
+
+#endif // !_FRAMING_H_
@@ -0,0 +1,909 @@
+#include "ingest.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "FreeRTOSConfig.h"
+#include "arena.h"
+#include "capture.h"
+#include "cmsis_os.h"
+#include "compress.h"
+#include "console.h"
+#include "dedup.h"
+#include "define.h"
+#include "filter.h"
+#include "flush.h"
+#include "framing.h"
+#include "gpio_config.h"
+#include "ingest_record.h"
+#include "main.h"
+#include "power.h"
+#include "spi_fram.h"
+#include "stamp.h"
+#include "timer.h"
+
+#define BAUD_UNIT      100u /**< Baudrate is stored in FRAM in 100 bps units */
+#define FORMAT_FRAMES  0x01u /**< INGEST_FORMAT_LOCATION bits */
+#define FORMAT_RECORDS 0x02u
+
+/**< DMA position reported by an UART callback and the time its interrupt was entered */
+typedef struct
+{
+    uint32_t stamp_us;
+    uint16_t head;
+} INGEST_EVENT_T;
+
+/**< Arrival time of the chunk stored from a position on, for the flush */
+typedef struct
+{
+    uint32_t position; /**< stored_total when the chunk started */
+    uint64_t us;
+} INGEST_MARK_T;
+
+static uint8_t* rx_buffer; /**< INGEST_RX_SIZE bytes from ARENA_INGEST */
+static uint16_t rx_tail;          /**< Next byte to store in FRAM */
+static volatile bool rx_restart;  /**< Reception was aborted by an UART error */
+static INGEST_EVENT_T events[INGEST_EVENTS]; /**< DMA write positions, queued by the UART callbacks */
+static volatile uint8_t event_in;
+static volatile uint8_t event_out;
+static volatile uint32_t irq_us; /**< timer_us() at the entry of the running USART2 or DMA interrupt */
+static volatile uint32_t pending_baudrate;
+
+static TaskHandle_t ingest_handle = NULL;
+static TaskHandle_t subscriber = NULL; /**< Notified with INGEST_EVENT_DATA after new data is stored */
+
+static uint32_t write_addr;
+static uint32_t dropped;
+static uint32_t boot_us;
+
+static COMPRESS_T compress;            /**< Gathers INGEST_BLOCK_SIZE raw bytes, primed with the static dictionary */
+static uint8_t* frame_buffer;          /**< Compressed frame of the block, from ARENA_INGEST */
+static uint32_t block_fill;            /**< Raw bytes waiting in compress.block */
+static bool compressed;                /**< The FRAM ring holds frames, persisted at INGEST_FORMAT_LOCATION */
+static volatile bool compress_request; /**< Format asked for by the configuration, applied once the ring is empty */
+static bool stamped;                   /**< The FRAM ring holds timestamped records, persisted with compressed */
+static volatile bool stamp_request;
+static uint8_t* record;                /**< INGEST_RECORD_SIZE bytes from ARENA_INGEST: header and data of the open record */
+static uint32_t record_fill;           /**< Data bytes of the open record */
+static uint32_t record_stamp;
+static uint32_t stamp_us;              /**< Arrival time of the chunk being processed */
+static volatile bool line_stamps;      /**< Text lines get a time prefix (Core/STAMP), records already carry the time */
+static bool dedup_enabled;             /**< Received lines go through Core/DEDUP */
+static volatile bool dedup_request;
+static char filter_rules[FILTER_RULES_SIZE];  /**< Rules asked for by the configuration, copied under a critical section */
+static volatile bool filter_request;
+static uint64_t now_us;                       /**< Arrival time of the bytes being processed, timer_now_us() */
+static uint64_t seal_deadline = TIMER_NEVER;  /**< INGEST_SEAL_MS after the last chunk, held partial data is stored then */
+static volatile bool overwrite;               /**< mode=ring: a full ring drops its oldest bytes instead of the new ones */
+static char capture_trigger[CAPTURE_TRIGGER_MAX]; /**< Trigger capture settings asked for by the configuration */
+static uint32_t capture_pre;
+static uint32_t capture_post;
+static bool capture_enable;
+static volatile bool capture_request;
+static volatile uint32_t frame_end;    /**< FRAM address after the last whole frame, the flush stops there */
+static uint32_t block_boundary;        /**< Raw bytes in compress.block up to the last frame boundary */
+static bool framing_enable;            /**< Framing asked for by the configuration */
+static uint8_t framing_delimiter;
+static volatile bool framing_request;
+static INGEST_MARK_T marks[INGEST_MARKS]; /**< Written by the ingest task, read by ingest_time_at() in a critical section */
+static uint32_t mark_count;
+static uint32_t stored_total; /**< Bytes stored since boot, modulo 2^32, positions do not repeat with the ring */
+
+static uint32_t ingest_load_write_addr(void)
+{
+    uint8_t addr[3u] = { 0u };
+    fram_read(SYNC_BUFFER_MSB, addr, sizeof(addr));
+
+    const uint32_t ram_addr = ((uint32_t)addr[0u] << 16u) | ((uint32_t)addr[1u] << 8u) | addr[2u];
+
+    return ((ram_addr < LOCATION_BUFFER_START) || (ram_addr >= LOCATION_BUFFER_END)) ? LOCATION_BUFFER_START : ram_addr;
+}
+
+static void ingest_save_write_addr(void)
+{
+    const uint8_t addr[3u] = { (uint8_t)(write_addr >> 16u), (uint8_t)(write_addr >> 8u), (uint8_t)write_addr };
+    fram_write(SYNC_BUFFER_MSB, addr, sizeof(addr));
+}
+
+static uint8_t ingest_load_format(void)
+{
+    const uint8_t format = fram_read_8b(INGEST_FORMAT_LOCATION);
+
+    return ((format & ~(FORMAT_FRAMES | FORMAT_RECORDS)) != 0u) ? 0u : format;
+}
+
+static void ingest_save_format(void)
+{
+    const uint8_t format = (compressed ? FORMAT_FRAMES : 0u) | (stamped ? FORMAT_RECORDS : 0u);
+    fram_write(INGEST_FORMAT_LOCATION, &format, sizeof(format));
+}
+
+static uint32_t ingest_load_baudrate(void)
+{
+    uint8_t baud[2u] = { 0u };
+    fram_read(BAUD_LSB_LOCATION, baud, sizeof(baud));
+
+    const uint16_t units = (uint16_t)(baud[0u] | (baud[1u] << 8u));
+
+    return ((units == 0u) || (units == 0xffffu)) ? DEFAULT_BAUDRATE : (uint32_t)units * BAUD_UNIT;
+}
+
+static void ingest_save_baudrate(uint32_t baudrate)
+{
+    const uint16_t units = (uint16_t)(baudrate / BAUD_UNIT);
+    const uint8_t baud[2u] = { (uint8_t)units, (uint8_t)(units >> 8u) };
+    fram_write(BAUD_LSB_LOCATION, baud, sizeof(baud));
+}
+
+static bool ingest_start(uint32_t baudrate)
+{
+    if (huart2.Init.BaudRate != baudrate)
+    {
+        HAL_UART_DeInit(&huart2);
+        huart2.Init.BaudRate = baudrate;
+        if (HAL_UART_Init(&huart2) != HAL_OK)
+        {
+            return false;
+        }
+    }
+
+    /* A start bit wakes the core from STOP1, the tickless idle sets UESM only around STOP */
+    const UART_WakeUpTypeDef wakeup_source = { .WakeUpEvent = UART_WAKEUP_ON_STARTBIT };
+    HAL_UARTEx_StopModeWakeUpSourceConfig(&huart2, wakeup_source);
+    __HAL_UART_ENABLE_IT(&huart2, UART_IT_WUF);
+
+    rx_tail = 0u;
+    rx_restart = false;
+    event_in = 0u;
+    event_out = 0u;
+
+    /* Circular DMA, the callback reports half, full and idle line positions */
+    return HAL_UARTEx_ReceiveToIdle_DMA(&huart2, rx_buffer, INGEST_RX_SIZE) == HAL_OK;
+}
+
+/* mode=ring: make room by dropping the oldest bytes, INGEST_OVERWRITE at a time so the checkpoint is stored once per
+   step. The bytes of an open BLK block go with them, they are on the card already. A cut record or frame is skipped
+   by the readers. Refused while the logger task flushes; it runs at a lower priority, so it never sees half a drop. */
+static bool ingest_overwrite(uint32_t length)
+{
+    const uint32_t held = flush_held(write_addr);
+    const uint32_t flushed = held - flush_pending(write_addr);
+    const uint32_t needed = held + length + 1u - LOCATION_BUFFER_SIZE;
+    uint32_t drop = (needed > flushed + INGEST_OVERWRITE) ? needed : flushed + INGEST_OVERWRITE;
+
+    drop = (drop < held) ? drop : held;
+    flush_discard(flush_ring_advance(write_addr, LOCATION_BUFFER_SIZE - held + drop), true);
+    if (flush_held(write_addr) != held - drop)
+    {
+        return false;
+    }
+    dropped += drop - flushed;
+
+    return true;
+}
+
+/* Append to the FRAM ring, all or nothing. Never overwrites data that is not on the card yet, unless mode=ring.
+   A failed write of the second part of a wrapping chunk takes the first part back, it is not in the ring either. */
+static __RAM_FUNC bool ingest_store(const uint8_t* data, uint32_t length)
+{
+    const uint32_t start_addr = write_addr;
+    const uint32_t start_total = stored_total;
+
+    if ((flush_held(write_addr) + length >= LOCATION_BUFFER_SIZE) && !(overwrite && ingest_overwrite(length)))
+    {
+        return false;
+    }
+
+    while (length > 0u)
+    {
+        uint32_t part = length;
+        if (part > LOCATION_BUFFER_END - write_addr)
+        {
+            part = LOCATION_BUFFER_END - write_addr;
+        }
+        if (!fram_write(write_addr, data, (uint16_t)part))
+        {
+            write_addr = start_addr;
+            stored_total = start_total;
+            return false;
+        }
+        write_addr = flush_ring_advance(write_addr, part);
+        stored_total += part;
+        data += part;
+        length -= part;
+    }
+
+    return true;
+}
+
+/* Compress the first length gathered bytes and store their frame, the rest moves to the front of the block */
+static __RAM_FUNC void ingest_seal(uint32_t length)
+{
+    if (!ingest_store(frame_buffer, compress_block(&compress, length, frame_buffer)))
+    {
+        dropped += length;
+    }
+    else if ((block_boundary != 0u) && (length == block_boundary))
+    {
+        frame_end = write_addr;
+    }
+
+    block_boundary = 0u;
+    block_fill -= length;
+    memmove(compress.block, &compress.block[length], block_fill);
+}
+
+/* Straight into the FRAM ring, or gathered into blocks that are stored when full */
+static __RAM_FUNC void ingest_output(const uint8_t* data, uint32_t length)
+{
+    if (!compressed)
+    {
+        if (!ingest_store(data, length))
+        {
+            dropped += length;
+        }
+        return;
+    }
+
+    while (length > 0u)
+    {
+        uint32_t part = INGEST_BLOCK_SIZE - block_fill;
+        if (part > length)
+        {
+            part = length;
+        }
+        memcpy(&compress.block[block_fill], data, part);
+        block_fill += part;
+        data += part;
+        length -= part;
+
+        if (block_fill == INGEST_BLOCK_SIZE)
+        {
+            /* With framing the block ends at the last frame boundary, unless a frame fills it on its own */
+            ingest_seal((block_boundary != 0u) ? block_boundary : block_fill);
+        }
+    }
+}
+
+/* The open record goes out with its header, a record never spans two ingest passes */
+static __RAM_FUNC void ingest_record_close(void)
+{
+    if (record_fill == 0u)
+    {
+        return;
+    }
+
+    const INGEST_RECORD_T header = {
+        .magic = INGEST_RECORD_MAGIC,
+        .epoch = (uint8_t)timer_us_epoch(record_stamp),
+        .length = (uint16_t)record_fill,
+        .stamp_us = record_stamp,
+    };
+    memcpy(record, &header, sizeof(header));
+    ingest_output(record, sizeof(header) + record_fill);
+    record_fill = 0u;
+}
+
+/* Output of the capture (and of the line filter and duplicate suppression). With timestamps the bytes of one chunk
+   are gathered into one record carrying its arrival time. */
+static __RAM_FUNC void ingest_emit(const uint8_t* data, uint32_t length)
+{
+    if (!stamped)
+    {
+        if (line_stamps)
+        {
+            stamp_feed(data, length);
+        }
+        else
+        {
+            ingest_output(data, length);
+        }
+        return;
+    }
+
+    if (record_stamp != stamp_us)
+    {
+        ingest_record_close();
+        record_stamp = stamp_us;
+    }
+    while (length > 0u)
+    {
+        uint32_t part = INGEST_RECORD_SIZE - sizeof(INGEST_RECORD_T) - record_fill;
+        if (part > length)
+        {
+            part = length;
+        }
+        memcpy(&record[sizeof(INGEST_RECORD_T) + record_fill], data, part);
+        record_fill += part;
+        data += part;
+        length -= part;
+
+        if (record_fill == INGEST_RECORD_SIZE - sizeof(INGEST_RECORD_T))
+        {
+            ingest_record_close();
+        }
+    }
+}
+
+/* The bytes passed on so far end with a frame: a record closes with it, the ring may be flushed up to here */
+static __RAM_FUNC void ingest_frame_boundary(void)
+{
+    ingest_record_close();
+    if (compressed && (block_fill != 0u))
+    {
+        block_boundary = block_fill;
+    }
+    else
+    {
+        frame_end = write_addr;
+    }
+}
+
+/* Frames skip the text stages, as records they still carry their arrival time */
+static __RAM_FUNC void ingest_framed(const uint8_t* data, uint32_t length)
+{
+    if (stamped)
+    {
+        ingest_emit(data, length);
+    }
+    else
+    {
+        ingest_output(data, length);
+    }
+}
+
+/* A frame longer than FRAMING_FRAME_MAX may be cut by the flush, the ring must not fill up waiting for its end */
+static void ingest_frame_limit(void)
+{
+    if (framing_active() && (flush_pending(write_addr) - flush_pending(frame_end) > FRAMING_FRAME_MAX))
+    {
+        frame_end = write_addr;
+    }
+}
+
+/* A new mark every INGEST_MARK_BYTES, and for the first chunk after INGEST_MARK_MS, older marks are overwritten */
+static void ingest_mark(uint64_t us)
+{
+    const INGEST_MARK_T* last = &marks[(mark_count + INGEST_MARKS - 1u) % INGEST_MARKS];
+    const bool moved = (mark_count == 0u) || (last->position != stored_total); // Otherwise the bytes there arrive now
+
+    if (moved && (mark_count != 0u) && (stored_total - last->position < INGEST_MARK_BYTES) &&
+        (us - last->us < (uint64_t)INGEST_MARK_MS * 1000u))
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if (moved)
+    {
+        mark_count++;
+    }
+    marks[(mark_count - 1u) % INGEST_MARKS] = (INGEST_MARK_T){ .position = stored_total, .us = us };
+    taskEXIT_CRITICAL();
+}
+
+/* Switch the ring format only when it is empty, a flush never sees text, frames and records mixed. In trigger mode the
+   ring never drains: the armed history is dropped for the switch, a closed window is flushed first. */
+static void ingest_apply_format(void)
+{
+    static bool deferred;
+
+    if ((compress_request == compressed) && (stamp_request == stamped))
+    {
+        deferred = false;
+        return;
+    }
+    if (block_fill != 0u)
+    {
+        return;
+    }
+
+    if (!compressed && (flush_pending(write_addr) != 0u) && capture_drop_history(write_addr))
+    {
+        log_info("Trigger history dropped for the format switch\r\n");
+    }
+    if (flush_pending(write_addr) == 0u)
+    {
+        compressed = compress_request;
+        stamped = stamp_request;
+        deferred = false;
+        ingest_save_format();
+        log_info("Ingest compression %s, timestamps %s\r\n", compressed ? "on" : "off", stamped ? "on" : "off");
+    }
+    else if (!deferred)
+    {
+        deferred = true;
+        log_info("Ingest format switch waits for %lu buffered bytes\r\n", flush_pending(write_addr));
+    }
+}
+
+/* Duplicate line suppression is switched at line level: what the filter still holds goes out first */
+static void ingest_apply_dedup(void)
+{
+    if (dedup_request != dedup_enabled)
+    {
+        if (dedup_enabled)
+        {
+            dedup_flush();
+        }
+        dedup_enabled = dedup_request;
+    }
+}
+
+/* Lines kept by the filter go on to duplicate suppression */
+static __RAM_FUNC void ingest_filtered(const uint8_t* data, uint32_t length)
+{
+    if (dedup_enabled)
+    {
+        dedup_feed(data, length, now_us);
+    }
+    else
+    {
+        ingest_emit(data, length);
+    }
+}
+
+/* New rules are compiled by the ingest task, a line the filter still holds is decided with the old ones */
+static void ingest_apply_filter(void)
+{
+    static char rules[FILTER_RULES_SIZE];
+
+    if (!filter_request)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    memcpy(rules, filter_rules, sizeof(rules));
+    filter_request = false;
+    taskEXIT_CRITICAL();
+
+    if (!filter_compile(rules))
+    {
+        log_info("Line filter rules do not fit, filter off\r\n");
+    }
+    else
+    {
+        log_info("Line filter %s\r\n", filter_active() ? "on" : "off");
+    }
+}
+
+/* Whatever was stored before the switch counts as whole frames, switched on the framing waits for a delimiter */
+static void ingest_apply_framing(void)
+{
+    if (!framing_request)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    const bool enable = framing_enable;
+    const uint8_t delimiter = framing_delimiter;
+    framing_request = false;
+    taskEXIT_CRITICAL();
+
+    if (enable && !framing_active())
+    {
+        filter_idle();
+        if (dedup_enabled)
+        {
+            dedup_flush();
+        }
+    }
+    ingest_record_close();
+    frame_end = write_addr;
+    block_boundary = block_fill;
+    framing_configure(enable, delimiter);
+    log_info("Framing %s\r\n", enable ? "on" : "off");
+}
+
+static void ingest_apply_capture(void)
+{
+    static char trigger[CAPTURE_TRIGGER_MAX];
+
+    if (!capture_request)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    memcpy(trigger, capture_trigger, sizeof(trigger));
+    const bool enable = capture_enable;
+    const uint32_t pre = capture_pre;
+    const uint32_t post = capture_post;
+    capture_request = false;
+    taskEXIT_CRITICAL();
+
+    capture_configure(enable, trigger, pre, post);
+    log_info("Trigger capture %s\r\n", enable ? "armed" : "off");
+}
+
+/* Move everything the DMA has written since the last call into the FRAM ring. seal is set after INGEST_SEAL_MS without
+   input: the partial line held by the filter and a partial compression block are stored then. */
+static __RAM_FUNC void ingest_consume(uint16_t head, bool capturing)
+{
+    while (rx_tail != head)
+    {
+        const uint32_t length = ((head > rx_tail) ? head : INGEST_RX_SIZE) - rx_tail;
+
+        if (capturing)
+        {
+            capture_feed(&rx_buffer[rx_tail], length, write_addr, now_us);
+        }
+        if (framing_active())
+        {
+            framing_feed(&rx_buffer[rx_tail], length);
+        }
+        else if (filter_active())
+        {
+            filter_feed(&rx_buffer[rx_tail], length);
+        }
+        else
+        {
+            ingest_filtered(&rx_buffer[rx_tail], length);
+        }
+        rx_tail = (uint16_t)((rx_tail + length) % INGEST_RX_SIZE);
+    }
+}
+
+static __RAM_FUNC void ingest_process(bool seal)
+{
+    const uint32_t start_addr = write_addr;
+
+    /* The capture history is cut at arbitrary bytes, it only works on text */
+    const bool capturing = capture_active() && !compressed;
+
+    now_us = timer_now_us();
+    ingest_apply_capture();
+    ingest_apply_filter();
+    ingest_apply_dedup();
+    ingest_apply_framing();
+    while (event_out != event_in)
+    {
+        stamp_us = events[event_out].stamp_us;
+        const uint64_t event_us = ((uint64_t)timer_us_epoch(stamp_us) << 32u) | stamp_us;
+        if (line_stamps)
+        {
+            stamp_time(event_us);
+        }
+        ingest_mark(event_us);
+        ingest_consume(events[event_out].head, capturing);
+        seal_deadline = event_us + (uint64_t)INGEST_SEAL_MS * 1000u;
+        event_out = (uint8_t)((event_out + 1u) % INGEST_EVENTS);
+    }
+
+    if (seal)
+    {
+        filter_idle();
+    }
+    if (dedup_enabled)
+    {
+        if (seal)
+        {
+            dedup_idle();
+        }
+        dedup_poll(now_us);
+    }
+    ingest_record_close();
+    if (seal && (block_fill != 0u))
+    {
+        /* Whole frames in a frame of their own, so the flush can take them while the last one is still open */
+        if ((block_boundary != 0u) && (block_boundary < block_fill))
+        {
+            ingest_seal(block_boundary);
+        }
+        ingest_seal(block_fill);
+    }
+    ingest_frame_limit();
+    const bool closed = capturing && capture_update(write_addr, now_us);
+
+    if (write_addr != start_addr)
+    {
+        ingest_save_write_addr();
+    }
+    if (((write_addr != start_addr) || closed) && (subscriber != NULL))
+    {
+        xTaskNotify(subscriber, INGEST_EVENT_DATA, eSetBits);
+    }
+}
+
+/* Wait for the UART callbacks, but not longer than the held partial data, an open repeat run or an open capture window
+   may wait */
+static TickType_t ingest_timeout(void)
+{
+    if ((block_fill != 0u) || filter_holding() || (dedup_enabled && dedup_holding()))
+    {
+        return pdMS_TO_TICKS(timer_remaining_ms(seal_deadline));
+    }
+
+    const uint64_t run = dedup_enabled ? dedup_poll(timer_now_us()) : TIMER_NEVER;
+    const uint64_t window = capture_deadline();
+    const uint64_t deadline = (run < window) ? run : window;
+
+    return (deadline != TIMER_NEVER) ? pdMS_TO_TICKS(timer_remaining_ms(deadline)) : portMAX_DELAY;
+}
+
+/* Wake the ingest task from the UART callbacks, before the scheduler runs the data simply waits in the DMA ring */
+static __RAM_FUNC void ingest_wake_from_isr(void)
+{
+    if ((ingest_handle != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING))
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(ingest_handle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+void ingest_boot_prepare(void)
+{
+    timer_us_init();
+
+    __HAL_RCC_HSI_ENABLE();
+    while (!__HAL_RCC_GET_FLAG(RCC_FLAG_HSIRDY))
+    {
+    }
+}
+
+void ingest_boot(void)
+{
+    rx_buffer = arena_alloc(ARENA_INGEST, INGEST_RX_SIZE);
+    write_addr = ingest_load_write_addr();
+
+    if (!ingest_start(ingest_load_baudrate()))
+    {
+        Error_Handler();
+    }
+
+    boot_us = DWT->CYCCNT / (SystemCoreClock / 1000000u); // Still the boot clock, set by SystemInit()
+    LED_ON; // Scope marker: NRST rising edge to LED is the reset to capture latency
+
+    /* Not needed to arm the capture, the first bytes wait in the DMA ring */
+    compress_init(&compress, ARENA_INGEST, INGEST_BLOCK_SIZE, true);
+    frame_buffer = arena_alloc(ARENA_INGEST, COMPRESS_FRAME_SIZE(INGEST_BLOCK_SIZE));
+    filter_init(ingest_filtered);
+    dedup_init(ingest_emit);
+    stamp_init(ingest_output);
+    record = arena_alloc(ARENA_INGEST, INGEST_RECORD_SIZE);
+    framing_init(ingest_framed, ingest_frame_boundary);
+
+    const uint8_t format = ingest_load_format();
+    compressed = (format & FORMAT_FRAMES) != 0u;
+    compress_request = compressed;
+    stamped = (format & FORMAT_RECORDS) != 0u;
+    stamp_request = stamped;
+    frame_end = write_addr; // A frame cut by the power loss is flushed with the last log, the framing syncs anew
+    capture_init(write_addr);
+}
+
+uint32_t ingest_boot_latency_us(void)
+{
+    return boot_us;
+}
+
+void ingest_set_baudrate(uint32_t baudrate)
+{
+    pending_baudrate = baudrate;
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+void ingest_set_compression(bool enable)
+{
+    compress_request = enable;
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+void ingest_set_timestamps(bool enable)
+{
+    stamp_request = enable;
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+void ingest_set_line_stamps(bool enable)
+{
+    line_stamps = enable;
+}
+
+void ingest_set_overwrite(bool enable)
+{
+    overwrite = enable;
+}
+
+void ingest_set_dedup(bool enable)
+{
+    dedup_request = enable;
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+void ingest_set_filter(const char* rules)
+{
+    if (strncmp(rules, filter_rules, sizeof(filter_rules)) == 0)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    strncpy(filter_rules, rules, sizeof(filter_rules) - 1u);
+    filter_request = true;
+    taskEXIT_CRITICAL();
+
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+void ingest_set_framing(bool enable, uint8_t delimiter)
+{
+    taskENTER_CRITICAL();
+    framing_enable = enable;
+    framing_delimiter = delimiter;
+    framing_request = true;
+    taskEXIT_CRITICAL();
+
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+void ingest_set_capture(bool enable, const char* trigger, uint32_t pre_bytes, uint32_t post_bytes)
+{
+    taskENTER_CRITICAL();
+    strncpy(capture_trigger, trigger, sizeof(capture_trigger) - 1u);
+    capture_enable = enable;
+    capture_pre = pre_bytes;
+    capture_post = post_bytes;
+    capture_request = true;
+    taskEXIT_CRITICAL();
+
+    if (ingest_handle != NULL)
+    {
+        xTaskNotifyGive(ingest_handle);
+    }
+}
+
+bool ingest_compressed(void)
+{
+    return compressed;
+}
+
+bool ingest_stamped(void)
+{
+    return stamped;
+}
+
+__RAM_FUNC void ingest_irq_entry(uint32_t stamp)
+{
+    irq_us = stamp;
+}
+
+void ingest_subscribe(TaskHandle_t task)
+{
+    subscriber = task;
+}
+
+uint32_t ingest_baudrate(void)
+{
+    return huart2.Init.BaudRate;
+}
+
+uint32_t ingest_write_addr(void)
+{
+    return write_addr;
+}
+
+uint32_t ingest_flush_addr(void)
+{
+    return framing_active() ? frame_end : write_addr;
+}
+
+uint64_t ingest_time_at(uint32_t addr)
+{
+    uint64_t us = 0u;
+    uint32_t nearest = UINT32_MAX;
+
+    taskENTER_CRITICAL();
+    const uint32_t behind = (write_addr >= addr) ? write_addr - addr : LOCATION_BUFFER_SIZE - (addr - write_addr);
+    const uint32_t position = stored_total - behind;
+    const uint32_t count = (mark_count < INGEST_MARKS) ? mark_count : INGEST_MARKS;
+    for (uint32_t index = 0u; index < count; index++)
+    {
+        /* The last mark at or before the position, a mark after it wraps to a huge distance */
+        const uint32_t distance = position - marks[index].position;
+        if ((distance < nearest) && (distance < UINT32_MAX / 2u))
+        {
+            nearest = distance;
+            us = marks[index].us;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return us;
+}
+
+uint32_t ingest_dropped(void)
+{
+    return dropped;
+}
+
+static void ingest_task(void* arg)
+{
+    LED_OFF;
+
+    bool seal = false;
+
+    while (true)
+    {
+        ingest_apply_format();
+        ingest_process(seal);
+
+        if ((pending_baudrate != 0u) || rx_restart)
+        {
+            const uint32_t baudrate = (pending_baudrate != 0u) ? pending_baudrate : huart2.Init.BaudRate;
+            HAL_UART_AbortReceive(&huart2);
+            ingest_process(false);
+            if (ingest_start(baudrate) && (pending_baudrate != 0u))
+            {
+                ingest_save_baudrate(baudrate);
+                log_info("Capture baudrate: %lu\r\n", baudrate);
+            }
+            pending_baudrate = 0u;
+        }
+
+        seal = (ulTaskNotifyTake(pdTRUE, ingest_timeout()) == 0u) && timer_expired(seal_deadline);
+    }
+}
+
+void ingest_task_entry(void)
+{
+    ingest_handle = arena_create_task(ingest_task, "ingest", INGEST_STACK, INGEST_PRIORITY);
+
+    if (ingest_handle == NULL)
+    {
+        log_info("ingest task initialization failed\r\n");
+    }
+}
+
+__RAM_FUNC void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t size)
+{
+    if (huart->Instance == USART2)
+    {
+        const INGEST_EVENT_T event = { .stamp_us = irq_us, .head = (size >= INGEST_RX_SIZE) ? 0u : size };
+        const uint8_t next = (uint8_t)((event_in + 1u) % INGEST_EVENTS);
+        if (next == event_out)
+        {
+            /* Queue full: the newest event takes this position, its chunk gets the later time */
+            events[(event_in + INGEST_EVENTS - 1u) % INGEST_EVENTS] = event;
+        }
+        else
+        {
+            events[event_in] = event;
+            event_in = next;
+        }
+        power_activity();
+        ingest_wake_from_isr();
+    }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart)
+{
+    if (huart->Instance == USART2)
+    {
+        rx_restart = true;
+        ingest_wake_from_isr();
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef _INGEST_H_
+#define _INGEST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define INGEST_EVENT_DATA (1u << 0u) /**< Notification bit: new data was stored in the FRAM ring */
+
+/**
+ * @brief Start the microsecond timer and HSI16 (USART2 kernel clock). First call in main().
+ *        The cycle counter already runs, Reset_Handler starts it.
+ */
+void ingest_boot_prepare(void);
+
+/**
+ * @brief Arm USART2 DMA capture at the baudrate stored in FRAM.
+ *        Called from main() right after USART2/SPI1 init, before the clock switch and the RTOS.
+ *        Received bytes wait in the DMA ring until the ingest task stores them into FRAM.
+ */
+void ingest_boot(void);
+
+/**
+ * @brief Time from the first instruction of Reset_Handler to capture armed, taken with the cycle counter at the
+ *        boot clock. The data copy and bss clear of the startup code are included, the hardware reset (option
+ *        byte load) is not: the LED_ON in ingest_boot() is the scope marker for that.
+ *
+ * @return uint32_t latency in microseconds
+ */
+uint32_t ingest_boot_latency_us(void);
+
+/**
+ * @brief Request a new capture baudrate, applied and stored in FRAM by the ingest task
+ *
+ * @param baudrate new baudrate in bps
+ */
+void ingest_set_baudrate(uint32_t baudrate);
+
+/**
+ * @brief Current capture baudrate
+ */
+uint32_t ingest_baudrate(void);
+
+/**
+ * @brief Request compression at ingest (static dictionary, INGEST_BLOCK_SIZE frames). The ingest task switches
+ *        once the FRAM ring is empty, buffered data keeps the format it was stored in.
+ *
+ * @param enable compress blocks before they are stored in FRAM
+ */
+void ingest_set_compression(bool enable);
+
+/**
+ * @brief Request timestamped records (ingest_record.h). Like the compression the ingest task switches once the FRAM
+ *        ring is empty.
+ *
+ * @param enable store every received chunk behind a header with its arrival time
+ */
+void ingest_set_timestamps(bool enable);
+
+/**
+ * @brief Put the arrival time in front of every received line (Core/STAMP). Applies to text only, on a ring of
+ *        records or frames it waits for the switch like any other data.
+ *
+ * @param enable prefix lines with the time since boot
+ */
+void ingest_set_line_stamps(bool enable);
+
+/**
+ * @brief mode=ring: when the FRAM ring is full its oldest bytes are dropped for new ones, otherwise new bytes are
+ *        dropped. The oldest bytes stay while a flush runs.
+ *
+ * @param enable overwrite the oldest buffered bytes
+ */
+void ingest_set_overwrite(bool enable);
+
+/**
+ * @brief Switch duplicate line suppression (Core/DEDUP) on or off, applied by the ingest task
+ *
+ * @param enable drop repeated lines and store a summary instead
+ */
+void ingest_set_dedup(bool enable);
+
+/**
+ * @brief Replace the line filter rules (Core/FILTER), compiled by the ingest task. Unchanged rules are ignored.
+ *
+ * @param rules LOGGER_CONFIG_T filter, empty to pass every line
+ */
+void ingest_set_filter(const char* rules);
+
+/**
+ * @brief Switch framed binary input (Core/FRAMING), applied by the ingest task. Frames bypass the line filter, duplicate
+ *        suppression and line timestamps, the flush only takes whole frames.
+ *
+ * @param enable received bytes are COBS or SLIP frames
+ * @param delimiter FRAMING_COBS_DELIMITER or FRAMING_SLIP_END
+ */
+void ingest_set_framing(bool enable, uint8_t delimiter);
+
+/**
+ * @brief Set up the trigger capture (Core/CAPTURE), applied by the ingest task. Needs a text ring: with ingest
+ *        compression still on the capture waits until the ring switched back.
+ *
+ * @param enable keep only a history in FRAM and capture the windows around the trigger
+ * @param trigger pattern that starts a capture
+ * @param pre_bytes history kept in front of the trigger
+ * @param post_bytes captured after the trigger
+ */
+void ingest_set_capture(bool enable, const char* trigger, uint32_t pre_bytes, uint32_t post_bytes);
+
+/**
+ * @brief true while the FRAM ring holds compressed frames, the flush then copies them into LOGxxxxx.LZB
+ */
+bool ingest_compressed(void);
+
+/**
+ * @brief true while the FRAM ring holds timestamped records, the flush then writes LOGxxxxx.TSR
+ */
+bool ingest_stamped(void);
+
+/**
+ * @brief Remember the time an USART2 or DMA interrupt was entered, the next UART callback stamps its event with it
+ *
+ * @param stamp timer_us(), read as the first instruction of the interrupt handler
+ */
+void ingest_irq_entry(uint32_t stamp);
+
+/**
+ * @brief FRAM address one past the last stored byte
+ */
+uint32_t ingest_write_addr(void);
+
+/**
+ * @brief FRAM address the flush may go up to: after the last whole frame with framing, otherwise the write address
+ */
+uint32_t ingest_flush_addr(void);
+
+/**
+ * @brief Arrival time of the data stored at a FRAM address, from the last of INGEST_MARKS marks at or before it
+ *
+ * @param addr FRAM address of a stored byte not flushed yet
+ * @return uint64_t microseconds since boot (timer_now_us()), 0 if no mark covers it (stored before this boot)
+ */
+uint64_t ingest_time_at(uint32_t addr);
+
+/**
+ * @brief Bytes dropped because the FRAM ring was full
+ */
+uint32_t ingest_dropped(void);
+
+/**
+ * @brief Notify a task (eSetBits with INGEST_EVENT_DATA) every time new data is stored in FRAM
+ *
+ * @param task task to notify, NULL to stop
+ */
+void ingest_subscribe(TaskHandle_t task);
+
+/**
+ * @brief Start the ingest task, it sleeps until the UART callbacks report received data
+ */
+void ingest_task_entry(void);
+
+#endif // !_INGEST_H_
@@ -0,0 +1,23 @@
+#ifndef _INGEST_RECORD_H_
+#define _INGEST_RECORD_H_
+
+#include <stdint.h>
+
+/**< With timestamps=records the FRAM ring, and the log it is flushed into (LOGxxxxx.TSR, or the content of a
+ *   LOGxxxxx.LZB), is a sequence of records: this header, then length data bytes. stamp_us is the TIM2 count read as
+ *   the first instruction of the USART2 or DMA interrupt that reported the last byte of the chunk, so it is the
+ *   arrival time of that byte within a few microseconds. The counter starts at boot; it stops in STOP, and on wake it
+ *   is stepped by the time LPTIM1 measured (Core/TIMER), so stamps stay microseconds since boot.
+ *   Shared with Tools/ts_decode, all fields are little endian. */
+
+#define INGEST_RECORD_MAGIC 0xf5u /**< Never part of UTF-8 text */
+
+typedef struct
+{
+    uint8_t magic;
+    uint8_t epoch;     /**< Low byte of the 2^32 us wrap count */
+    uint16_t length;   /**< Data bytes after the header */
+    uint32_t stamp_us; /**< Microseconds since boot, modulo 2^32 */
+} INGEST_RECORD_T;
+
+#endif // !_INGEST_RECORD_H_
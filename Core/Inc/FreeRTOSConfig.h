@@ -68,7 +68,7 @@ extern uint32_t SystemCoreClock;
 #define configTICK_RATE_HZ                      ((TickType_t)1000)
 #define configMAX_PRIORITIES                    (56)
 #define configMINIMAL_STACK_SIZE                ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                   ((size_t)8500)
+#define configTOTAL_HEAP_SIZE                   ((size_t)512)
 #define configMAX_TASK_NAME_LEN                 (16)
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_16_BIT_TICKS                  0
@@ -173,6 +173,18 @@ standard names. */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
 #define task_delay(ms) vTaskDelay(pdMS_TO_TICKS(ms))
 
+/* Task stacks, control blocks and semaphores are static (Core/ARENA). The heap only holds the FatFs volume
+   semaphore created by ff_cre_syncobj(); ff_malloc() is unused with _USE_LFN 0. */
+#define configCHECK_FOR_STACK_OVERFLOW 2
+
+/* Tickless idle: the idle task enters STOP through LPTIM1, see Core/POWER/power.c */
+#define configUSE_TICKLESS_IDLE               2
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP 4
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+void power_sleep(uint32_t idle_ticks);
+#endif
+#define portSUPPRESS_TICKS_AND_SLEEP(idle) power_sleep(idle)
+
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
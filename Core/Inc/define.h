@@ -6,19 +6,22 @@
 #define CONFIG_FILE   "config.txt"
 
 #define DEBUG
+// #define CONSOLE_BINARY // Console sends binary records, decode with Tools/log_decode and build/SD_Logger_Test.fmt
 
 /**< RTOS Stack Definition */
-#define CONSOLE_STACK       128u
+#define CONSOLE_STACK       256u // Formats every console message
 #define CONSOLE_PRIORITY    1u
 #define LOGGER_APP_STACK    128u
 #define LOGGER_APP_PRIORITY 3u
 #define SD_STACK            128u
 #define SD_PRIORITY         2u
-#define FRAM_STACK          128u
-#define FRAM_PRIORITY       4u
+#define INGEST_STACK        192u // compress_block() runs on the ingest path
+#define INGEST_PRIORITY     5u
 
 /**< Logger Configuration */
 #define CFG_FILENAME "config.txt" // Name of the file that contains configuration
+#define CONFIG_VERSION  8u          // Bump when LOGGER_CONFIG_T changes, invalidates the FRAM cache
+#define CONFIG_FILE_MAX 768u        // Bytes of config.txt that are parsed
 #define MB85RS2MTA                /**< FUJITSU 256kbytes FRAM */
 /*************************************************FRAM ADDRESS CONFIG*****************************************************/
 // External FRAM locations for user settings
@@ -27,8 +30,8 @@
 #define LOCATION_FILE_NUMBER_LSB 0x03 // 16-bit value LSB for file location number
 #define LOCATION_FILE_NUMBER_MSB 0x04 // 16-bit value MSB for file location number
 
-#define BAUD_LSB_LOCATION 0x05 // 16-bit value LSB for Logger baudrate
-#define BAUD_MSB_LOCATION 0x06 // 16-bit value MSB for Logger baudrate
+#define BAUD_LSB_LOCATION 0x05 // 16-bit value LSB for Logger baudrate (in 100 bps units)
+#define BAUD_MSB_LOCATION 0x06 // 16-bit value MSB for Logger baudrate (in 100 bps units)
 
 #define LOGGER_STAT_LOCATION 0x07 // Logger status location
 
@@ -38,14 +41,21 @@
 #define SYNC_BUFFER_LSB  0x0A // Last 8 LSB of the Iterator
 
 /*-----------------------------------------------------------------------------------------------*/
-// #define LOCATION_BAUD_SETTING_HIGH 0x0B
-// #define LOCATION_BAUD_SETTING_MID 0x0C
-// #define LOCATION_BAUD_SETTING_LOW 0x0D
+#define INGEST_FORMAT_LOCATION 0x0B // Content of the FRAM ring: bit 0 frames compressed by the ingest, bit 1 timestamped records
+#define CAPTURE_LOCATION       0x0C // 4 bytes: trigger capture state and 24-bit window end
 
 // #define LOCATION_LOGGER_RESTORE 0x0E
 
 #define LOCATION_BUFFER_START 20u      // Address of start position when buffering
-#define LOCATION_BUFFER_END   0x3ff70u // Address of end position when buffering (260000)
+#define LOCATION_BUFFER_END   0x3fc00u // Address of end position when buffering (261120)
+#define LOCATION_BUFFER_SIZE  (LOCATION_BUFFER_END - LOCATION_BUFFER_START)
+
+/*---------------- Cached configuration, parsed from config.txt only when its directory entry changes -----*/
+#define LOCATION_CONFIG_CACHE 0x3fc00u // 896 bytes reserved up to the checkpoint slots
+
+/*---------------- Flush checkpoint, two slots written alternately, newest valid slot wins ------------*/
+#define LOCATION_CHECKPOINT_A 0x3ff80u // 32 bytes reserved for checkpoint slot A
+#define LOCATION_CHECKPOINT_B 0x3ffa0u // 32 bytes reserved for checkpoint slot B
 
 /*************************************************USER DEFINE BUFFER SIZE, ITERATOR LOCAION AND TIMEOUT**********************************/
 #ifdef DEBUG
@@ -56,4 +66,54 @@
     #define MAX_IDLE_TIME_MSEC 5000  // User define timeout before going low power
 #endif
 
+#define DEFAULT_BAUDRATE    115200u // Used until a baudrate is stored in FRAM
+#define INGEST_RX_SIZE      8192u   // USART2 DMA ring, holds ~710 ms at 115200 bps
+#define INGEST_BLOCK_SIZE   1024u   // Raw bytes per frame when the ingest compresses (compression=ingest)
+#define INGEST_SEAL_MS      50u     // A partly filled ingest block is compressed and stored after this long without input
+#define INGEST_EVENTS       8u      // Timestamped UART/DMA events waiting for the ingest task, later ones merge when full
+#define INGEST_RECORD_SIZE  256u    // Largest timestamped record, header included (timestamps=records)
+#define INGEST_MARKS        32u     // Arrival times kept for stored data not flushed yet (container block times)
+#define INGEST_MARK_BYTES   4096u   // A new arrival time mark after this many stored bytes
+#define INGEST_MARK_MS      1000u   // or for the first chunk after this long
+#define INGEST_OVERWRITE    4096u   // mode=ring: oldest bytes dropped at once when the FRAM ring is full
+#define DEDUP_LINE_MAX      256u    // Longer lines are never suppressed as repeats
+#define DEDUP_RUN_MS        30000u  // A run of repeated lines is summarised at least this often
+#define FILTER_RULES        8u      // include= and exclude= rules in config.txt, bits of a uint8_t mask
+#define FILTER_RULES_SIZE   128u    // All rules as "+pattern\n-pattern\n" text, stored in the FRAM config cache
+#define FILTER_PIECES       16u     // Pattern pieces between '*' over all rules
+#define FILTER_STATES       128u    // Automaton states, one per pattern byte plus the root, below 255
+#define FILTER_CLASSES      32u     // Distinct pattern bytes plus one class for all others
+#define FILTER_LINE_MAX     256u    // Longer lines are decided on their first bytes
+#define CAPTURE_TRIGGER_MAX 32u     // Trigger pattern of mode=trigger, including the terminator
+#define CAPTURE_PRE_KB      32u     // Default history kept in front of the trigger
+#define CAPTURE_POST_KB     32u     // Default window captured after the trigger
+#define CAPTURE_POST_MS     60000u  // A post-trigger window that does not fill is closed after this long
+#define FRAMING_FRAME_MAX   4096u   // Longest frame kept whole (framing=cobs/slip), the flush may cut longer ones
+#define FLUSH_CHUNK_SIZE    4096u // Bytes committed to SD between two flush checkpoints
+#define FLUSH_TRANSFER_SIZE 512u  // Bytes moved from FRAM to SD per transfer
+#define FLUSH_INDEX_STRIDE  16384u // Log file bytes per entry of its LOGxxxxx.IDX time and word index
+#define FLUSH_INDEX_BLOOM   256u   // Bytes of word filter per index entry, a power of two
+#define COMPRESS_BLOCK_SIZE FLUSH_CHUNK_SIZE // Raw bytes per compressed frame, one frame per flush checkpoint
+#define COMPRESS_HASH_BITS  10u   // Match finder table of 2^bits 16-bit positions
+#define FRAM_TIMEOUT_MS     10u   // Longest wait for one FRAM DMA completion before the state is polled again
+#define FRAM_SPI_MAX_HZ     40000000u // MB85RS2MTA and SPI1 maximum SCK
+#define FRAM_DMA_MIN        32u   // Shorter FRAM payloads are polled, setting up the DMA costs more than the transfer
+#define SPI_BUS_SPIN_MAX    100000u // Status polls for one SPI frame before the bus counts as dead, about 8 ms at 80 MHz
+#define CONSOLE_TX_SIZE     1024u // USART2 TX DMA ring, power of two
+#define CONSOLE_RECORDS     16u   // Queued console messages waiting to be formatted
+#define CONSOLE_LINE_MAX    128u  // Longest formatted console message
+#define CONSOLE_TEXT_MAX    40u   // Bytes of %s arguments copied per queued console message
+#define CONSOLE_TX_TIMEOUT_MS 100u // Check a running TX DMA transfer for an abort after this long
+
+/**< Static arena (Core/ARENA): one slice per subsystem, sized from the buffer sizes above */
+#define ARENA_ALIGN           8u             // DMA and AAPCS stack alignment
+#define ARENA_SRAM1           ".arena_sram1" // 40K, DMA buffers
+#define ARENA_SRAM2           ".arena_sram2" // 8K, task stacks
+#define ARENA_INGEST_REGION   ARENA_SRAM1
+#define ARENA_FLUSH_REGION    ARENA_SRAM1
+#define ARENA_CONSOLE_REGION  ARENA_SRAM1
+#define ARENA_COMPRESS_REGION ARENA_SRAM1
+#define ARENA_RTOS_REGION     ARENA_SRAM2
+#define ARENA_TASKS           3u // ingest, console, logger
+
 #endif /* DEFINE_H */
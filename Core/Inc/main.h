@@ -63,6 +63,7 @@ void Error_Handler(void);
     extern DMA_HandleTypeDef hdma_spi1_tx;
 
     extern UART_HandleTypeDef huart2;
+    extern DMA_HandleTypeDef hdma_usart2_rx;
     extern DMA_HandleTypeDef hdma_usart2_tx;
     extern UART_WakeUpTypeDef wakeup; // Wake up handler
 
@@ -0,0 +1,254 @@
+#include "power.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "FreeRTOSConfig.h"
+#include "define.h"
+#include "main.h"
+#include "task.h"
+#include "timer.h"
+
+#define LPTIM_MAX        0xffffu /**< LPTIM1 is a 16-bit counter */
+#define LPTIM_MARGIN     8u      /**< Counts kept free so the compare is always ahead of the counter */
+#define LSI_CAL_COUNTS   128u    /**< LSI periods timed with the cycle counter in power_init() */
+#define LSI_NOMINAL_HZ   32000u
+
+#define HSI_MHZ          (HSI_VALUE / 1000000u)
+#define STOP1_EXIT_US    5u      /**< STOP1 exit to HSI16 of the datasheet, a USART2 start bit is not time stamped */
+
+static uint32_t wake_us; /**< Wake-up event to ready of the last STOP exit */
+static uint32_t wake_max_us;
+
+static uint32_t lsi_hz = LSI_NOMINAL_HZ;
+static bool initialised;
+static uint32_t stop_count;
+static uint32_t resume_carry; /**< Remainder of the last LPTIM1 to microsecond conversion, the clock does not drift by it */
+static uint64_t idle_us;              /**< STOP is entered this long after the last input (sleep_idle_ms) */
+static volatile uint64_t activity_us; /**< Last input, timer_now_us() */
+
+/* LPTIM1 is clocked asynchronously, a read is only valid when two consecutive reads match */
+static uint16_t lptim_count(void)
+{
+    uint32_t count;
+
+    do
+    {
+        count = LPTIM1->CNT;
+    } while (count != LPTIM1->CNT);
+
+    return (uint16_t)count;
+}
+
+static void lptim_set_compare(uint16_t value)
+{
+    LPTIM1->ICR = LPTIM_ICR_CMPOKCF | LPTIM_ICR_CMPMCF;
+    LPTIM1->CMP = value;
+    while ((LPTIM1->ISR & LPTIM_ISR_CMPOK) == 0u)
+    {
+    }
+    LPTIM1->ICR = LPTIM_ICR_CMPOKCF;
+}
+
+/* Second half of the wake path at CLOCK_HIGH, PLLON was set right after the wakeup so the lock ran in parallel.
+   At CLOCK_LOW the core wakes directly on MSI (STOPWUCK) and there is nothing to do. */
+static void power_restore_clock(void)
+{
+    while (READ_BIT(RCC->CR, RCC_CR_PLLRDY) == 0u)
+    {
+    }
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, RCC_CFGR_SW_PLL);
+    while (READ_BIT(RCC->CFGR, RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
+    {
+    }
+}
+
+/* STOP halts the DMA and SPI/UART kernel clocks, never enter it with a transfer on the way */
+static bool power_stop_allowed(void)
+{
+    return (HAL_SPI_GetState(&hspi1) == HAL_SPI_STATE_READY) && (HAL_SPI_GetState(&hspi2) == HAL_SPI_STATE_READY) &&
+           (huart2.gState == HAL_UART_STATE_READY);
+}
+
+/* TIM2 was stopped from the LPTIM1 count start until now, wake-up and PLL relock included */
+static void power_resume_us(uint16_t start)
+{
+    const uint64_t scaled = (uint64_t)(uint16_t)(lptim_count() - start) * 1000000u + resume_carry;
+
+    resume_carry = (uint32_t)(scaled % lsi_hz);
+    timer_us_resume((uint32_t)(scaled / lsi_hz));
+}
+
+void power_init(void)
+{
+    __HAL_RCC_LSI_ENABLE();
+    while (!__HAL_RCC_GET_FLAG(RCC_FLAG_LSIRDY))
+    {
+    }
+
+    __HAL_RCC_LPTIM1_CONFIG(RCC_LPTIM1CLKSOURCE_LSI);
+    __HAL_RCC_LPTIM1_CLK_ENABLE();
+    __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_HSI); // Same clock as USART2 and the PLL input
+    SET_BIT(RCC->CR, RCC_CR_HSIKERON);                         // USART2 samples the first start bit without HSI16 startup
+
+    LPTIM1->CR = 0u;
+    LPTIM1->CFGR = 0u;              // Internal clock, no prescaler
+    LPTIM1->IER = LPTIM_IER_CMPMIE; // IER may only be written while disabled
+    LPTIM1->CR = LPTIM_CR_ENABLE;
+    LPTIM1->ARR = LPTIM_MAX;
+    while ((LPTIM1->ISR & LPTIM_ISR_ARROK) == 0u)
+    {
+    }
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+    LPTIM1->CR |= LPTIM_CR_CNTSTRT;
+
+    /* LSI is only accurate to a few percent, time it against the core clock once */
+    const uint16_t start = lptim_count();
+    while (lptim_count() == start)
+    {
+    }
+    const uint16_t first = lptim_count();
+    const uint32_t cycles = DWT->CYCCNT;
+    while ((uint16_t)(lptim_count() - first) < LSI_CAL_COUNTS)
+    {
+    }
+    lsi_hz = (uint32_t)(((uint64_t)SystemCoreClock * LSI_CAL_COUNTS) / (DWT->CYCCNT - cycles));
+    initialised = true;
+
+    SET_BIT(EXTI->IMR2, EXTI_IMR2_IM32); // LPTIM1 wakeup line
+    HAL_NVIC_SetPriority(LPTIM1_IRQn, 15, 0);
+    HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+}
+
+void power_set_idle(uint32_t idle_ms)
+{
+    idle_us = (idle_ms != UINT32_MAX) ? (uint64_t)idle_ms * 1000u : TIMER_NEVER;
+}
+
+void power_activity(void)
+{
+    activity_us = timer_now_us();
+}
+
+void power_sleep(TickType_t idle_ticks)
+{
+    const uint32_t max_ticks = ((LPTIM_MAX - LPTIM_MARGIN) * configTICK_RATE_HZ) / lsi_hz;
+    if (idle_ticks > max_ticks)
+    {
+        idle_ticks = max_ticks;
+    }
+
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep)
+    {
+        __enable_irq();
+        return;
+    }
+
+    if (!initialised || !power_stop_allowed() || (timer_now_us() - activity_us < idle_us))
+    {
+        /* The tick keeps running, sleep until the next interrupt */
+        __DSB();
+        __WFI();
+        __enable_irq();
+        return;
+    }
+
+    /* The clock governor may have changed SYSCLK since the last sleep */
+    const uint32_t cycles_per_tick = SystemCoreClock / configTICK_RATE_HZ;
+    const bool pll = READ_BIT(RCC->CFGR, RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL;
+
+    /* Freeze the tick and remember how far into the current tick period we are */
+    CLEAR_BIT(SysTick->CTRL, SysTick_CTRL_ENABLE_Msk);
+    const uint32_t tick_cycles = SysTick->LOAD - SysTick->VAL;
+    HAL_SuspendTick();
+
+    const uint64_t sleep_cycles = (uint64_t)idle_ticks * cycles_per_tick - tick_cycles;
+    const uint16_t sleep_counts = (uint16_t)((sleep_cycles * lsi_hz) / SystemCoreClock);
+    const uint16_t start = lptim_count();
+    timer_us_suspend();
+    lptim_set_compare((uint16_t)(start + ((sleep_counts > LPTIM_MARGIN) ? sleep_counts : LPTIM_MARGIN)));
+
+    SET_BIT(huart2.Instance->CR1, USART_CR1_UESM); // Start bit wakes the core, see ingest_start()
+    stop_count++;
+    HAL_PWREx_EnterSTOP1Mode(PWR_STOPENTRY_WFI); // STOP2 stops USART2, the received bytes would be lost
+
+    /* Running on HSI16: USART2 and its DMA already move the first bytes while the PLL locks.
+       STOP1 keeps the GPIO, SPI and DMA registers, only the clocks have to come back. */
+    const uint32_t wake_cycles = DWT->CYCCNT;
+    const bool lptim_wake = (LPTIM1->ISR & LPTIM_ISR_CMPM) != 0u; // Read first, the count is then past the compare
+    const uint16_t wake_count = lptim_count();
+    if (pll)
+    {
+        SET_BIT(RCC->CR, RCC_CR_PLLON);
+    }
+    CLEAR_BIT(huart2.Instance->CR1, USART_CR1_UESM);
+
+    /* Wake-up event to the first instruction: LPTIM1 matched its compare at a known count, one LSI period resolution */
+    const uint32_t exit_us = lptim_wake ? (uint32_t)(((uint64_t)(uint16_t)(wake_count - LPTIM1->CMP) * 1000000u) / lsi_hz)
+                                        : STOP1_EXIT_US;
+
+    /* Slept time in core cycles: the LPTIM1 counts plus the part of the tick that had already elapsed */
+    const uint16_t counts = (uint16_t)(lptim_count() - start);
+    const uint64_t elapsed = tick_cycles + ((uint64_t)counts * SystemCoreClock) / lsi_hz;
+    uint32_t ticks = (uint32_t)(elapsed / cycles_per_tick);
+    uint32_t remainder = (uint32_t)(elapsed % cycles_per_tick);
+
+    if (ticks >= idle_ticks)
+    {
+        /* Woken by LPTIM1: let the next SysTick interrupt add the last tick right away */
+        ticks = idle_ticks - 1u;
+        remainder = cycles_per_tick - 1u;
+    }
+
+    if (pll)
+    {
+        power_restore_clock();
+    }
+    const uint32_t pll_cycles = DWT->CYCCNT;
+    power_resume_us(start);
+
+    SysTick->LOAD = (remainder < cycles_per_tick - 1u) ? cycles_per_tick - remainder - 1u : 1u;
+    SysTick->VAL = 0u;
+    SET_BIT(SysTick->CTRL, SysTick_CTRL_ENABLE_Msk);
+    SysTick->LOAD = cycles_per_tick - 1u;
+
+    vTaskStepTick(ticks);
+    uwTick += ticks; // HAL tick runs at 1 kHz as well
+    HAL_ResumeTick();
+
+    wake_us = exit_us + (pll_cycles - wake_cycles) / (pll ? HSI_MHZ : SystemCoreClock / 1000000u) +
+              (DWT->CYCCNT - pll_cycles) / (SystemCoreClock / 1000000u);
+    wake_max_us = (wake_us > wake_max_us) ? wake_us : wake_max_us;
+
+    __enable_irq();
+}
+
+uint32_t power_wake_us(void)
+{
+    return wake_us;
+}
+
+uint32_t power_wake_max_us(void)
+{
+    return wake_max_us;
+}
+
+uint32_t power_lsi_hz(void)
+{
+    return lsi_hz;
+}
+
+uint32_t power_stop_count(void)
+{
+    return stop_count;
+}
+
+void power_lptim_irq(void)
+{
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+}
@@ -0,0 +1,65 @@
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/**
+ * @brief Start LSI and LPTIM1, the time base of the tickless idle, and calibrate LSI against the core clock.
+ *        Call after SystemClock_Config() and before the scheduler starts.
+ */
+void power_init(void);
+
+/**
+ * @brief Time without input before the tickless idle enters STOP, until then it only waits for interrupts
+ *
+ * @param idle_ms sleep_idle_ms of the configuration, 0 enters STOP whenever all tasks wait, UINT32_MAX never
+ */
+void power_set_idle(uint32_t idle_ms);
+
+/**
+ * @brief Input arrived, STOP waits for the idle time again. Called from the USART2 receive interrupt.
+ */
+void power_activity(void);
+
+/**
+ * @brief portSUPPRESS_TICKS_AND_SLEEP(): stop the tick and enter STOP1 until LPTIM1 reaches the next task
+ *        deadline or an interrupt (USART2 start bit) arrives, then step the RTOS and HAL ticks by the slept time.
+ *        Falls back to a plain WFI while a SPI or UART TX transfer is running.
+ *
+ * @param idle_ticks ticks until the next task unblocks
+ */
+void power_sleep(TickType_t idle_ticks);
+
+/**
+ * @brief Measured LSI frequency
+ */
+uint32_t power_lsi_hz(void);
+
+/**
+ * @brief Number of STOP entries since boot
+ */
+uint32_t power_stop_count(void);
+
+/**
+ * @brief Wake-to-ready time of the last STOP exit, from the wake-up event until the PLL runs and the ticks are
+ *        corrected. A LPTIM1 wake is measured from its compare match to one LSI period, a USART2 wake adds the
+ *        datasheet STOP1 exit time; the rest is taken with the cycle counter.
+ *
+ * @return uint32_t time in microseconds
+ */
+uint32_t power_wake_us(void);
+
+/**
+ * @brief Longest wake-to-ready time since boot in microseconds
+ */
+uint32_t power_wake_max_us(void);
+
+/**
+ * @brief LPTIM1 compare interrupt, called from LPTIM1_IRQHandler()
+ */
+void power_lptim_irq(void);
+
+#endif // !_POWER_H_
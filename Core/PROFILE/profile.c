@@ -0,0 +1,48 @@
+#include "profile.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "main.h"
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max;
+    uint64_t total;
+} PROFILE_T;
+
+static PROFILE_T points[PROFILE_POINTS];
+
+static const char* const names[PROFILE_POINTS] = {
+    [PROFILE_UART_ISR] = "uart isr",
+    [PROFILE_FRAM_ISR] = "fram isr",
+    [PROFILE_SD_BLOCK] = "sd block",
+    [PROFILE_CRC] = "crc",
+    [PROFILE_COMPRESS] = "compress",
+};
+
+__RAM_FUNC void profile_stop(PROFILE_POINT_T point, uint32_t start)
+{
+    const uint32_t cycles = DWT->CYCCNT - start;
+    const uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    PROFILE_T* profile = &points[point];
+    profile->count++;
+    profile->total += cycles;
+    profile->max = (cycles > profile->max) ? cycles : profile->max;
+    __set_PRIMASK(primask);
+}
+
+void profile_report(void)
+{
+    for (uint32_t index = 0u; index < PROFILE_POINTS; index++)
+    {
+        const PROFILE_T* profile = &points[index];
+        const uint32_t average = (profile->count != 0u) ? (uint32_t)(profile->total / profile->count) : 0u;
+
+        log_info("[profile] %s: %lu calls, %lu cycles avg, %lu max\r\n", names[index], profile->count, average, profile->max);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "main.h"
+
+/**< Byte moving paths timed with the cycle counter, compare a HOT_CODE=ram and a HOT_CODE=flash build */
+typedef enum
+{
+    PROFILE_UART_ISR = 0u, /**< USART2 and its RX/TX DMA interrupts */
+    PROFILE_FRAM_ISR,      /**< SPI1 RX/TX DMA interrupts, ends a FRAM transfer */
+    PROFILE_SD_BLOCK,      /**< 512 data bytes of one SD block write over SPI2 */
+    PROFILE_CRC,           /**< Flush checkpoint CRC */
+    PROFILE_COMPRESS,      /**< One flush chunk through compress_block() */
+    PROFILE_POINTS,
+} PROFILE_POINT_T;
+
+/**
+ * @brief Start timing a profile point
+ *
+ * @return uint32_t cycle counter, pass it to profile_stop()
+ */
+static inline uint32_t profile_start(void)
+{
+    return DWT->CYCCNT;
+}
+
+/**
+ * @brief Account the cycles since profile_start() to a profile point, safe from interrupts
+ */
+void profile_stop(PROFILE_POINT_T point, uint32_t start);
+
+/**
+ * @brief Print calls, average and worst case cycles of every profile point
+ */
+void profile_report(void);
+
+#endif // !_PROFILE_H_
@@ -1,5 +1,6 @@
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "console.h"
 #include "fatfs.h"
@@ -7,14 +8,29 @@
 #include "main.h"
 #include "sd.h"
 
-// Some variables for FatFs
-static FATFS FatFs;                   // Fatfs handle
-static FIL newFile, workingFile, fil; // File handle
+// Some variables for FatFs, the volume and the log file are the USERFatFS/USERFile objects of fatfs.c
+static FIL fil; // config.txt and other short lived files
 static char FATPATH[4];
 
 void sd_power_on(void)
 {
+    GPIO_InitTypeDef GPIO_InitStruct = { 0 };
+
     SD_PWR_ON;
+
+    /* Give back the pins released by sd_power_off() */
+    HAL_GPIO_WritePin(SD_CS_GPIO_Port, SD_CS_Pin, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin = SD_CS_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(SD_CS_GPIO_Port, &GPIO_InitStruct);
+
+    if (hspi2.State == HAL_SPI_STATE_RESET)
+    {
+        HAL_SPI_Init(&hspi2);
+    }
+    HAL_Delay(200u); // Card power up time
 }
 
 void sd_power_off(void)
@@ -39,7 +55,7 @@ bool sd_init(void)
 
     FRESULT fres;
 
-    fres = f_mount(&FatFs, (const TCHAR*)FATPATH, 1); // 1=mount now
+    fres = f_mount(&USERFatFS, (const TCHAR*)FATPATH, 1); // 1=mount now
 
     // TODO: Look for a safe way to do this
     // while (fres != FR_OK) {
@@ -64,8 +80,185 @@ bool sd_init(void)
     if (fres == FR_OK)
     {
         log_info("SD mounted\r\n");
-        ret = true;
+    }
+    else
+    {
+        log_info("f_mount error (%i)\r\n", fres);
+        ret = false;
     }
 
     return ret;
+}
+
+void sd_deinit(void)
+{
+    f_mount(NULL, (const TCHAR*)FATPATH, 0);
+}
+
+bool sd_read_file(const char* name, char* buffer, uint32_t size)
+{
+    UINT byte_read = 0u;
+    FRESULT fres = f_open(&fil, name, FA_READ | FA_OPEN_EXISTING);
+
+    if (fres == FR_OK)
+    {
+        fres = f_read(&fil, buffer, size, &byte_read);
+        f_close(&fil);
+    }
+
+    return (fres == FR_OK) && (byte_read > 0u);
+}
+
+bool sd_write_file(const char* name, const char* data, uint32_t length)
+{
+    UINT bytes_wrote = 0u;
+    FRESULT fres = f_open(&fil, name, FA_WRITE | FA_CREATE_ALWAYS);
+
+    if (fres == FR_OK)
+    {
+        fres = f_write(&fil, data, length, &bytes_wrote);
+        f_close(&fil);
+    }
+
+    return (fres == FR_OK) && (bytes_wrote == length);
+}
+
+bool sd_stat_file(const char* name, uint32_t* size, uint16_t* date, uint16_t* time)
+{
+    FILINFO info;
+
+    if (f_stat(name, &info) != FR_OK)
+    {
+        return false;
+    }
+
+    *size = info.fsize;
+    *date = info.fdate;
+    *time = info.ftime;
+
+    return true;
+}
+
+void sd_log_name(const char* prefix, uint16_t file_id, const char* extension, char* name)
+{
+    sprintf(name, "%.3s%05u.%.3s", prefix, file_id, extension);
+}
+
+bool sd_log_open(const char* prefix, uint16_t file_id, const char* extension, uint32_t offset)
+{
+    char name[13u];
+    sd_log_name(prefix, file_id, extension, name);
+
+    FRESULT fres = f_open(&USERFile, name, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+    if (fres != FR_OK)
+    {
+        log_info("f_open error (%i)\r\n", fres);
+        return false;
+    }
+
+    /* Anything past the committed offset was written after the last checkpoint, drop it */
+    if (f_size(&USERFile) > offset)
+    {
+        fres = f_lseek(&USERFile, offset);
+        if (fres == FR_OK)
+        {
+            fres = f_truncate(&USERFile);
+        }
+    }
+    else
+    {
+        fres = f_lseek(&USERFile, f_size(&USERFile));
+    }
+
+    if (fres != FR_OK)
+    {
+        log_info("f_lseek error (%i)\r\n", fres);
+        f_close(&USERFile);
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t sd_log_size(void)
+{
+    return f_size(&USERFile);
+}
+
+bool sd_log_write(const uint8_t* data, uint32_t length)
+{
+    UINT bytes_wrote = 0u;
+    FRESULT fres = f_write(&USERFile, data, length, &bytes_wrote);
+
+    if ((fres != FR_OK) || (bytes_wrote != length))
+    {
+        log_info("f_write error (%i)\r\n", fres);
+        return false;
+    }
+
+    return true;
+}
+
+bool sd_log_seek(uint32_t offset)
+{
+    return f_lseek(&USERFile, offset) == FR_OK;
+}
+
+bool sd_log_sync(void)
+{
+    return f_sync(&USERFile) == FR_OK;
+}
+
+void sd_log_close(void)
+{
+    f_close(&USERFile);
+}
+
+bool sd_index_open(const char* prefix, uint16_t file_id)
+{
+    char name[13u];
+    sd_log_name(prefix, file_id, "IDX", name);
+
+    const FRESULT fres = f_open(&fil, name, FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+    if (fres != FR_OK)
+    {
+        log_info("f_open error (%i)\r\n", fres);
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t sd_index_size(void)
+{
+    return f_size(&fil);
+}
+
+bool sd_index_read(uint32_t offset, void* data, uint32_t length)
+{
+    UINT byte_read = 0u;
+
+    return (f_lseek(&fil, offset) == FR_OK) && (f_read(&fil, data, length, &byte_read) == FR_OK) && (byte_read == length);
+}
+
+bool sd_index_write(uint32_t offset, const void* data, uint32_t length)
+{
+    UINT bytes_wrote = 0u;
+
+    return (f_lseek(&fil, offset) == FR_OK) && (f_write(&fil, data, length, &bytes_wrote) == FR_OK) && (bytes_wrote == length);
+}
+
+bool sd_index_truncate(void)
+{
+    return f_truncate(&fil) == FR_OK;
+}
+
+bool sd_index_sync(void)
+{
+    return f_sync(&fil) == FR_OK;
+}
+
+void sd_index_close(void)
+{
+    f_close(&fil);
 }
\ No newline at end of file
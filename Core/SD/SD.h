@@ -2,10 +2,131 @@
 #define _SD_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+
 #include "fatfs.h"
 
+/*!
+ *  @brief  Mount the SD card file system
+ *  @retval true if the card is mounted
+ */
 bool sd_init(void);
 
+/*!
+ *  @brief  Unmount the SD card file system
+ */
+void sd_deinit(void);
+
+/*!
+ *  @brief  Read the beginning of a file
+ *  @param  name   File name
+ *  @param  buffer Output buffer
+ *  @param  size   Maximum number of bytes to read
+ *  @retval true if at least one byte was read
+ */
+bool sd_read_file(const char* name, char* buffer, uint32_t size);
+
+/*!
+ *  @brief  Create or overwrite a file
+ *  @retval true if all bytes were written
+ */
+bool sd_write_file(const char* name, const char* data, uint32_t length);
+
+/*!
+ *  @brief  Read the directory entry of a file without opening it
+ *  @param  name File name
+ *  @param  size Output file size
+ *  @param  date Output FAT modification date
+ *  @param  time Output FAT modification time
+ *  @retval true if the file exists
+ */
+bool sd_stat_file(const char* name, uint32_t* size, uint16_t* date, uint16_t* time);
+
+/*!
+ *  @brief  Build the 8.3 name of a log file (LOGxxxxx.TXT, .LZB when compressed, .TSR for timestamped records, .BLK in blocks)
+ *  @param  prefix     "LOG" for logs, "CAP" for trigger captures
+ *  @param  file_id    Log file number
+ *  @param  extension  "TXT", "LZB", "TSR", "BLK", or "IDX" for the index of any of them
+ *  @param  name       Output buffer, at least 13 bytes
+ */
+void sd_log_name(const char* prefix, uint16_t file_id, const char* extension, char* name);
+
+/*!
+ *  @brief  Open (or create) a log file and place the write pointer at offset.
+ *          Bytes beyond offset are truncated, so an interrupted write is never kept twice.
+ *  @param  prefix     "LOG" or "CAP", see sd_log_name()
+ *  @param  file_id    Log file number
+ *  @param  extension  See sd_log_name()
+ *  @param  offset     Committed size of the file, UINT32_MAX to append at the current end
+ *  @retval true on success
+ */
+bool sd_log_open(const char* prefix, uint16_t file_id, const char* extension, uint32_t offset);
+
+/*!
+ *  @brief  Current size of the opened log file
+ */
+uint32_t sd_log_size(void);
+
+/*!
+ *  @brief  Write data at the write pointer of the opened log file, the end unless sd_log_seek() moved it
+ */
+bool sd_log_write(const uint8_t* data, uint32_t length);
+
+/*!
+ *  @brief  Move the write pointer of the opened log file, the next write goes over what is there
+ */
+bool sd_log_seek(uint32_t offset);
+
+/*!
+ *  @brief  Commit written data and the directory entry of the opened log file to the card
+ */
+bool sd_log_sync(void);
+
+/*!
+ *  @brief  Close the opened log file
+ */
+void sd_log_close(void);
+
+/*!
+ *  @brief  Open (or create) the index of a log file, LOGxxxxx.IDX next to it. It uses the file object of the short
+ *          lived files, so no other file but the log may be used until sd_index_close().
+ *  @param  prefix     "LOG" or "CAP", see sd_log_name()
+ *  @param  file_id    Log file number
+ *  @retval true on success
+ */
+bool sd_index_open(const char* prefix, uint16_t file_id);
+
+/*!
+ *  @brief  Current size of the opened index
+ */
+uint32_t sd_index_size(void);
+
+/*!
+ *  @brief  Read from the opened index at offset
+ *  @retval true if all length bytes were read
+ */
+bool sd_index_read(uint32_t offset, void* data, uint32_t length);
+
+/*!
+ *  @brief  Write to the opened index at offset, a gap in front of it holds undefined bytes
+ */
+bool sd_index_write(uint32_t offset, const void* data, uint32_t length);
+
+/*!
+ *  @brief  Cut the opened index right after the last write
+ */
+bool sd_index_truncate(void);
+
+/*!
+ *  @brief  Commit the opened index to the card
+ */
+bool sd_index_sync(void);
+
+/*!
+ *  @brief  Close the opened index
+ */
+void sd_index_close(void);
+
 /*!
  *  @brief  Turn off SD NAND chip by disable 3V3 power supply and put the GPIOs to analog mode
  *  @param  None
@@ -0,0 +1,83 @@
+#include "spi_bus.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "main.h"
+
+#define SPI_BUS_IDLE  0xffu
+#define SPI_FIFO_SIZE 4u /**< TX and RX FIFO depth in 8-bit frames */
+
+const SPI_BUS_T spi_bus_fram = { SPI1, FRAM_CS_GPIO_Port, FRAM_CS_Pin };
+const SPI_BUS_T spi_bus_sd = { SPI2, SD_CS_GPIO_Port, SD_CS_Pin };
+
+__RAM_FUNC bool spi_bus_transfer(const SPI_BUS_T* bus, const uint8_t* tx, uint8_t* rx, uint32_t length)
+{
+    SPI_TypeDef* spi = bus->instance;
+    uint32_t tx_left = length;
+    uint32_t rx_left = length;
+    uint32_t spin = 0u; /**< Polls since a frame last moved */
+
+    spi_bus_enable(bus);
+    CLEAR_BIT(spi->CR2, SPI_CR2_FRXTH); // RXNE after two frames, the last odd frame switches back
+
+    while (rx_left > 0u)
+    {
+        /* Frames in flight never exceed the RX FIFO, so it cannot overrun while we are busy elsewhere */
+        const uint32_t in_flight = rx_left - tx_left;
+        const uint32_t moved = tx_left + rx_left;
+
+        if ((tx_left > 0u) && ((spi->SR & SPI_SR_TXE) != 0u))
+        {
+            if ((tx_left >= 2u) && (in_flight + 2u <= SPI_FIFO_SIZE))
+            {
+                const uint16_t data = (tx != NULL) ? (uint16_t)(tx[0u] | (tx[1u] << 8u)) : 0xffffu;
+                SPI_BUS_DR16(spi) = data;
+                tx = (tx != NULL) ? tx + 2u : NULL;
+                tx_left -= 2u;
+            }
+            else if ((tx_left == 1u) && (in_flight + 1u <= SPI_FIFO_SIZE))
+            {
+                SPI_BUS_DR8(spi) = (tx != NULL) ? *tx : SPI_BUS_IDLE;
+                tx_left = 0u;
+            }
+        }
+
+        if (rx_left >= 2u)
+        {
+            if ((in_flight >= 2u) && ((spi->SR & SPI_SR_RXNE) != 0u))
+            {
+                const uint16_t data = SPI_BUS_DR16(spi);
+                if (rx != NULL)
+                {
+                    rx[0u] = (uint8_t)data;
+                    rx[1u] = (uint8_t)(data >> 8u);
+                    rx += 2u;
+                }
+                rx_left -= 2u;
+            }
+        }
+        else if (in_flight == 1u)
+        {
+            SET_BIT(spi->CR2, SPI_CR2_FRXTH);
+            if (!spi_bus_wait(spi, SPI_SR_RXNE))
+            {
+                return false;
+            }
+            const uint8_t data = SPI_BUS_DR8(spi);
+            if (rx != NULL)
+            {
+                *rx = data;
+            }
+            rx_left = 0u;
+        }
+
+        spin = (tx_left + rx_left != moved) ? 0u : (spin + 1u);
+        if (spin >= SPI_BUS_SPIN_MAX)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,116 @@
+#ifndef _SPI_BUS_H_
+#define _SPI_BUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "define.h"
+#include "main.h"
+
+/**< One SPI master and its chip select, configured by the CubeMX init of the HAL handle */
+typedef struct
+{
+    SPI_TypeDef* instance;
+    GPIO_TypeDef* cs_port;
+    uint32_t cs_pin;
+} SPI_BUS_T;
+
+extern const SPI_BUS_T spi_bus_fram; /**< SPI1, MB85RS2MTA */
+extern const SPI_BUS_T spi_bus_sd;   /**< SPI2, SD card */
+
+/* 8-bit frames: a byte access to DR moves one frame, a halfword access two */
+#define SPI_BUS_DR8(spi)  (*(volatile uint8_t*)&(spi)->DR)
+#define SPI_BUS_DR16(spi) (*(volatile uint16_t*)&(spi)->DR)
+
+/**
+ * @brief Poll a status flag for at most SPI_BUS_SPIN_MAX reads. An SPI that was deinitialised or lost its clock
+ *        never sets it, the caller gets false instead of hanging.
+ */
+static inline bool spi_bus_wait(SPI_TypeDef* spi, uint32_t flag)
+{
+    for (uint32_t spin = 0u; spin < SPI_BUS_SPIN_MAX; spin++)
+    {
+        if ((spi->SR & flag) != 0u)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Enable the peripheral if a HAL init or deinit left it off
+ */
+static inline void spi_bus_enable(const SPI_BUS_T* bus)
+{
+    if ((bus->instance->CR1 & SPI_CR1_SPE) == 0u)
+    {
+        SET_BIT(bus->instance->CR1, SPI_CR1_SPE);
+    }
+}
+
+/**
+ * @brief Pull chip select low. Stale bytes a previous HAL transfer left in the RX FIFO are dropped first.
+ */
+static inline void spi_bus_select(const SPI_BUS_T* bus)
+{
+    SPI_TypeDef* spi = bus->instance;
+
+    spi_bus_enable(bus);
+    while ((spi->SR & SPI_SR_FRLVL) != 0u)
+    {
+        (void)SPI_BUS_DR8(spi);
+    }
+    (void)spi->SR; // DR then SR read clears OVR
+    bus->cs_port->BSRR = bus->cs_pin << 16u;
+}
+
+/**
+ * @brief Release chip select, call when the last frame was received
+ */
+static inline void spi_bus_deselect(const SPI_BUS_T* bus)
+{
+    bus->cs_port->BSRR = bus->cs_pin;
+}
+
+/**
+ * @brief Send one byte and get the byte clocked in at the same time
+ *
+ * @param rx received byte, NULL drops it; left alone if the bus does not respond
+ * @return false if the frame did not complete
+ */
+static inline bool spi_bus_xchg(const SPI_BUS_T* bus, uint8_t data, uint8_t* rx)
+{
+    SPI_TypeDef* spi = bus->instance;
+
+    spi_bus_enable(bus);
+    SET_BIT(spi->CR2, SPI_CR2_FRXTH); // RXNE after one frame
+    SPI_BUS_DR8(spi) = data;
+    if (!spi_bus_wait(spi, SPI_SR_RXNE))
+    {
+        return false;
+    }
+
+    const uint8_t received = SPI_BUS_DR8(spi);
+    if (rx != NULL)
+    {
+        *rx = received;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Full-duplex transfer by polling, two frames per FIFO access. Meant for command, header and short
+ *        payload phases where setting up a DMA transfer costs more than the transfer itself.
+ *
+ * @param bus SPI bus, chip select is left to the caller
+ * @param tx bytes to send, NULL sends 0xff
+ * @param rx received bytes, NULL drops them
+ * @param length bytes
+ * @return false if the bus stopped moving frames for SPI_BUS_SPIN_MAX polls
+ */
+bool spi_bus_transfer(const SPI_BUS_T* bus, const uint8_t* tx, uint8_t* rx, uint32_t length);
+
+#endif // !_SPI_BUS_H_
@@ -0,0 +1,164 @@
+#include "stamp.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef STAMP_HOST
+#define __RAM_FUNC
+#else
+#include "main.h"
+#endif
+
+/* One bit per byte lane, both cores here are little endian so the lowest set lane is the first byte */
+#define SWAR_ONES     0x01010101u
+#define SWAR_HIGHS    0x80808080u
+#define SWAR_NEWLINES 0x0a0a0a0au
+
+#define US_PER_SECOND 1000000u
+
+static const char digit_pairs[201u] = "00010203040506070809"
+                                      "10111213141516171819"
+                                      "20212223242526272829"
+                                      "30313233343536373839"
+                                      "40414243444546474849"
+                                      "50515253545556575859"
+                                      "60616263646566676869"
+                                      "70717273747576777879"
+                                      "80818283848586878889"
+                                      "90919293949596979899";
+
+static STAMP_EMIT_T output;
+static char prefix[STAMP_PREFIX_MAX];
+static uint32_t prefix_length; /**< 0 until the prefix of prefix_us is formatted */
+static uint64_t prefix_us;
+static bool line_start;
+
+static char* put_pair(char* dst, uint32_t value)
+{
+    memcpy(dst, &digit_pairs[value * 2u], 2u);
+
+    return dst + 2u;
+}
+
+__RAM_FUNC uint32_t stamp_find_newline(const uint8_t* data, uint32_t length)
+{
+    uint32_t index = 0u;
+
+    /* Single bytes up to a word boundary, the word loads below are aligned */
+    for (; (index < length) && ((((uintptr_t)&data[index]) & 3u) != 0u); index++)
+    {
+        if (data[index] == '\n')
+        {
+            return index;
+        }
+    }
+
+    /* A lane of word ^ SWAR_NEWLINES is zero where the byte is '\n'. (x - ones) & ~x sets the high bit of a zero lane;
+       a borrow can only add false hits above a real one, so the lowest hit is exact. */
+    for (; index + 4u <= length; index += 4u)
+    {
+        uint32_t word;
+        memcpy(&word, &data[index], sizeof(word));
+
+        const uint32_t lanes = word ^ SWAR_NEWLINES;
+        const uint32_t hits = (lanes - SWAR_ONES) & ~lanes & SWAR_HIGHS;
+        if (hits != 0u)
+        {
+            return index + ((uint32_t)__builtin_ctz(hits) >> 3u);
+        }
+    }
+
+    for (; index < length; index++)
+    {
+        if (data[index] == '\n')
+        {
+            return index;
+        }
+    }
+
+    return length;
+}
+
+uint32_t stamp_format(char* dst, uint64_t us)
+{
+    const uint32_t seconds = (uint32_t)(us / US_PER_SECOND);
+    const uint32_t fraction = (uint32_t)(us - (uint64_t)seconds * US_PER_SECOND);
+
+    /* Seconds two digits per step from the back, divisions by constants are multiplications */
+    char digits[10u];
+    char* first = &digits[sizeof(digits)];
+    uint32_t value = seconds;
+    while (value >= 100u)
+    {
+        first -= 2;
+        put_pair(first, value % 100u);
+        value /= 100u;
+    }
+    if (value >= 10u)
+    {
+        first -= 2;
+        put_pair(first, value);
+    }
+    else
+    {
+        *--first = (char)('0' + value);
+    }
+
+    const uint32_t width = (uint32_t)(&digits[sizeof(digits)] - first);
+    char* end = dst;
+    *end++ = '[';
+    for (uint32_t pad = width; pad < STAMP_SECONDS_WIDTH; pad++)
+    {
+        *end++ = ' ';
+    }
+    memcpy(end, first, width);
+    end += width;
+    *end++ = '.';
+    end = put_pair(end, fraction / 10000u);
+    end = put_pair(end, (fraction / 100u) % 100u);
+    end = put_pair(end, fraction % 100u);
+    *end++ = ']';
+    *end++ = ' ';
+
+    return (uint32_t)(end - dst);
+}
+
+void stamp_init(STAMP_EMIT_T emit)
+{
+    output = emit;
+    prefix_length = 0u;
+    line_start = true;
+}
+
+__RAM_FUNC void stamp_time(uint64_t us)
+{
+    if (us != prefix_us)
+    {
+        prefix_us = us;
+        prefix_length = 0u;
+    }
+}
+
+__RAM_FUNC void stamp_feed(const uint8_t* data, uint32_t length)
+{
+    while (length > 0u)
+    {
+        if (line_start)
+        {
+            if (prefix_length == 0u)
+            {
+                prefix_length = stamp_format(prefix, prefix_us);
+            }
+            output((const uint8_t*)prefix, prefix_length);
+        }
+
+        const uint32_t newline = stamp_find_newline(data, length);
+        const uint32_t part = (newline < length) ? newline + 1u : length;
+
+        output(data, part);
+        line_start = newline < length;
+        data += part;
+        length -= part;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef _STAMP_H_
+#define _STAMP_H_
+
+#include <stdint.h>
+
+/**< Line timestamps (timestamps=text): every received line is stored behind "[     s.uuuuuu] ", the time since boot
+ *   of the chunk its first byte arrived in. The data itself is passed on in place, a line only costs the prefix.
+ *   Line breaks are found a word at a time and the prefix is formatted once per chunk, all lines of a chunk share it.
+ *   Plain C without the HAL, Tools/stamp_bench runs the same code on the host. */
+
+#define STAMP_PREFIX_MAX     20u /**< "[" 10 digits "." 6 digits "] " */
+#define STAMP_SECONDS_WIDTH  6u  /**< Seconds are right aligned to this width, like the kernel log */
+
+/**
+ * @brief Output of the stage, called with a prefix or with a piece of the fed data
+ */
+typedef void (*STAMP_EMIT_T)(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Set the output, the next byte fed starts a line
+ *
+ * @param emit next ingest stage
+ */
+void stamp_init(STAMP_EMIT_T emit);
+
+/**
+ * @brief Time of the lines starting in the next fed bytes
+ *
+ * @param us microseconds since boot
+ */
+void stamp_time(uint64_t us);
+
+/**
+ * @brief Pass received bytes on, with a prefix in front of every line start
+ */
+void stamp_feed(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Position of the first '\n', checking four bytes per step
+ *
+ * @return uint32_t index of the line break, length if there is none
+ */
+uint32_t stamp_find_newline(const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Format "[     s.uuuuuu] " without printf
+ *
+ * @param dst at least STAMP_PREFIX_MAX bytes, not terminated
+ * @param us microseconds since boot
+ * @return uint32_t characters written
+ */
+uint32_t stamp_format(char* dst, uint64_t us);
+
+#endif // !_STAMP_H_
@@ -54,6 +54,15 @@
 
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
+/* Checked on every context switch (configCHECK_FOR_STACK_OVERFLOW 2), the task name stays visible in the debugger */
+static const char* volatile stack_overflow_task;
+
+void vApplicationStackOverflowHook(TaskHandle_t xTask, char* pcTaskName)
+{
+    (void)xTask;
+    stack_overflow_task = pcTaskName;
+    Error_Handler();
+}
 
 /* USER CODE END Application */
 
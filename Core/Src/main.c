@@ -63,8 +63,11 @@
 
 #include "console.h"
 #include "define.h"
+#include "flush.h"
 #include "gpio_config.h"
+#include "ingest.h"
 #include "logger_app.h"
+#include "power.h"
 #include "sd.h"
 #include "spi_fram.h"
 #include "timer.h"
@@ -94,6 +97,7 @@ DMA_HandleTypeDef hdma_spi1_rx;
 DMA_HandleTypeDef hdma_spi1_tx;
 
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
 DMA_HandleTypeDef hdma_usart2_tx;
 
 /* Definitions for defaultTask */
@@ -733,26 +737,34 @@ static void log_buffer(void)
 int main(void)
 {
     /* MCU Configuration--------------------------------------------------------*/
+    ingest_boot_prepare();
 
     /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
     HAL_Init();
 
+    /* Only what the capture needs runs at the MSI boot clock, USART2 is clocked from HSI16 */
+    MX_GPIO_Init();
+    MX_DMA_Init();
+    MX_SPI1_Init();
+    MX_USART2_UART_Init();
+    MX_CRC_Init();
+    flush_restore();
+    ingest_boot();
+
     /* Configure the system clock */
     SystemClock_Config();
+    timer_us_clock_changed();
 
     /* Initialize all configured peripherals */
-    MX_GPIO_Init();
-    MX_DMA_Init();
-    MX_SPI1_Init();
     MX_SPI2_Init();
-    MX_USART2_UART_Init();
     MX_FATFS_Init();
-    MX_CRC_Init();
+    power_init();
 
     /* Init scheduler and Banner */
     log_info(" ---- SD Logger by PL v%d.%d ---- \r\n", VERSION_MAJOR, VERSION_MINOR);
     osKernelInitialize();
-    fram_task_entry();
+    fram_os_init();
+    ingest_task_entry();
     console_task_entry();
     logger_app_task_entry();
 
@@ -976,6 +988,9 @@ static void MX_DMA_Init(void)
     /* DMA1_Channel3_IRQn interrupt configuration */
     HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 5, 0);
     HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+    /* DMA1_Channel6_IRQn interrupt configuration */
+    HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
     /* DMA1_Channel7_IRQn interrupt configuration */
     HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 5, 0);
     HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
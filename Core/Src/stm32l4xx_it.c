@@ -22,6 +22,10 @@
 #include "stm32l4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "ingest.h"
+#include "power.h"
+#include "profile.h"
+#include "timer.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -60,6 +64,7 @@ extern DMA_HandleTypeDef hdma_spi1_rx;
 extern DMA_HandleTypeDef hdma_spi1_tx;
 extern SPI_HandleTypeDef hspi1;
 extern SPI_HandleTypeDef hspi2;
+extern DMA_HandleTypeDef hdma_usart2_rx;
 extern DMA_HandleTypeDef hdma_usart2_tx;
 extern UART_HandleTypeDef huart2;
 extern TIM_HandleTypeDef htim1;
@@ -172,11 +177,11 @@ void DebugMon_Handler(void)
 void DMA1_Channel2_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel2_IRQn 0 */
-
+  const uint32_t cycles = profile_start();
   /* USER CODE END DMA1_Channel2_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi1_rx);
   /* USER CODE BEGIN DMA1_Channel2_IRQn 1 */
-
+  profile_stop(PROFILE_FRAM_ISR, cycles);
   /* USER CODE END DMA1_Channel2_IRQn 1 */
 }
 
@@ -186,25 +191,40 @@ void DMA1_Channel2_IRQHandler(void)
 void DMA1_Channel3_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel3_IRQn 0 */
-
+  const uint32_t cycles = profile_start();
   /* USER CODE END DMA1_Channel3_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi1_tx);
   /* USER CODE BEGIN DMA1_Channel3_IRQn 1 */
-
+  profile_stop(PROFILE_FRAM_ISR, cycles);
   /* USER CODE END DMA1_Channel3_IRQn 1 */
 }
 
+/**
+  * @brief This function handles DMA1 channel6 global interrupt.
+  */
+void DMA1_Channel6_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Channel6_IRQn 0 */
+  ingest_irq_entry(timer_us()); // First: the half/full transfer event time carries no handler jitter
+  const uint32_t cycles = profile_start();
+  /* USER CODE END DMA1_Channel6_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_usart2_rx);
+  /* USER CODE BEGIN DMA1_Channel6_IRQn 1 */
+  profile_stop(PROFILE_UART_ISR, cycles);
+  /* USER CODE END DMA1_Channel6_IRQn 1 */
+}
+
 /**
   * @brief This function handles DMA1 channel7 global interrupt.
   */
 void DMA1_Channel7_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel7_IRQn 0 */
-
+  const uint32_t cycles = profile_start();
   /* USER CODE END DMA1_Channel7_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart2_tx);
   /* USER CODE BEGIN DMA1_Channel7_IRQn 1 */
-
+  profile_stop(PROFILE_UART_ISR, cycles);
   /* USER CODE END DMA1_Channel7_IRQn 1 */
 }
 
@@ -256,14 +276,25 @@ void SPI2_IRQHandler(void)
 void USART2_IRQHandler(void)
 {
   /* USER CODE BEGIN USART2_IRQn 0 */
-
+  ingest_irq_entry(timer_us()); // First: the idle line event time carries no handler jitter
+  const uint32_t cycles = profile_start();
   /* USER CODE END USART2_IRQn 0 */
   HAL_UART_IRQHandler(&huart2);
   /* USER CODE BEGIN USART2_IRQn 1 */
-
+  profile_stop(PROFILE_UART_ISR, cycles);
   /* USER CODE END USART2_IRQn 1 */
 }
 
+/**
+  * @brief This function handles LPTIM1 global interrupt.
+  */
+void LPTIM1_IRQHandler(void)
+{
+  /* USER CODE BEGIN LPTIM1_IRQn 0 */
+  power_lptim_irq();
+  /* USER CODE END LPTIM1_IRQn 0 */
+}
+
 /**
   * @brief This function handles USB event interrupt through EXTI line 17.
   */
@@ -279,5 +310,12 @@ void USB_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles TIM2 global interrupt, the wraps of the microsecond counter.
+  */
+void TIM2_IRQHandler(void)
+{
+  timer_us_irq();
+}
 
 /* USER CODE END 1 */
@@ -1,16 +1,134 @@
 #include "timer.h"
-#include "FreeRTOS.h"
-#include "FreeRTOSConfig.h"
-#include "cmsis_os.h"
 
-uint32_t timer_get_elapsed_time(const uint32_t timer)
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIMER_US_HZ 1000000u
+
+static volatile uint32_t us_wraps;
+
+/* Both APB dividers stay at 1 (Core/CLOCK), TIM2 runs on PCLK1 */
+static uint32_t timer_us_prescaler(void)
 {
-    const TickType_t current_timestamp = xTaskGetTickCount();
+    return (HAL_RCC_GetPCLK1Freq() / TIMER_US_HZ) - 1u;
+}
 
-    return timer >= 0u ? current_timestamp - timer : 0u;
+uint32_t timer_get_elapsed_time(const uint32_t timer)
+{
+    return timer_now_ms() - timer; // Modulo 2^32 ms, right across the wrap
 }
 
 void timer_reset(uint32_t* timestamp)
 {
-    *timestamp = xTaskGetTickCount();
+    *timestamp = timer_now_ms();
+}
+
+void timer_us_init(void)
+{
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    TIM2->CR1 = TIM_CR1_URS; // Only the overflow raises the update interrupt, not the UG of a prescaler reload
+    TIM2->ARR = UINT32_MAX;
+    TIM2->PSC = timer_us_prescaler();
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->SR = 0u;
+    TIM2->DIER = TIM_DIER_UIE;
+    TIM2->CR1 |= TIM_CR1_CEN;
+
+    HAL_NVIC_SetPriority(TIM2_IRQn, 15, 0);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+void timer_us_clock_changed(void)
+{
+    /* The prescaler is buffered until the next update, force one and put the count back */
+    __disable_irq();
+    const uint32_t count = TIM2->CNT;
+    TIM2->PSC = timer_us_prescaler();
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->CNT = count;
+    __enable_irq();
+}
+
+void timer_us_suspend(void)
+{
+    TIM2->CR1 &= ~TIM_CR1_CEN;
+}
+
+void timer_us_resume(uint32_t us)
+{
+    const uint32_t count = TIM2->CNT;
+    TIM2->CNT = count + us;
+    if (count + us < count)
+    {
+        us_wraps++; // A software write raises no update interrupt
+    }
+    TIM2->CR1 |= TIM_CR1_CEN;
+}
+
+void timer_us_irq(void)
+{
+    TIM2->SR = ~(uint32_t)TIM_SR_UIF;
+    us_wraps++;
+}
+
+uint32_t timer_us_epoch(uint32_t stamp)
+{
+    const uint64_t now = timer_now_us();
+    const uint32_t wraps = (uint32_t)(now >> 32u);
+
+    /* The counter wrapped between the stamp and now */
+    return ((uint32_t)now < stamp) ? wraps - 1u : wraps;
+}
+
+uint64_t timer_now_us(void)
+{
+    const uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    uint32_t wraps = us_wraps;
+    uint32_t count = TIM2->CNT;
+    if ((TIM2->SR & TIM_SR_UIF) != 0u)
+    {
+        /* Wrapped, but the interrupt is masked or not served yet: the count may be from either side of the wrap */
+        wraps++;
+        count = TIM2->CNT;
+    }
+    __set_PRIMASK(primask);
+
+    return ((uint64_t)wraps << 32u) | count;
+}
+
+uint32_t timer_now_ms(void)
+{
+    return (uint32_t)(timer_now_us() / 1000u);
+}
+
+uint64_t timer_deadline_ms(uint32_t timeout_ms)
+{
+    return timer_now_us() + (uint64_t)timeout_ms * 1000u;
+}
+
+bool timer_expired(uint64_t deadline)
+{
+    return timer_now_us() >= deadline;
+}
+
+uint32_t timer_remaining_ms(uint64_t deadline)
+{
+    if (deadline == TIMER_NEVER)
+    {
+        return UINT32_MAX;
+    }
+
+    const uint64_t now = timer_now_us();
+    if (now >= deadline)
+    {
+        return 0u;
+    }
+
+    /* Rounded up, a wait for the result never wakes before the deadline */
+    const uint64_t remaining = (deadline - now + 999u) / 1000u;
+
+    return (remaining < UINT32_MAX) ? (uint32_t)remaining : UINT32_MAX - 1u;
 }
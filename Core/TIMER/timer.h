@@ -1,10 +1,18 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "main.h"
+
+/**< TIM2 counts microseconds since boot. It is not clocked in STOP, power_sleep() stops it and adds the time measured
+ *   with LPTIM1 on wake, so with the wrap count it is one monotonic 64-bit clock across STOP1/2 and clock switches. */
+
+#define TIMER_NEVER UINT64_MAX /**< Deadline that never expires */
+
 /**
- * @brief Get elapses (delta ms) time from xTaskGetTickCount
+ * @brief Get elapsed time (delta ms) since a timer_reset() timestamp, keeps counting through STOP
  *
  * @param timer timer from a module
  * @return uint32_t elapsed time
@@ -12,10 +20,81 @@
 uint32_t timer_get_elapsed_time(const uint32_t timer);
 
 /**
- * @brief Reset timer (Update to current timestamp based on systick)
+ * @brief Reset timer (Update to the current ms of the microsecond clock)
  *
  * @param timestamp timestamp of module
  */
 void timer_reset(uint32_t* timestamp);
 
+/**
+ * @brief Microseconds since boot, safe from tasks and interrupts
+ */
+uint64_t timer_now_us(void);
+
+/**
+ * @brief Milliseconds since boot, modulo 2^32
+ */
+uint32_t timer_now_ms(void);
+
+/**
+ * @brief Deadline timeout_ms from now, for timer_expired() and timer_remaining_ms()
+ */
+uint64_t timer_deadline_ms(uint32_t timeout_ms);
+
+/**
+ * @brief true once timer_now_us() reached the deadline, never for TIMER_NEVER
+ */
+bool timer_expired(uint64_t deadline);
+
+/**
+ * @brief Time left until a deadline, rounded up
+ *
+ * @return uint32_t ms, 0 if expired, UINT32_MAX for TIMER_NEVER
+ */
+uint32_t timer_remaining_ms(uint64_t deadline);
+
+/**
+ * @brief Start TIM2 as a free-running 32-bit microsecond counter. Called from ingest_boot_prepare() at the MSI boot
+ *        clock, before the capture is armed.
+ */
+void timer_us_init(void);
+
+/**
+ * @brief Reload the TIM2 prescaler after a system clock change, the count continues
+ */
+void timer_us_clock_changed(void);
+
+/**
+ * @brief Stop the count before STOP, the clocks are not trusted until timer_us_resume()
+ */
+void timer_us_suspend(void);
+
+/**
+ * @brief Add the time since timer_us_suspend(), measured with LPTIM1, and count on
+ *
+ * @param us microseconds the count was stopped
+ */
+void timer_us_resume(uint32_t us);
+
+/**
+ * @brief TIM2 update interrupt, counts the 2^32 us wraps
+ */
+void timer_us_irq(void);
+
+/**
+ * @brief Wraps of the counter before a stamp taken shortly before this call
+ *
+ * @param stamp timer_us() value
+ * @return uint32_t wrap count
+ */
+uint32_t timer_us_epoch(uint32_t stamp);
+
+/**
+ * @brief Microsecond count, one register load: take it as the first statement of an ISR
+ */
+static inline uint32_t timer_us(void)
+{
+    return TIM2->CNT;
+}
+
 #endif // !_TIMER_H_
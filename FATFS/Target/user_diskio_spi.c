@@ -26,6 +26,8 @@
 
 #include "stm32l4xx_hal.h" /* Provide the low-level HAL functions */
 #include "user_diskio_spi.h"
+#include "profile.h"
+#include "spi_bus.h"
 
 //Make sure you set #define SD_SPI_HANDLE as some hspix in main.h
 //Make sure you set #define SD_CS_GPIO_Port as some GPIO port in main.h
@@ -38,8 +40,8 @@ extern SPI_HandleTypeDef SD_SPI_HANDLE;
 #define FCLK_SLOW() { MODIFY_REG(SD_SPI_HANDLE.Instance->CR1, SPI_BAUDRATEPRESCALER_256, SPI_BAUDRATEPRESCALER_8); }	/* Set SCLK = slow, approx 280 KBits/s*/
 #define FCLK_FAST() { MODIFY_REG(SD_SPI_HANDLE.Instance->CR1, SPI_BAUDRATEPRESCALER_256, SPI_BAUDRATEPRESCALER_4); }	/* Set SCLK = fast, approx 4.5 MBits/s */
 
-#define CS_HIGH()	{HAL_GPIO_WritePin(SD_CS_GPIO_Port, SD_CS_Pin, GPIO_PIN_SET);}
-#define CS_LOW()	{HAL_GPIO_WritePin(SD_CS_GPIO_Port, SD_CS_Pin, GPIO_PIN_RESET);}
+#define CS_HIGH()	{spi_bus_deselect(&spi_bus_sd);}
+#define CS_LOW()	{spi_bus_select(&spi_bus_sd);}
 
 /*--------------------------------------------------------------------------
 
@@ -91,7 +93,7 @@ void SPI_Timer_On(uint32_t waitTicks) {
     spiTimerTickDelay = waitTicks;
 }
 
-uint8_t SPI_Timer_Status() {
+__RAM_FUNC uint8_t SPI_Timer_Status() {
     return ((HAL_GetTick() - spiTimerTickStart) < spiTimerTickDelay);
 }
 
@@ -99,42 +101,38 @@ uint8_t SPI_Timer_Status() {
 /* SPI controls (Platform dependent)                                     */
 /*-----------------------------------------------------------------------*/
 
-/* Exchange a byte */
-static
+/* Exchange a byte, a dead bus reads as an idle card (0xFF) so every wait ends in its timeout */
+static __RAM_FUNC
 BYTE xchg_spi (
 	BYTE dat	/* Data to send */
 )
 {
-	BYTE rxDat;
-    HAL_SPI_TransmitReceive(&SD_SPI_HANDLE, &dat, &rxDat, 1, 50);
-    return rxDat;
+	BYTE rxDat = 0xFF;
+	spi_bus_xchg(&spi_bus_sd, dat, &rxDat);
+	return rxDat;
 }
 
 
 /* Receive multiple byte */
-static
-void rcvr_spi_multi (
+static __RAM_FUNC
+int rcvr_spi_multi (	/* 1:OK, 0:Bus error */
 	BYTE *buff,		/* Pointer to data buffer */
 	UINT btr		/* Number of bytes to receive (even number) */
 )
 {
-	for(UINT i=0; i<btr; i++) {
-		*(buff+i) = xchg_spi(0xFF);
-	}
+	return spi_bus_transfer(&spi_bus_sd, NULL, buff, btr) ? 1 : 0;	/* 0xFF is sent while receiving */
 }
 
 
 #if _USE_WRITE
 /* Send multiple byte */
-static
-void xmit_spi_multi (
+static __RAM_FUNC
+int xmit_spi_multi (	/* 1:OK, 0:Bus error */
 	const BYTE *buff,	/* Pointer to the data */
 	UINT btx			/* Number of bytes to send (even number) */
 )
 {
-	for(UINT i=0; i<btx; i++) {
-		xchg_spi(*(buff+i));
-	}
+	return spi_bus_transfer(&spi_bus_sd, buff, NULL, btx) ? 1 : 0;
 }
 #endif
 
@@ -143,7 +141,7 @@ void xmit_spi_multi (
 /* Wait for card ready                                                   */
 /*-----------------------------------------------------------------------*/
 
-static
+static __RAM_FUNC
 int wait_ready (	/* 1:Ready, 0:Timeout */
 	UINT wt			/* Timeout [ms] */
 )
@@ -201,7 +199,7 @@ int spiselect (void)	/* 1:OK, 0:Timeout */
 /* Receive a data packet from the MMC                                    */
 /*-----------------------------------------------------------------------*/
 
-static
+static __RAM_FUNC
 int rcvr_datablock (	/* 1:OK, 0:Error */
 	BYTE *buff,			/* Data buffer */
 	UINT btr			/* Data block length (byte) */
@@ -217,7 +215,7 @@ int rcvr_datablock (	/* 1:OK, 0:Error */
 	} while ((token == 0xFF) && SPI_Timer_Status());
 	if(token != 0xFE) return 0;		/* Function fails if invalid DataStart token or timeout */
 
-	rcvr_spi_multi(buff, btr);		/* Store trailing data to the buffer */
+	if (!rcvr_spi_multi(buff, btr)) return 0;	/* Store trailing data to the buffer */
 	xchg_spi(0xFF); xchg_spi(0xFF);			/* Discard CRC */
 
 	return 1;						/* Function succeeded */
@@ -230,7 +228,7 @@ int rcvr_datablock (	/* 1:OK, 0:Error */
 /*-----------------------------------------------------------------------*/
 
 #if _USE_WRITE
-static
+static __RAM_FUNC
 int xmit_datablock (	/* 1:OK, 0:Failed */
 	const BYTE *buff,	/* Ponter to 512 byte data to be sent */
 	BYTE token			/* Token */
@@ -243,7 +241,10 @@ int xmit_datablock (	/* 1:OK, 0:Failed */
 
 	xchg_spi(token);					/* Send token */
 	if (token != 0xFD) {				/* Send data if token is other than StopTran */
-		xmit_spi_multi(buff, 512);		/* Data */
+		const uint32_t cycles = profile_start();
+		const int sent = xmit_spi_multi(buff, 512);	/* Data */
+		profile_stop(PROFILE_SD_BLOCK, cycles);
+		if (!sent) return 0;
 		xchg_spi(0xFF); xchg_spi(0xFF);	/* Dummy CRC */
 
 		resp = xchg_spi(0xFF);				/* Receive data resp */
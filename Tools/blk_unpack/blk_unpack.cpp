@@ -0,0 +1,212 @@
+/**
+ * @brief Host unpacker for block container logs (container=blocks, LOGxxxxx.BLK / CAPxxxxx.BLK)
+ *
+ * Usage: blk_unpack [-l] [-o <offset>] [-n <bytes>] [log, default stdin]
+ *
+ * Block layout (Core/FLUSH/flush_block.h, little endian): 512-byte blocks of a 24-byte header (sync a5 5a 4c 4b,
+ * sequence, first_us, payload length, content, crc) and the zero padded payload. The payloads are written to stdout in
+ * file order, which gives back the TXT, LZB or TSR content; feed it to lz_expand or ts_decode as usual.
+ * A block is only accepted when its CRC-32 matches. After a bad block the unpacker looks for the next sync word on a
+ * 4-byte boundary, so a damaged or truncated card loses only the blocks it hit; gaps are reported on stderr.
+ * -o and -n start at any byte of the file and stop after that many bytes, e.g. to split a large file between workers:
+ * each range resyncs on its own and takes the blocks that start inside it. -l lists the blocks instead.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "flush_block.h"
+
+namespace
+{
+constexpr size_t BLOCK_HEADER = sizeof(FLUSH_BLOCK_T);
+constexpr size_t CRC_OFFSET = offsetof(FLUSH_BLOCK_T, crc);
+
+uint16_t get16(const uint8_t* src)
+{
+    return static_cast<uint16_t>(src[0] | (src[1] << 8u));
+}
+
+uint32_t get32(const uint8_t* src)
+{
+    return static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8u) | (static_cast<uint32_t>(src[2]) << 16u) |
+           (static_cast<uint32_t>(src[3]) << 24u);
+}
+
+uint64_t get64(const uint8_t* src)
+{
+    return static_cast<uint64_t>(get32(src)) | (static_cast<uint64_t>(get32(src + 4)) << 32u);
+}
+
+bool read_file(const char* path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/* Standard CRC-32 (zlib), the target computes it with the CRC unit */
+class Crc32
+{
+public:
+    Crc32()
+    {
+        for (uint32_t index = 0u; index < table_.size(); index++)
+        {
+            uint32_t value = index;
+            for (unsigned bit = 0u; bit < 8u; bit++)
+            {
+                value = (value & 1u) ? ((value >> 1u) ^ 0xedb88320u) : (value >> 1u);
+            }
+            table_[index] = value;
+        }
+    }
+
+    uint32_t update(uint32_t crc, const uint8_t* data, size_t length) const
+    {
+        for (size_t index = 0u; index < length; index++)
+        {
+            crc = table_[(crc ^ data[index]) & 0xffu] ^ (crc >> 8u);
+        }
+        return crc;
+    }
+
+private:
+    std::array<uint32_t, 256> table_;
+};
+
+bool valid_block(const Crc32& crc32, const std::vector<uint8_t>& data, size_t pos)
+{
+    if ((pos + FLUSH_BLOCK_SIZE > data.size()) || (get32(&data[pos]) != FLUSH_BLOCK_SYNC) ||
+        (get16(&data[pos + offsetof(FLUSH_BLOCK_T, length)]) > FLUSH_BLOCK_PAYLOAD))
+    {
+        return false;
+    }
+    const uint8_t* block = &data[pos];
+    uint32_t crc = crc32.update(UINT32_MAX, block, CRC_OFFSET);
+    crc = crc32.update(crc, block + BLOCK_HEADER, FLUSH_BLOCK_PAYLOAD);
+    return ~crc == get32(&block[CRC_OFFSET]);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool list = false;
+    size_t offset = 0u;
+    size_t count = SIZE_MAX;
+    const char* path = nullptr;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if ((std::strcmp(argv[index], "-o") == 0) && (index + 1 < argc))
+        {
+            offset = std::strtoull(argv[++index], nullptr, 0);
+        }
+        else if ((std::strcmp(argv[index], "-n") == 0) && (index + 1 < argc))
+        {
+            count = std::strtoull(argv[++index], nullptr, 0);
+        }
+        else if (std::strcmp(argv[index], "-l") == 0)
+        {
+            list = true;
+        }
+        else if ((argv[index][0] != '-') && (path == nullptr))
+        {
+            path = argv[index];
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [-l] [-o <offset>] [-n <bytes>] [LOGxxxxx.BLK, default stdin]\n";
+            return 2;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    if (path != nullptr)
+    {
+        if (!read_file(path, data))
+        {
+            std::cerr << "cannot read " << path << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+
+    const Crc32 crc32;
+    const size_t end = (count < data.size() - std::min(offset, data.size()) ? offset + count : data.size());
+    size_t pos = (offset + 3u) & ~static_cast<size_t>(3u);
+    size_t blocks = 0u;
+    size_t damaged = 0u;
+    size_t gap_start = SIZE_MAX;
+    uint32_t next_sequence = 0u;
+    bool started = false;
+
+    while (pos < end)
+    {
+        if (!valid_block(crc32, data, pos))
+        {
+            if (gap_start == SIZE_MAX)
+            {
+                gap_start = pos;
+            }
+            pos += sizeof(uint32_t);
+            continue;
+        }
+
+        const uint8_t* block = &data[pos];
+        const uint32_t sequence = get32(&block[offsetof(FLUSH_BLOCK_T, sequence)]);
+        const size_t length = get16(&block[offsetof(FLUSH_BLOCK_T, length)]);
+        if (gap_start != SIZE_MAX)
+        {
+            /* Bytes before the first block of a range belong to the previous range, not a gap */
+            if (started || (offset == 0u))
+            {
+                std::cerr << "bad data at " << gap_start << ".." << pos << "\n";
+                damaged++;
+            }
+            gap_start = SIZE_MAX;
+        }
+        if (started && (sequence != next_sequence))
+        {
+            std::cerr << "block " << sequence << " at " << pos << " follows block " << next_sequence - 1u << "\n";
+        }
+
+        if (list)
+        {
+            std::printf("%zu,%" PRIu32 ",%" PRIu64 ",%zu,%u\n", pos, sequence, get64(&block[offsetof(FLUSH_BLOCK_T, first_us)]), length,
+                        block[offsetof(FLUSH_BLOCK_T, content)]);
+        }
+        else
+        {
+            std::fwrite(block + BLOCK_HEADER, 1u, length, stdout);
+        }
+        next_sequence = sequence + 1u;
+        started = true;
+        blocks++;
+        pos += FLUSH_BLOCK_SIZE;
+    }
+    if ((gap_start != SIZE_MAX) && (gap_start < data.size()))
+    {
+        std::cerr << "bad data at " << gap_start << ".." << std::min(end, data.size()) << "\n";
+        damaged++;
+    }
+
+    std::cerr << blocks << " blocks, " << damaged << " damaged areas\n";
+    return (damaged > 0u) ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+/**
+ * @brief Host decoder for the binary console (CONSOLE_BINARY)
+ *
+ * Usage: log_decode <SD_Logger_Test.fmt> [capture.bin]
+ *
+ * The format table is the .log_fmt section dumped by the build, a record references a format by its offset.
+ * Record layout (little endian): 0xa5, argument count, format id (16 bit), HAL tick in ms (32 bit), arguments (32 bit each),
+ * then the bytes of the %s arguments, whose arguments are their lengths. The table starts with a pad byte, id 0 is unused.
+ * Bytes that do not start a valid record are skipped, so a capture can start anywhere.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+constexpr uint8_t RECORD_SYNC = 0xa5u;
+constexpr size_t RECORD_HEADER = 8u;
+constexpr size_t RECORD_ARGS_MAX = 4u;
+
+uint32_t get32(const uint8_t* src)
+{
+    return static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8u) | (static_cast<uint32_t>(src[2]) << 16u) |
+           (static_cast<uint32_t>(src[3]) << 24u);
+}
+
+bool read_file(const char* path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+class FormatTable
+{
+  public:
+    explicit FormatTable(std::vector<uint8_t> table) : table_(std::move(table))
+    {
+    }
+
+    /* A format id is valid if it starts a string inside the table, 0 is the pad byte */
+    const char* lookup(uint16_t id) const
+    {
+        if ((id == 0u) || (id >= table_.size()) || (table_[id - 1u] != 0u) || (table_[id] == 0u))
+        {
+            return nullptr;
+        }
+        if (std::memchr(&table_[id], 0, table_.size() - id) == nullptr)
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<const char*>(&table_[id]);
+    }
+
+  private:
+    std::vector<uint8_t> table_;
+};
+
+/* Conversion letter of every argument, as console_conversions() on the target: a '*' takes an int of its own */
+std::string conversions(const char* fmt)
+{
+    std::string letters;
+    for (fmt = std::strchr(fmt, '%'); fmt != nullptr; fmt = std::strchr(fmt, '%'))
+    {
+        fmt++;
+        if (*fmt == '%')
+        {
+            fmt++;
+            continue;
+        }
+        for (; (*fmt != '\0') && (std::strchr("-+ #0123456789.*hlzjt", *fmt) != nullptr); fmt++)
+        {
+            letters += (*fmt == '*') ? "d" : "";
+        }
+        if (*fmt == '\0')
+        {
+            break;
+        }
+        letters += *fmt++;
+    }
+    return letters;
+}
+
+/* printf with 32-bit target arguments, each conversion is rendered on its own */
+std::string render(const char* fmt, const uint32_t* args, const std::string* strings, size_t count)
+{
+    std::string out;
+    size_t arg = 0u;
+
+    while (*fmt != '\0')
+    {
+        if (*fmt != '%')
+        {
+            if (*fmt != '\r')
+            {
+                out += *fmt;
+            }
+            fmt++;
+            continue;
+        }
+        if (fmt[1] == '%')
+        {
+            out += '%';
+            fmt += 2;
+            continue;
+        }
+
+        /* %[flags][width][.precision][length]conversion, length modifiers are dropped: every argument is 32 bit */
+        std::string spec = "%";
+        fmt++;
+        while ((*fmt != '\0') && (std::strchr("-+ #0123456789.", *fmt) != nullptr))
+        {
+            spec += *fmt++;
+        }
+        while ((*fmt != '\0') && (std::strchr("hlzjt", *fmt) != nullptr))
+        {
+            fmt++;
+        }
+        const char conversion = (*fmt != '\0') ? *fmt++ : 'x';
+        const uint32_t value = (arg < count) ? args[arg] : 0u;
+        const std::string text = (arg < count) ? strings[arg] : std::string();
+        arg++;
+
+        char buffer[64];
+        switch (conversion)
+        {
+            case 'd':
+            case 'i':
+                std::snprintf(buffer, sizeof(buffer), (spec + "d").c_str(), static_cast<int32_t>(value));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                std::snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), value);
+                break;
+            case 's':
+                std::snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), text.c_str());
+                break;
+            default:
+                std::snprintf(buffer, sizeof(buffer), "0x%08x", value);
+                break;
+        }
+        out += buffer;
+    }
+
+    return out;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if ((argc < 2) || (argc > 3))
+    {
+        std::cerr << "usage: " << argv[0] << " <format table .fmt> [capture, default stdin]\n";
+        return 2;
+    }
+
+    std::vector<uint8_t> table;
+    if (!read_file(argv[1], table) || table.empty())
+    {
+        std::cerr << "cannot read format table " << argv[1] << " (built with CONSOLE_BINARY?)\n";
+        return 1;
+    }
+    const FormatTable formats(std::move(table));
+
+    std::vector<uint8_t> data;
+    if (argc == 3)
+    {
+        if (!read_file(argv[2], data))
+        {
+            std::cerr << "cannot read " << argv[2] << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+
+    size_t pos = 0u;
+    size_t skipped = 0u;
+    while (pos + RECORD_HEADER <= data.size())
+    {
+        const uint8_t* record = &data[pos];
+        const size_t count = record[1];
+        const uint16_t id = static_cast<uint16_t>(record[2] | (record[3] << 8u));
+        const char* fmt = (record[0] == RECORD_SYNC) && (count <= RECORD_ARGS_MAX) ? formats.lookup(id) : nullptr;
+        const std::string letters = (fmt != nullptr) ? conversions(fmt) : std::string();
+        size_t length = RECORD_HEADER + count * 4u;
+
+        if ((fmt == nullptr) || (pos + length > data.size()) || (std::min(letters.size(), RECORD_ARGS_MAX) != count))
+        {
+            pos++;
+            skipped++;
+            continue;
+        }
+
+        uint32_t args[RECORD_ARGS_MAX] = {};
+        std::string strings[RECORD_ARGS_MAX];
+        bool complete = true;
+        for (size_t index = 0u; (index < count) && complete; index++)
+        {
+            args[index] = get32(&record[RECORD_HEADER + index * 4u]);
+            if (letters[index] != 's')
+            {
+                continue;
+            }
+            complete = args[index] <= data.size() - pos - length;
+            if (complete)
+            {
+                strings[index].assign(reinterpret_cast<const char*>(&record[length]), args[index]);
+                length += args[index];
+            }
+        }
+        if (!complete)
+        {
+            pos++;
+            skipped++;
+            continue;
+        }
+
+        const uint32_t tick = get32(&record[4]);
+        std::printf("[%7u.%03u] %s", tick / 1000u, tick % 1000u, render(fmt, args, strings, count).c_str());
+        pos += length;
+    }
+
+    if (skipped != 0u)
+    {
+        std::fprintf(stderr, "%zu bytes skipped\n", skipped);
+    }
+
+    return 0;
+}
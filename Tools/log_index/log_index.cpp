@@ -0,0 +1,309 @@
+/**
+ * @brief Host reader for the time index of the logs (LOGxxxxx.IDX, Core/FLUSH/flush_index.h)
+ *
+ * Usage: log_index [-s <unix seconds at boot>] <LOGxxxxx.IDX>...            list the logs from their summaries
+ *        log_index [-s <unix seconds at boot>] -t <from>[,<to>] [-x] <LOGxxxxx.IDX>
+ *
+ * The list needs only the index files: size, lines, first and last arrival time and dropped bytes of every log.
+ * -t looks up the byte range of the log that arrived between from and to, given in seconds since boot, or as unix
+ * seconds with -s. It prints the range, -x writes those bytes of the log next to the index to stdout instead. Text is
+ * cut at whole lines; frames, records and blocks start at a piece boundary or resync there (lz_expand, ts_decode,
+ * blk_unpack). Times are the logger's microsecond clock, which restarts at every boot.
+ */
+
+#include <cctype>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <strings.h>
+#include <vector>
+
+#include "define.h"
+#include "flush_index.h"
+
+namespace
+{
+constexpr uint32_t PIECE_MAX = 0x10000u; /**< An entry's piece starts at most this far before its offset */
+const char* const LOG_EXTENSIONS[] = { "TXT", "LZB", "TSR", "BLK" };
+
+uint32_t get32(const uint8_t* src)
+{
+    return static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8u) | (static_cast<uint32_t>(src[2]) << 16u) |
+           (static_cast<uint32_t>(src[3]) << 24u);
+}
+
+bool read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+uint32_t crc32(const uint8_t* data, size_t length)
+{
+    uint32_t crc = UINT32_MAX;
+    for (size_t index = 0u; index < length; index++)
+    {
+        crc ^= data[index];
+        for (unsigned bit = 0u; bit < 8u; bit++)
+        {
+            crc = (crc & 1u) ? ((crc >> 1u) ^ 0xedb88320u) : (crc >> 1u);
+        }
+    }
+    return ~crc;
+}
+
+class Index
+{
+public:
+    bool load(const std::string& path)
+    {
+        std::vector<uint8_t> data;
+        if (!read_file(path, data))
+        {
+            return false;
+        }
+
+        valid_ = (data.size() >= sizeof(summary_)) &&
+                 (get32(&data[data.size() - sizeof(summary_)]) == FLUSH_INDEX_MAGIC) &&
+                 (crc32(&data[data.size() - sizeof(summary_)], offsetof(FLUSH_INDEX_SUMMARY_T, crc)) ==
+                  get32(&data[data.size() - sizeof(summary_) + offsetof(FLUSH_INDEX_SUMMARY_T, crc)]));
+        if (valid_)
+        {
+            std::memcpy(&summary_, &data[data.size() - sizeof(summary_)], sizeof(summary_));
+        }
+
+        /* Without a summary (power loss during the last flush) the entries are still usable */
+        const uint32_t stride = valid_ ? summary_.stride : FLUSH_INDEX_STRIDE;
+        const size_t count = valid_ ? (summary_.bytes + stride - 1u) / stride : data.size() / sizeof(FLUSH_INDEX_ENTRY_T);
+        for (size_t index = 0u; (index < count) && ((index + 1u) * sizeof(FLUSH_INDEX_ENTRY_T) <= data.size()); index++)
+        {
+            FLUSH_INDEX_ENTRY_T entry;
+            std::memcpy(&entry, &data[index * sizeof(entry)], sizeof(entry));
+            const uint64_t covered = static_cast<uint64_t>(index) * stride;
+            if ((entry.piece.offset <= covered) && (covered - entry.piece.offset < PIECE_MAX) && (entry.piece.us != 0u) &&
+                (entries_.empty() || (entry.piece.offset != entries_.back().piece.offset)))
+            {
+                entries_.push_back(entry);
+            }
+        }
+        return true;
+    }
+
+    bool valid() const
+    {
+        return valid_;
+    }
+
+    const FLUSH_INDEX_SUMMARY_T& summary() const
+    {
+        return summary_;
+    }
+
+    /* Bytes of the log that arrived in [from_us, to_us]: from the last piece that started before from_us up to the first
+       one that started after to_us */
+    void range(uint64_t from_us, uint64_t to_us, uint64_t& start, uint64_t& end) const
+    {
+        start = 0u;
+        end = UINT64_MAX;
+        for (const FLUSH_INDEX_ENTRY_T& entry : entries_)
+        {
+            if (entry.piece.us <= from_us)
+            {
+                start = entry.piece.offset;
+            }
+            if ((entry.piece.us > to_us) && (end == UINT64_MAX))
+            {
+                end = entry.piece.offset;
+            }
+        }
+        if (end < start)
+        {
+            end = start; // Nothing arrived in the range
+        }
+    }
+
+    size_t entries() const
+    {
+        return entries_.size();
+    }
+
+private:
+    FLUSH_INDEX_SUMMARY_T summary_ = {};
+    std::vector<FLUSH_INDEX_ENTRY_T> entries_;
+    bool valid_ = false;
+};
+
+std::string format_time(uint64_t us, bool wall, int64_t boot_s)
+{
+    char text[40];
+    if (us == 0u)
+    {
+        return "-";
+    }
+    if (wall)
+    {
+        const time_t seconds = static_cast<time_t>(boot_s + static_cast<int64_t>(us / 1000000u));
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+        return std::string(text) + "." + std::to_string(us % 1000000u + 1000000u).substr(1u);
+    }
+    std::snprintf(text, sizeof(text), "%" PRIu64 ".%06" PRIu64, us / 1000000u, us % 1000000u);
+    return text;
+}
+
+uint64_t parse_time(const char* text, bool wall, int64_t boot_s)
+{
+    const double seconds = std::strtod(text, nullptr) - (wall ? static_cast<double>(boot_s) : 0.0);
+    return (seconds <= 0.0) ? 0u : static_cast<uint64_t>(seconds * 1e6);
+}
+
+/* The log next to an index: same name, whichever extension exists, in the case of the index extension */
+std::string log_path(const std::string& index_path, std::vector<uint8_t>& data)
+{
+    const bool lower = std::islower(static_cast<unsigned char>(index_path.back())) != 0;
+    for (const char* extension : LOG_EXTENSIONS)
+    {
+        std::string path = index_path.substr(0u, index_path.size() - 3u);
+        for (const char* letter = extension; *letter != '\0'; letter++)
+        {
+            path += lower ? static_cast<char>(std::tolower(static_cast<unsigned char>(*letter))) : *letter;
+        }
+        if (read_file(path, data))
+        {
+            return path;
+        }
+    }
+    return std::string();
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool wall = false;
+    bool extract = false;
+    int64_t boot_s = 0;
+    const char* range = nullptr;
+    std::vector<std::string> paths;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if ((std::strcmp(argv[index], "-s") == 0) && (index + 1 < argc))
+        {
+            boot_s = std::strtoll(argv[++index], nullptr, 10);
+            wall = true;
+        }
+        else if ((std::strcmp(argv[index], "-t") == 0) && (index + 1 < argc))
+        {
+            range = argv[++index];
+        }
+        else if (std::strcmp(argv[index], "-x") == 0)
+        {
+            extract = true;
+        }
+        else if (argv[index][0] != '-')
+        {
+            paths.push_back(argv[index]);
+        }
+        else
+        {
+            paths.clear();
+            break;
+        }
+    }
+    if (paths.empty() || ((range != nullptr) && (paths.size() != 1u)) || (extract && (range == nullptr)))
+    {
+        std::cerr << "usage: " << argv[0] << " [-s <unix seconds at boot>] <LOGxxxxx.IDX>...\n"
+                  << "       " << argv[0] << " [-s <unix seconds at boot>] -t <from>[,<to>] [-x] <LOGxxxxx.IDX>\n";
+        return 2;
+    }
+
+    if (range == nullptr)
+    {
+        int ret = 0;
+        std::printf("%-14s %10s %9s %9s %-26s %-26s %s\n", "index", "bytes", "lines", "dropped", "first", "last", "entries");
+        for (const std::string& path : paths)
+        {
+            Index index;
+            if (!index.load(path))
+            {
+                std::cerr << "cannot read " << path << "\n";
+                ret = 1;
+                continue;
+            }
+            const FLUSH_INDEX_SUMMARY_T& summary = index.summary();
+            if (!index.valid())
+            {
+                std::printf("%-14s %10s %9s %9s %-26s %-26s %zu (no summary)\n", path.c_str(), "?", "?", "?", "?", "?", index.entries());
+                continue;
+            }
+            const std::string lines = ((summary.flags & FLUSH_INDEX_LINES) == 0u) ? "-"
+                                      : std::to_string(summary.lines) + (((summary.flags & FLUSH_INDEX_PARTIAL) != 0u) ? "+" : "");
+            std::printf("%-14s %10" PRIu32 " %9s %9" PRIu32 " %-26s %-26s %zu\n", path.c_str(), summary.bytes, lines.c_str(), summary.dropped,
+                        format_time(summary.first_us, wall, boot_s).c_str(), format_time(summary.last_us, wall, boot_s).c_str(), index.entries());
+        }
+        return ret;
+    }
+
+    Index index;
+    if (!index.load(paths[0]))
+    {
+        std::cerr << "cannot read " << paths[0] << "\n";
+        return 1;
+    }
+    const char* comma = std::strchr(range, ',');
+    const uint64_t from_us = parse_time(range, wall, boot_s);
+    const uint64_t to_us = (comma != nullptr) ? parse_time(comma + 1, wall, boot_s) : UINT64_MAX;
+    uint64_t start;
+    uint64_t end;
+    index.range(from_us, to_us, start, end);
+
+    if (!extract)
+    {
+        if (end == UINT64_MAX)
+        {
+            std::printf("%" PRIu64 " end\n", start);
+        }
+        else
+        {
+            std::printf("%" PRIu64 " %" PRIu64 "\n", start, end);
+        }
+        return 0;
+    }
+
+    std::vector<uint8_t> log;
+    const std::string path = log_path(paths[0], log);
+    if (path.empty())
+    {
+        std::cerr << "no log next to " << paths[0] << "\n";
+        return 1;
+    }
+    end = (end > log.size()) ? log.size() : end;
+    start = (start > end) ? end : start;
+    if (strcasecmp(path.c_str() + path.size() - 3u, "TXT") == 0)
+    {
+        /* Whole lines: from the first line starting in the range up to the end of the line the range ends in */
+        while ((start > 0u) && (start < end) && (log[start - 1u] != '\n'))
+        {
+            start++;
+        }
+        while ((end < log.size()) && (end > 0u) && (log[end - 1u] != '\n'))
+        {
+            end++;
+        }
+    }
+    std::fwrite(log.data() + start, 1u, end - start, stdout);
+    return 0;
+}
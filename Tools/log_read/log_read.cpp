@@ -0,0 +1,275 @@
+/**
+ * @brief Multithreaded host reader for logger output, on top of log_reader.h
+ *
+ * Usage: log_read [-j <threads>] [-f txt|tsr|lzb|blk|fram] [-a] [-c] [-r] <log or FRAM dump>
+ *
+ * The file is memory mapped, unpacked (BLK), expanded (LZB) and decoded (text, timestamped records) by all threads, then
+ * written to stdout in file order. Records print every line behind the time of the record it starts in, in seconds
+ * since boot; use ts_decode for wall-clock time and reboots. -r lists the records (microseconds, length) instead.
+ * The format follows the extension, a file of the FRAM size is a dump: the data not flushed yet (-a the whole ring).
+ * -c only counts, for measuring. Throughput of every stage goes to stderr.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "log_reader.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+constexpr size_t RECORD_SNIFF = 4096u; /**< Bytes of an expanded LZB searched for a record */
+
+struct Part
+{
+    std::string out;
+    size_t units = 0u;
+    size_t skipped = 0u;
+};
+
+void report(const char* stage, size_t bytes, Clock::time_point start, const log_reader::Stats& stats)
+{
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::fprintf(stderr, "%-7s %12zu bytes %10zu units %8.1f ms %9.1f MB/s", stage, bytes, stats.units, ms,
+                 (ms > 0.0) ? (static_cast<double>(bytes) / 1000.0 / ms) : 0.0);
+    if ((stats.damaged != 0u) || (stats.skipped != 0u))
+    {
+        std::fprintf(stderr, ", %zu damaged, %zu bytes skipped", stats.damaged, stats.skipped);
+    }
+    std::fprintf(stderr, "\n");
+}
+
+/* "[ssssss.uuuuuu] " like ts_decode, without snprintf: it is the slowest part of the record output */
+void print_time(std::string& out, uint64_t us)
+{
+    char text[32];
+    char* end = text + sizeof(text);
+    char* digit = end;
+    *--digit = ' ';
+    *--digit = ']';
+    for (unsigned index = 0u; (index < 8u) || (us != 0u); index++)
+    {
+        *--digit = (index == 6u) ? '.' : static_cast<char>('0' + (us % 10u));
+        us = (index == 6u) ? us : (us / 10u);
+    }
+    while (end - digit < 15)
+    {
+        *--digit = ' ';
+    }
+    *--digit = '[';
+    out.append(digit, static_cast<size_t>(end - digit));
+}
+
+void decode_text(std::string_view text, bool count, Part& part)
+{
+    for (std::string_view line : log_reader::Lines(text))
+    {
+        if (!count)
+        {
+            part.out.append(line.data(), line.size());
+        }
+        part.units++;
+    }
+}
+
+/* line_start: the bytes in front of the part ended a line */
+void decode_records(std::string_view stream, size_t begin, size_t end, bool line_start, bool count, bool list, Part& part)
+{
+    const log_reader::Records records(stream, begin, end);
+    log_reader::Records::Iterator record = records.begin();
+    for (; record != records.end(); ++record)
+    {
+        part.units++;
+        if (count)
+        {
+            continue;
+        }
+        if (list)
+        {
+            part.out += std::to_string((*record).us) + "," + std::to_string((*record).data.size()) + "\n";
+            continue;
+        }
+        for (std::string_view line : log_reader::Lines((*record).data))
+        {
+            if (line_start)
+            {
+                print_time(part.out, (*record).us);
+            }
+            part.out.append(line.data(), line.size());
+            line_start = (line.back() == '\n');
+        }
+    }
+    part.skipped = record.skipped();
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    bool forced = false;
+    bool all = false;
+    bool count = false;
+    bool list = false;
+    log_reader::Format format = log_reader::Format::Text;
+    const char* path = nullptr;
+
+    static const struct
+    {
+        const char* name;
+        log_reader::Format format;
+    } formats[] = {
+        { "txt", log_reader::Format::Text },   { "tsr", log_reader::Format::Records }, { "lzb", log_reader::Format::Frames },
+        { "blk", log_reader::Format::Blocks }, { "fram", log_reader::Format::Fram },
+    };
+
+    bool usage = false;
+    for (int index = 1; (index < argc) && !usage; index++)
+    {
+        if ((std::strcmp(argv[index], "-j") == 0) && (index + 1 < argc))
+        {
+            threads = static_cast<unsigned>(std::strtoul(argv[++index], nullptr, 10));
+        }
+        else if ((std::strcmp(argv[index], "-f") == 0) && (index + 1 < argc))
+        {
+            const char* name = argv[++index];
+            usage = true;
+            for (const auto& entry : formats)
+            {
+                if (std::strcmp(name, entry.name) == 0)
+                {
+                    format = entry.format;
+                    forced = true;
+                    usage = false;
+                }
+            }
+        }
+        else if (std::strcmp(argv[index], "-a") == 0)
+        {
+            all = true;
+        }
+        else if (std::strcmp(argv[index], "-c") == 0)
+        {
+            count = true;
+        }
+        else if (std::strcmp(argv[index], "-r") == 0)
+        {
+            list = true;
+        }
+        else if ((argv[index][0] != '-') && (path == nullptr))
+        {
+            path = argv[index];
+        }
+        else
+        {
+            usage = true;
+        }
+    }
+    if (usage || (path == nullptr))
+    {
+        std::cerr << "usage: " << argv[0] << " [-j <threads>] [-f txt|tsr|lzb|blk|fram] [-a] [-c] [-r] <log or FRAM dump>\n";
+        return 2;
+    }
+    threads = (threads == 0u) ? 1u : threads;
+
+    log_reader::MappedFile file;
+    if (!file.open(path))
+    {
+        std::cerr << "cannot read " << path << "\n";
+        return 1;
+    }
+    if (!forced && !log_reader::detect_format(path, file.view().size(), format))
+    {
+        std::cerr << "unknown format of " << path << ", use -f\n";
+        return 2;
+    }
+
+    /* Peel the container layers, the content ends up in stream; only a decoding layer owns a buffer */
+    std::string_view stream = file.view();
+    std::vector<char> ring;
+    std::vector<char> unpacked;
+    std::vector<char> expanded;
+    uint8_t content = (format == log_reader::Format::Records) ? log_reader::CONTENT_RECORDS
+                      : (format == log_reader::Format::Frames) ? log_reader::CONTENT_PACKED
+                                                               : 0u;
+    bool damaged = false;
+    const Clock::time_point start = Clock::now();
+
+    if (format == log_reader::Format::Fram)
+    {
+        bool ok;
+        ring = log_reader::fram_ring(stream, all, content, ok);
+        if (!ok)
+        {
+            std::cerr << path << ": too short for a FRAM dump or no valid checkpoint (-a reads the whole ring)\n";
+            return 1;
+        }
+        stream = std::string_view(ring.data(), ring.size());
+    }
+    else if (format == log_reader::Format::Blocks)
+    {
+        log_reader::Stats stats;
+        const Clock::time_point stage = Clock::now();
+        unpacked = log_reader::unpack_blocks(stream, threads, stats, content);
+        report("blocks", stream.size(), stage, stats);
+        damaged |= (stats.damaged != 0u);
+        stream = std::string_view(unpacked.data(), unpacked.size());
+    }
+    if ((content & log_reader::CONTENT_PACKED) != 0u)
+    {
+        log_reader::Stats stats;
+        const Clock::time_point stage = Clock::now();
+        expanded = log_reader::expand_frames(stream, threads, stats);
+        report("frames", stream.size(), stage, stats);
+        damaged |= (stats.damaged != 0u);
+        stream = std::string_view(expanded.data(), expanded.size());
+    }
+
+    /* An LZB file does not say what it holds: the record magic never occurs in UTF-8 text */
+    if ((format == log_reader::Format::Frames) && (stream.size() > 0u))
+    {
+        const size_t magic = stream.substr(0u, RECORD_SNIFF).find(static_cast<char>(INGEST_RECORD_MAGIC));
+        content |= ((magic != std::string_view::npos) && log_reader::valid_record(stream, magic)) ? log_reader::CONTENT_RECORDS : 0u;
+    }
+
+    const bool records = (content & log_reader::CONTENT_RECORDS) != 0u;
+    const std::vector<size_t> offsets = log_reader::split(stream, threads, records);
+    std::vector<Part> parts(threads);
+    const Clock::time_point stage = Clock::now();
+    log_reader::run_parallel(threads, [&](unsigned index) {
+        const size_t begin = offsets[index];
+        const size_t end = offsets[index + 1u];
+        if (records)
+        {
+            decode_records(stream, begin, end, (begin == 0u) || (stream[begin - 1u] == '\n'), count, list, parts[index]);
+        }
+        else
+        {
+            decode_text(stream.substr(begin, end - begin), count, parts[index]);
+        }
+    });
+
+    log_reader::Stats stats;
+    size_t written = 0u;
+    for (const Part& part : parts)
+    {
+        stats.units += part.units;
+        stats.skipped += part.skipped;
+        written += part.out.size();
+        std::fwrite(part.out.data(), 1u, part.out.size(), stdout);
+    }
+    std::fflush(stdout);
+    report(records ? "records" : "lines", stream.size(), stage, stats);
+
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::fprintf(stderr, "total   %12zu bytes -> %zu bytes in %.1f ms, %.1f MB/s with %u threads\n", file.view().size(), written, ms,
+                 (ms > 0.0) ? (static_cast<double>(file.view().size()) / 1000.0 / ms) : 0.0, threads);
+
+    return damaged ? 1 : 0;
+}
@@ -0,0 +1,524 @@
+#include "log_reader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compress_dict.h"
+#include "define.h"
+#include "flush.h"
+#include "flush_block.h"
+
+namespace log_reader
+{
+namespace
+{
+constexpr size_t FRAM_SIZE = 0x40000u; /**< MB85RS2MTA, 256 KiB */
+constexpr uint16_t CHECKPOINT_MAGIC = 0x4b43u;
+constexpr uint16_t FRAME_MAGIC = 0x5a4cu;
+constexpr uint8_t FRAME_STORED = 0x01u;
+constexpr uint8_t FRAME_DICTIONARY = 0x02u;
+constexpr unsigned FRAME_DICT_SHIFT = 4u;
+constexpr size_t DICTIONARY_SIZE = sizeof(COMPRESS_DICTIONARY) - 1u;
+constexpr size_t FRAME_HEADER = 8u;
+constexpr size_t MIN_MATCH = 4u;
+constexpr uint32_t RUN_MASK = 15u;
+constexpr size_t RECORD_HEADER = sizeof(INGEST_RECORD_T);
+
+uint16_t get16(const char* src)
+{
+    const uint8_t* byte = reinterpret_cast<const uint8_t*>(src);
+    return static_cast<uint16_t>(byte[0] | (byte[1] << 8u));
+}
+
+uint32_t get32(const char* src)
+{
+    return get16(src) | (static_cast<uint32_t>(get16(src + 2)) << 16u);
+}
+
+/* Standard CRC-32 (zlib) of the block container */
+class Crc32
+{
+public:
+    Crc32()
+    {
+        for (uint32_t index = 0u; index < table_.size(); index++)
+        {
+            uint32_t value = index;
+            for (unsigned bit = 0u; bit < 8u; bit++)
+            {
+                value = (value & 1u) ? ((value >> 1u) ^ 0xedb88320u) : (value >> 1u);
+            }
+            table_[index] = value;
+        }
+    }
+
+    uint32_t update(uint32_t crc, const char* data, size_t length) const
+    {
+        for (size_t index = 0u; index < length; index++)
+        {
+            crc = table_[(crc ^ static_cast<uint8_t>(data[index])) & 0xffu] ^ (crc >> 8u);
+        }
+        return crc;
+    }
+
+private:
+    std::array<uint32_t, 256> table_;
+};
+
+/* The checkpoint CRC as hcrc computes it: 16-bit polynomial 0x0007, init 0xffff, bytes and result bit reversed */
+uint32_t checkpoint_crc(const char* data, size_t length)
+{
+    uint16_t crc = 0xffffu;
+    for (size_t index = 0u; index < length; index++)
+    {
+        crc ^= static_cast<uint8_t>(data[index]);
+        for (unsigned bit = 0u; bit < 8u; bit++)
+        {
+            crc = (crc & 1u) ? static_cast<uint16_t>((crc >> 1u) ^ 0xe000u) : static_cast<uint16_t>(crc >> 1u);
+        }
+    }
+    return crc;
+}
+
+bool valid_block(const Crc32& crc32, std::string_view file, size_t pos)
+{
+    if ((pos + FLUSH_BLOCK_SIZE > file.size()) || (get32(&file[pos]) != FLUSH_BLOCK_SYNC) ||
+        (get16(&file[pos + offsetof(FLUSH_BLOCK_T, length)]) > FLUSH_BLOCK_PAYLOAD))
+    {
+        return false;
+    }
+    const char* block = &file[pos];
+    uint32_t crc = crc32.update(UINT32_MAX, block, offsetof(FLUSH_BLOCK_T, crc));
+    crc = crc32.update(crc, block + sizeof(FLUSH_BLOCK_T), FLUSH_BLOCK_PAYLOAD);
+    return ~crc == get32(&block[offsetof(FLUSH_BLOCK_T, crc)]);
+}
+
+bool valid_frame_header(const char* header)
+{
+    uint8_t check = 0u;
+    for (size_t index = 0u; index < FRAME_HEADER - 1u; index++)
+    {
+        check = static_cast<uint8_t>(check + static_cast<uint8_t>(header[index]));
+    }
+    return (get16(header) == FRAME_MAGIC) && (static_cast<uint8_t>(header[FRAME_HEADER - 1u]) == check);
+}
+
+/* Length continuation bytes after a full token nibble */
+bool get_length(const uint8_t*& src, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (src >= end)
+        {
+            return false;
+        }
+        byte = *src++;
+        length += byte;
+    } while (byte == 255u);
+    return true;
+}
+
+/* LZ4 block into exactly capacity bytes at dst, matches may reach back history bytes in front of dst */
+bool expand_block(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity, size_t history)
+{
+    const uint8_t* end = src + length;
+    size_t out = 0u;
+
+    while (src < end)
+    {
+        const uint8_t token = *src++;
+
+        size_t literals = token >> 4u;
+        if (((literals == RUN_MASK) && !get_length(src, end, literals)) || (literals > static_cast<size_t>(end - src)) ||
+            (literals > capacity - out))
+        {
+            return false;
+        }
+        std::memcpy(dst + out, src, literals);
+        src += literals;
+        out += literals;
+
+        if (src == end)
+        {
+            break; // Last sequence has no match
+        }
+
+        if (end - src < 2)
+        {
+            return false;
+        }
+        const size_t offset = src[0] | (src[1] << 8u);
+        src += 2;
+
+        size_t match = token & RUN_MASK;
+        if ((match == RUN_MASK) && !get_length(src, end, match))
+        {
+            return false;
+        }
+        match += MIN_MATCH;
+
+        if ((offset == 0u) || (offset > out + history) || (match > capacity - out))
+        {
+            return false;
+        }
+        for (size_t index = 0u; index < match; index++, out++) // Overlapping copy, byte by byte
+        {
+            dst[out] = dst[static_cast<ptrdiff_t>(out) - static_cast<ptrdiff_t>(offset)];
+        }
+    }
+
+    return out == capacity;
+}
+
+struct Frame
+{
+    size_t pos;
+    size_t raw;
+    size_t packed;
+    uint8_t flags;
+};
+
+bool expand_frame(std::string_view file, const Frame& frame, char* out)
+{
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(&file[frame.pos + FRAME_HEADER]);
+    if ((frame.flags & FRAME_STORED) != 0u)
+    {
+        if (frame.packed != frame.raw)
+        {
+            return false;
+        }
+        std::memcpy(out, payload, frame.raw);
+        return true;
+    }
+    if ((frame.flags & FRAME_DICTIONARY) != 0u)
+    {
+        /* Expand behind a copy of the dictionary, then keep only the block */
+        thread_local std::vector<uint8_t> block;
+        block.resize(DICTIONARY_SIZE + frame.raw);
+        std::memcpy(block.data(), COMPRESS_DICTIONARY, DICTIONARY_SIZE);
+        if (((frame.flags >> FRAME_DICT_SHIFT) != COMPRESS_DICTIONARY_ID) ||
+            !expand_block(payload, frame.packed, &block[DICTIONARY_SIZE], frame.raw, DICTIONARY_SIZE))
+        {
+            return false;
+        }
+        std::memcpy(out, &block[DICTIONARY_SIZE], frame.raw);
+        return true;
+    }
+    return expand_block(payload, frame.packed, reinterpret_cast<uint8_t*>(out), frame.raw, 0u);
+}
+
+bool load_checkpoint(std::string_view dump, size_t addr, FLUSH_CHECKPOINT_T& checkpoint)
+{
+    std::memcpy(&checkpoint, &dump[addr], sizeof(checkpoint));
+    return (checkpoint.magic == CHECKPOINT_MAGIC) &&
+           (checkpoint.crc == checkpoint_crc(&dump[addr], offsetof(FLUSH_CHECKPOINT_T, crc))) &&
+           (checkpoint.fram_read >= LOCATION_BUFFER_START) && (checkpoint.fram_read < LOCATION_BUFFER_END);
+}
+} // namespace
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+    {
+        munmap(data_, size_);
+    }
+}
+
+bool MappedFile::open(const char* path)
+{
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    bool ok = (fstat(fd, &info) == 0);
+    if (ok && (info.st_size > 0))
+    {
+        size_ = static_cast<size_t>(info.st_size);
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = (data_ != MAP_FAILED);
+        if (ok)
+        {
+            madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+        else
+        {
+            data_ = nullptr;
+            size_ = 0u;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+bool detect_format(const char* path, size_t size, Format& format)
+{
+    static const struct
+    {
+        const char* extension;
+        Format format;
+    } extensions[] = {
+        { ".TXT", Format::Text }, { ".TSR", Format::Records }, { ".LZB", Format::Frames }, { ".BLK", Format::Blocks },
+    };
+
+    const char* dot = std::strrchr(path, '.');
+    for (const auto& entry : extensions)
+    {
+        if ((dot != nullptr) && (strcasecmp(dot, entry.extension) == 0))
+        {
+            format = entry.format;
+            return true;
+        }
+    }
+    if (size == FRAM_SIZE)
+    {
+        format = Format::Fram;
+        return true;
+    }
+    return false;
+}
+
+std::vector<char> unpack_blocks(std::string_view file, unsigned threads, Stats& stats, uint8_t& content)
+{
+    struct Found
+    {
+        size_t pos;
+        uint32_t sequence;
+        uint16_t length;
+    };
+
+    /* Each thread takes the blocks starting in its range, resyncing on a 4-byte boundary after damage */
+    const Crc32 crc32;
+    const size_t range = std::max<size_t>(((file.size() / threads) + 3u) & ~static_cast<size_t>(3u), FLUSH_BLOCK_SIZE);
+    std::vector<std::vector<Found>> found(threads);
+    run_parallel(threads, [&](unsigned part) {
+        const size_t end = std::min(file.size(), (part + 1u) * range);
+        for (size_t pos = part * range; pos < end;)
+        {
+            if (!valid_block(crc32, file, pos))
+            {
+                pos += sizeof(uint32_t);
+                continue;
+            }
+            found[part].push_back({ pos, get32(&file[pos + offsetof(FLUSH_BLOCK_T, sequence)]),
+                                    get16(&file[pos + offsetof(FLUSH_BLOCK_T, length)]) });
+            pos += FLUSH_BLOCK_SIZE;
+        }
+    });
+
+    /* Blocks of the next range may start inside the last block of a range, a false sync in a payload */
+    std::vector<Found> blocks;
+    for (const std::vector<Found>& part : found)
+    {
+        for (const Found& block : part)
+        {
+            if (blocks.empty() || (block.pos >= blocks.back().pos + FLUSH_BLOCK_SIZE))
+            {
+                blocks.push_back(block);
+            }
+        }
+    }
+
+    std::vector<size_t> offsets(blocks.size() + 1u, 0u);
+    size_t expected = 0u;
+    for (size_t index = 0u; index < blocks.size(); index++)
+    {
+        if (blocks[index].pos != expected)
+        {
+            stats.damaged++;
+            stats.skipped += blocks[index].pos - expected;
+        }
+        expected = blocks[index].pos + FLUSH_BLOCK_SIZE;
+        offsets[index + 1u] = offsets[index] + blocks[index].length;
+    }
+    if (expected < file.size())
+    {
+        stats.damaged++;
+        stats.skipped += file.size() - expected;
+    }
+    stats.units += blocks.size();
+    content = blocks.empty() ? 0u : static_cast<uint8_t>(file[blocks.front().pos + offsetof(FLUSH_BLOCK_T, content)]);
+
+    std::vector<char> out(offsets.back());
+    run_parallel(threads, [&](unsigned part) {
+        for (size_t index = part; index < blocks.size(); index += threads)
+        {
+            std::memcpy(out.data() + offsets[index], &file[blocks[index].pos + sizeof(FLUSH_BLOCK_T)], blocks[index].length);
+        }
+    });
+    return out;
+}
+
+std::vector<char> expand_frames(std::string_view file, unsigned threads, Stats& stats)
+{
+    std::vector<Frame> frames;
+    std::vector<size_t> offsets(1u, 0u);
+    for (size_t pos = 0u; pos + FRAME_HEADER <= file.size();)
+    {
+        const char* header = &file[pos];
+        if (!valid_frame_header(header))
+        {
+            pos++;
+            stats.skipped++;
+            continue;
+        }
+        const Frame frame = { pos, get16(&header[2]), get16(&header[4]), static_cast<uint8_t>(header[6]) };
+        if (pos + FRAME_HEADER + frame.packed > file.size())
+        {
+            stats.damaged++; // Truncated
+            break;
+        }
+        frames.push_back(frame);
+        offsets.push_back(offsets.back() + frame.raw);
+        pos += FRAME_HEADER + frame.packed;
+    }
+
+    std::vector<char> out(offsets.back());
+    std::vector<uint8_t> damaged(frames.size(), 0u);
+    run_parallel(threads, [&](unsigned part) {
+        for (size_t index = part; index < frames.size(); index += threads)
+        {
+            damaged[index] = expand_frame(file, frames[index], out.data() + offsets[index]) ? 0u : 1u;
+        }
+    });
+
+    /* Damage is rare, close the gaps it left afterwards */
+    size_t fill = 0u;
+    for (size_t index = 0u; index < frames.size(); index++)
+    {
+        if (damaged[index] != 0u)
+        {
+            stats.damaged++;
+            continue;
+        }
+        if (fill != offsets[index])
+        {
+            std::memmove(out.data() + fill, out.data() + offsets[index], frames[index].raw);
+        }
+        fill += frames[index].raw;
+        stats.units++;
+    }
+    out.resize(fill);
+    return out;
+}
+
+std::vector<char> fram_ring(std::string_view dump, bool all, uint8_t& content, bool& ok)
+{
+    std::vector<char> ring;
+    ok = dump.size() >= FRAM_SIZE;
+    if (!ok)
+    {
+        return ring;
+    }
+
+    uint32_t write_addr = (static_cast<uint32_t>(static_cast<uint8_t>(dump[SYNC_BUFFER_MSB])) << 16u) |
+                          (static_cast<uint32_t>(static_cast<uint8_t>(dump[SYNC_BUFFER_MSB2])) << 8u) |
+                          static_cast<uint8_t>(dump[SYNC_BUFFER_LSB]);
+    if ((write_addr < LOCATION_BUFFER_START) || (write_addr >= LOCATION_BUFFER_END))
+    {
+        write_addr = LOCATION_BUFFER_START;
+    }
+    content = static_cast<uint8_t>(dump[INGEST_FORMAT_LOCATION]);
+    if ((content & ~(CONTENT_PACKED | CONTENT_RECORDS)) != 0u)
+    {
+        content = 0u;
+    }
+
+    uint32_t read_addr = write_addr; // The whole ring, oldest byte first
+    if (!all)
+    {
+        FLUSH_CHECKPOINT_T slot_a;
+        FLUSH_CHECKPOINT_T slot_b;
+        const bool valid_a = load_checkpoint(dump, LOCATION_CHECKPOINT_A, slot_a);
+        const bool valid_b = load_checkpoint(dump, LOCATION_CHECKPOINT_B, slot_b);
+        ok = valid_a || valid_b;
+        if (!ok)
+        {
+            return ring;
+        }
+        read_addr = (valid_a && valid_b) ? (((int16_t)(slot_b.sequence - slot_a.sequence) > 0) ? slot_b.fram_read : slot_a.fram_read)
+                    : valid_a            ? slot_a.fram_read
+                                         : slot_b.fram_read;
+    }
+
+    if (read_addr < write_addr)
+    {
+        ring.assign(&dump[read_addr], &dump[write_addr]);
+    }
+    else if ((read_addr > write_addr) || all)
+    {
+        ring.assign(&dump[read_addr], &dump[LOCATION_BUFFER_END]);
+        ring.insert(ring.end(), &dump[LOCATION_BUFFER_START], &dump[write_addr]);
+    }
+    return ring;
+}
+
+void Lines::Iterator::next()
+{
+    const size_t newline = rest_.find('\n');
+    const size_t length = (newline == std::string_view::npos) ? rest_.size() : newline + 1u;
+    line_ = rest_.substr(0u, length);
+    rest_.remove_prefix(length);
+}
+
+bool valid_record(std::string_view stream, size_t pos)
+{
+    if ((pos + RECORD_HEADER > stream.size()) || (static_cast<uint8_t>(stream[pos]) != INGEST_RECORD_MAGIC))
+    {
+        return false;
+    }
+    const size_t next = pos + RECORD_HEADER + get16(&stream[pos + 2u]);
+    return (next == stream.size()) || ((next < stream.size()) && (static_cast<uint8_t>(stream[next]) == INGEST_RECORD_MAGIC));
+}
+
+void Records::Iterator::next()
+{
+    while ((pos_ < end_) && !valid_record(stream_, pos_))
+    {
+        pos_++;
+        skipped_++;
+    }
+    if (pos_ >= end_)
+    {
+        pos_ = end_;
+        record_ = {};
+        return;
+    }
+
+    const char* header = &stream_[pos_];
+    record_.us = (static_cast<uint64_t>(static_cast<uint8_t>(header[1])) << 32u) | get32(&header[4]);
+    record_.data = stream_.substr(pos_ + RECORD_HEADER, get16(&header[2]));
+}
+
+std::vector<size_t> split(std::string_view stream, unsigned parts, bool records)
+{
+    std::vector<size_t> offsets(parts + 1u, stream.size());
+    offsets[0] = 0u;
+    for (unsigned part = 1u; part < parts; part++)
+    {
+        size_t pos = std::max(offsets[part - 1u], stream.size() / parts * part);
+        if (records)
+        {
+            while ((pos < stream.size()) && !valid_record(stream, pos))
+            {
+                pos++;
+            }
+        }
+        else if (pos > 0u)
+        {
+            const size_t newline = stream.find('\n', pos - 1u);
+            pos = (newline == std::string_view::npos) ? stream.size() : newline + 1u;
+        }
+        offsets[part] = pos;
+    }
+    return offsets;
+}
+} // namespace log_reader
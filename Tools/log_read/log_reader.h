@@ -0,0 +1,240 @@
+/**
+ * @brief Host library for reading logger output in bulk: memory mapped, split across threads, iterated in place
+ *
+ * Layers, outermost first:
+ *  - FRAM dump (fram_ring): the ring of a 256 KiB FRAM image, laid out as in Core/Inc/define.h
+ *  - block container (unpack_blocks): LOGxxxxx.BLK, Core/FLUSH/flush_block.h
+ *  - compressed frames (expand_frames): LOGxxxxx.LZB, Core/COMPRESS
+ *  - content: text lines (Lines) or timestamped records (Records, Core/INGEST/ingest_record.h)
+ * A layer that has to decode hands back the inner stream as one buffer. Text and records are iterated where they lie,
+ * a LOGxxxxx.TXT or .TSR is never copied: every line and record is a view into the mapping.
+ * split() cuts a content stream into parts that start on a line or record, run_parallel() runs one thread per part.
+ */
+
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "ingest_record.h"
+
+namespace log_reader
+{
+enum class Format
+{
+    Text,    /**< LOGxxxxx.TXT */
+    Records, /**< LOGxxxxx.TSR */
+    Frames,  /**< LOGxxxxx.LZB */
+    Blocks,  /**< LOGxxxxx.BLK */
+    Fram,    /**< Image of the whole FRAM */
+};
+
+/**< What a container or a FRAM ring holds, same bits as FLUSH_BLOCK_T content and the ingest format byte */
+constexpr uint8_t CONTENT_PACKED = 0x01u;
+constexpr uint8_t CONTENT_RECORDS = 0x02u;
+
+struct Stats
+{
+    size_t units = 0u;   /**< Blocks, frames, lines or records */
+    size_t damaged = 0u; /**< Areas that failed their check and were dropped */
+    size_t skipped = 0u; /**< Bytes skipped looking for the next valid unit */
+};
+
+/* Read only mapping of a whole file */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const char* path);
+
+    std::string_view view() const
+    {
+        return std::string_view(static_cast<const char*>(data_), size_);
+    }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0u;
+};
+
+/* Format from the extension (TXT, TSR, LZB, BLK, anything else of the FRAM size is a dump), false if unknown */
+bool detect_format(const char* path, size_t size, Format& format);
+
+/**
+ * @brief Payloads of the valid blocks in file order. The blocks are found by several threads, each in its own range.
+ *
+ * @param content CONTENT_PACKED and CONTENT_RECORDS of the first valid block
+ */
+std::vector<char> unpack_blocks(std::string_view file, unsigned threads, Stats& stats, uint8_t& content);
+
+/* Expanded frames in file order. The frame headers chain, so they are walked first, the frames expand in parallel. */
+std::vector<char> expand_frames(std::string_view file, unsigned threads, Stats& stats);
+
+/**
+ * @brief Bytes of the FRAM ring in the order they were stored
+ *
+ * @param all the whole ring starting after the write address, otherwise only what was not flushed yet: from the read
+ *            address in the newest valid checkpoint up to the write address
+ * @param content CONTENT_PACKED and CONTENT_RECORDS of the ring
+ * @param ok false if the dump is too short or has no valid checkpoint while all is false
+ */
+std::vector<char> fram_ring(std::string_view dump, bool all, uint8_t& content, bool& ok);
+
+/* Line by line, every line keeps its '\n', the last one may have none */
+class Lines
+{
+public:
+    class Iterator
+    {
+    public:
+        Iterator(std::string_view rest) : rest_(rest)
+        {
+            next();
+        }
+
+        std::string_view operator*() const
+        {
+            return line_;
+        }
+
+        Iterator& operator++()
+        {
+            next();
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return line_.data() != other.line_.data();
+        }
+
+    private:
+        void next();
+
+        std::string_view rest_;
+        std::string_view line_;
+    };
+
+    explicit Lines(std::string_view text) : text_(text)
+    {
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(text_);
+    }
+
+    Iterator end() const
+    {
+        return Iterator(std::string_view(text_.data() + text_.size(), 0u));
+    }
+
+private:
+    std::string_view text_;
+};
+
+struct Record
+{
+    uint64_t us;           /**< Microseconds since boot, exact for 2^40 us (12.7 days) */
+    std::string_view data; /**< Data bytes after the header */
+};
+
+/* Records starting in [begin, end) of a stream, invalid bytes are skipped; the stream end is needed to validate */
+class Records
+{
+public:
+    class Iterator
+    {
+    public:
+        Iterator(std::string_view stream, size_t pos, size_t end) : stream_(stream), pos_(pos), end_(end)
+        {
+            next();
+        }
+
+        const Record& operator*() const
+        {
+            return record_;
+        }
+
+        Iterator& operator++()
+        {
+            pos_ += sizeof(INGEST_RECORD_T) + record_.data.size();
+            next();
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return pos_ != other.pos_;
+        }
+
+        size_t skipped() const
+        {
+            return skipped_;
+        }
+
+    private:
+        void next();
+
+        std::string_view stream_;
+        size_t pos_;
+        size_t end_;
+        size_t skipped_ = 0u;
+        Record record_ = {};
+    };
+
+    Records(std::string_view stream, size_t begin, size_t end) : stream_(stream), begin_(begin), end_(end)
+    {
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(stream_, begin_, end_);
+    }
+
+    Iterator end() const
+    {
+        return Iterator(stream_, end_, end_);
+    }
+
+private:
+    std::string_view stream_;
+    size_t begin_;
+    size_t end_;
+};
+
+/* true if a record header at pos is followed by the next one (or the end of the stream) */
+bool valid_record(std::string_view stream, size_t pos);
+
+/**
+ * @brief Cut a content stream for parallel decoding
+ *
+ * @return parts + 1 offsets, part n is [offsets[n], offsets[n + 1]); every part starts on a line or a valid record
+ */
+std::vector<size_t> split(std::string_view stream, unsigned parts, bool records);
+
+/* part(index) for index 0..parts-1, one thread each, the caller runs part 0 */
+template <typename Part> void run_parallel(unsigned parts, Part part)
+{
+    std::vector<std::thread> workers;
+    for (unsigned index = 1u; index < parts; index++)
+    {
+        workers.emplace_back(part, index);
+    }
+    part(0u);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+} // namespace log_reader
+
+#endif // !LOG_READER_H
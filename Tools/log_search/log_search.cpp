@@ -0,0 +1,413 @@
+/**
+ * @brief Word search over logs, skipping what the word filters of their index (LOGxxxxx.IDX, Core/FLUSH/flush_index.h)
+ *        rule out
+ *
+ * Usage: log_search [-i] [-j <threads>] <words> <log or LOGxxxxx.IDX>...
+ *
+ * Prints every line holding words, as path: line. The words are matched whole at both ends: "timeout" finds
+ * "SPI timeout," but not "timeouts". Only the strides of the log whose filter holds all the words are read and decoded,
+ * from the piece before them so words cut by a piece are found too; a stride without an entry is always read. Words
+ * starting with a digit are not in the filters, a search for numbers only reads everything. -i ignores case (the
+ * filters do anyway). Lines of compressed and record logs may be cut where a read range starts or ends.
+ * How much of every log was read goes to stderr.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "define.h"
+#include "flush_index.h"
+#include "log_reader.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+constexpr uint32_t PIECE_MAX = 0x10000u; /**< An entry's piece starts at most this far before its offset */
+constexpr size_t RECORD_SNIFF = 4096u;   /**< Bytes of an expanded LZB searched for a record */
+const char* const LOG_EXTENSIONS[] = { "TXT", "LZB", "TSR", "BLK" };
+
+struct Range
+{
+    size_t begin;
+    size_t end;
+};
+
+struct Query
+{
+    std::string text;
+    std::vector<uint32_t> hashes; /**< Words that are in the filters */
+    bool fold = false;
+};
+
+/* Same classes as flush_bloom_words(), record headers aside */
+bool word_byte(uint8_t byte)
+{
+    return ((byte >= '0') && (byte <= '9')) || ((byte >= 'a') && (byte <= 'z')) || ((byte >= 'A') && (byte <= 'Z')) || (byte == '_') ||
+           ((byte >= 0x80u) && (byte < INGEST_RECORD_MAGIC));
+}
+
+uint8_t lower(uint8_t byte)
+{
+    return ((byte >= 'A') && (byte <= 'Z')) ? static_cast<uint8_t>(byte | 0x20u) : byte;
+}
+
+std::vector<uint32_t> word_hashes(std::string_view text)
+{
+    std::vector<uint32_t> hashes;
+    for (size_t pos = 0u; pos < text.size();)
+    {
+        if (!word_byte(static_cast<uint8_t>(text[pos])))
+        {
+            pos++;
+            continue;
+        }
+        const bool number = (text[pos] >= '0') && (text[pos] <= '9');
+        uint32_t hash = FLUSH_INDEX_HASH_BASIS;
+        for (; (pos < text.size()) && word_byte(static_cast<uint8_t>(text[pos])); pos++)
+        {
+            hash = (hash ^ lower(static_cast<uint8_t>(text[pos]))) * FLUSH_INDEX_HASH_PRIME;
+        }
+        if (!number)
+        {
+            hashes.push_back(hash);
+        }
+    }
+    return hashes;
+}
+
+bool bloom_holds(const uint8_t* bloom, uint32_t hash)
+{
+    const uint32_t step = (hash >> FLUSH_INDEX_ROTATE) | (hash << (32u - FLUSH_INDEX_ROTATE)) | 1u;
+    for (uint32_t probe = 0u; probe < FLUSH_INDEX_PROBES; probe++)
+    {
+        const uint32_t bit = (hash + probe * step) & (FLUSH_INDEX_BLOOM * 8u - 1u);
+        if ((bloom[bit / 8u] & (1u << (bit % 8u))) == 0u)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool exists(const std::string& path)
+{
+    return std::ifstream(path).good();
+}
+
+/* path with its extension replaced, in the case of the old one */
+std::string with_extension(const std::string& path, const char* extension)
+{
+    const size_t dot = path.rfind('.');
+    std::string out = path.substr(0u, (dot == std::string::npos) ? path.size() : dot) + ".";
+    const bool lower_case = (dot != std::string::npos) && (dot + 1u < path.size()) && std::islower(static_cast<unsigned char>(path[dot + 1u]));
+    for (const char* letter = extension; *letter != '\0'; letter++)
+    {
+        out += lower_case ? static_cast<char>(std::tolower(static_cast<unsigned char>(*letter))) : *letter;
+    }
+    return out;
+}
+
+/* Entries of the index that passed the checks, an empty index when there is none */
+class Index
+{
+public:
+    void load(const std::string& path, size_t log_size)
+    {
+        std::vector<uint8_t> data;
+        if (!read_file(path, data))
+        {
+            return;
+        }
+
+        FLUSH_INDEX_SUMMARY_T summary = {};
+        size_t count = data.size() / sizeof(FLUSH_INDEX_ENTRY_T);
+        if (data.size() >= sizeof(summary))
+        {
+            std::memcpy(&summary, &data[data.size() - sizeof(summary)], sizeof(summary));
+            if ((summary.magic == FLUSH_INDEX_MAGIC) && (summary.stride == FLUSH_INDEX_STRIDE))
+            {
+                count = std::min<size_t>(count, (summary.bytes + FLUSH_INDEX_STRIDE - 1u) / FLUSH_INDEX_STRIDE);
+            }
+        }
+
+        entries_.resize(count);
+        valid_.assign(count, false);
+        for (size_t index = 0u; index < count; index++)
+        {
+            std::memcpy(&entries_[index], &data[index * sizeof(FLUSH_INDEX_ENTRY_T)], sizeof(FLUSH_INDEX_ENTRY_T));
+            const FLUSH_INDEX_PIECE_T& piece = entries_[index].piece;
+            const uint64_t covered = static_cast<uint64_t>(index) * FLUSH_INDEX_STRIDE;
+            valid_[index] = (piece.offset <= covered) && (covered - piece.offset < PIECE_MAX) && (covered < log_size);
+        }
+    }
+
+    bool valid(size_t index) const
+    {
+        return (index < valid_.size()) && valid_[index];
+    }
+
+    const FLUSH_INDEX_ENTRY_T& entry(size_t index) const
+    {
+        return entries_[index];
+    }
+
+private:
+    std::vector<FLUSH_INDEX_ENTRY_T> entries_;
+    std::vector<bool> valid_;
+};
+
+/* The words of stride index could be in the log: its filter holds them all, or there is none */
+bool candidate(const Index& index, size_t stride, const Query& query)
+{
+    if (!index.valid(stride))
+    {
+        return true;
+    }
+    for (uint32_t hash : query.hashes)
+    {
+        if (!bloom_holds(index.entry(stride).bloom, hash))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Log bytes to read for the candidate strides: the pieces ending in a stride, from the start of the entry before */
+std::vector<Range> read_ranges(const Index& index, const Query& query, std::string_view log, bool text, size_t& strides, size_t& candidates)
+{
+    std::vector<Range> ranges;
+    strides = (log.size() + FLUSH_INDEX_STRIDE - 1u) / FLUSH_INDEX_STRIDE;
+    candidates = 0u;
+    for (size_t stride = 0u; stride < strides; stride++)
+    {
+        if (!candidate(index, stride, query))
+        {
+            continue;
+        }
+        candidates++;
+        Range range;
+        range.begin = (stride == 0u) ? 0u : index.valid(stride - 1u) ? index.entry(stride - 1u).piece.offset : (stride - 1u) * FLUSH_INDEX_STRIDE;
+        range.end = index.valid(stride + 1u) ? index.entry(stride + 1u).piece.offset : (stride + 1u) * FLUSH_INDEX_STRIDE;
+        range.end = std::min(std::max(range.end, range.begin), log.size());
+        if (text)
+        {
+            /* Whole lines */
+            const size_t line = (range.begin == 0u) ? std::string_view::npos : log.rfind('\n', range.begin - 1u);
+            const size_t next = (range.end == 0u) ? std::string_view::npos : log.find('\n', range.end - 1u);
+            range.begin = (line == std::string_view::npos) ? 0u : line + 1u;
+            range.end = (next == std::string_view::npos) ? log.size() : next + 1u;
+        }
+        if (!ranges.empty() && (range.begin <= ranges.back().end))
+        {
+            ranges.back().end = std::max(ranges.back().end, range.end);
+        }
+        else
+        {
+            ranges.push_back(range);
+        }
+    }
+    return ranges;
+}
+
+/* Data bytes of the records in a stream, headers dropped */
+std::string record_data(std::string_view stream)
+{
+    std::string data;
+    for (const log_reader::Record& record : log_reader::Records(stream, 0u, stream.size()))
+    {
+        data.append(record.data.data(), record.data.size());
+    }
+    return data;
+}
+
+bool matches(std::string_view line, const Query& query)
+{
+    const std::string_view term(query.text);
+    const bool word_start = word_byte(static_cast<uint8_t>(term.front()));
+    const bool word_end = word_byte(static_cast<uint8_t>(term.back()));
+    for (size_t pos = 0u; pos + term.size() <= line.size(); pos++)
+    {
+        size_t length = 0u;
+        while ((length < term.size()) && (query.fold ? (lower(static_cast<uint8_t>(line[pos + length])) == lower(static_cast<uint8_t>(term[length])))
+                                                     : (line[pos + length] == term[length])))
+        {
+            length++;
+        }
+        if ((length == term.size()) && (!word_start || (pos == 0u) || !word_byte(static_cast<uint8_t>(line[pos - 1u]))) &&
+            (!word_end || (pos + length == line.size()) || !word_byte(static_cast<uint8_t>(line[pos + length]))))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Decode one range of the log down to its content and keep the matching lines */
+void search_range(std::string_view bytes, log_reader::Format format, const std::string& path, const Query& query, std::string& out)
+{
+    std::vector<char> unpacked;
+    std::vector<char> expanded;
+    std::string data;
+    std::string_view stream = bytes;
+    log_reader::Stats stats;
+    uint8_t content = (format == log_reader::Format::Records) ? log_reader::CONTENT_RECORDS
+                      : (format == log_reader::Format::Frames) ? log_reader::CONTENT_PACKED
+                                                               : 0u;
+
+    if (format == log_reader::Format::Blocks)
+    {
+        unpacked = log_reader::unpack_blocks(stream, 1u, stats, content);
+        stream = std::string_view(unpacked.data(), unpacked.size());
+    }
+    if ((content & log_reader::CONTENT_PACKED) != 0u)
+    {
+        expanded = log_reader::expand_frames(stream, 1u, stats);
+        stream = std::string_view(expanded.data(), expanded.size());
+        const size_t magic = stream.substr(0u, RECORD_SNIFF).find(static_cast<char>(INGEST_RECORD_MAGIC));
+        content |= ((magic != std::string_view::npos) && log_reader::valid_record(stream, magic)) ? log_reader::CONTENT_RECORDS : 0u;
+    }
+    if ((content & log_reader::CONTENT_RECORDS) != 0u)
+    {
+        data = record_data(stream);
+        stream = data;
+    }
+
+    for (std::string_view line : log_reader::Lines(stream))
+    {
+        if (matches(line, query))
+        {
+            out += path + ": ";
+            out.append(line.data(), line.size());
+            out += (line.back() == '\n') ? "" : "\n";
+        }
+    }
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    Query query;
+    std::vector<std::string> paths;
+    bool usage = false;
+
+    for (int index = 1; (index < argc) && !usage; index++)
+    {
+        if (std::strcmp(argv[index], "-i") == 0)
+        {
+            query.fold = true;
+        }
+        else if ((std::strcmp(argv[index], "-j") == 0) && (index + 1 < argc))
+        {
+            threads = static_cast<unsigned>(std::strtoul(argv[++index], nullptr, 10));
+        }
+        else if ((argv[index][0] == '-') && query.text.empty())
+        {
+            usage = true;
+        }
+        else if (query.text.empty())
+        {
+            query.text = argv[index];
+        }
+        else
+        {
+            paths.push_back(argv[index]);
+        }
+    }
+    if (usage || query.text.empty() || paths.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " [-i] [-j <threads>] <words> <log or LOGxxxxx.IDX>...\n";
+        return 2;
+    }
+    threads = (threads == 0u) ? 1u : threads;
+    query.hashes = word_hashes(query.text);
+
+    int ret = 0;
+    size_t total = 0u;
+    size_t total_read = 0u;
+    const Clock::time_point start = Clock::now();
+    for (const std::string& path : paths)
+    {
+        /* Either file of the pair may be given */
+        std::string log_path = path;
+        std::string index_path = with_extension(path, "IDX");
+        if (log_path == index_path)
+        {
+            log_path.clear();
+            for (const char* extension : LOG_EXTENSIONS)
+            {
+                log_path = exists(with_extension(path, extension)) ? with_extension(path, extension) : log_path;
+            }
+        }
+
+        log_reader::MappedFile file;
+        log_reader::Format format;
+        if (log_path.empty() || !file.open(log_path.c_str()))
+        {
+            std::cerr << "cannot read the log of " << path << "\n";
+            ret = 1;
+            continue;
+        }
+        const std::string_view log = file.view();
+        if (!log_reader::detect_format(log_path.c_str(), log.size(), format) || (format == log_reader::Format::Fram))
+        {
+            std::cerr << "unknown format of " << log_path << "\n";
+            ret = 1;
+            continue;
+        }
+
+        Index index;
+        index.load(index_path, log.size());
+        size_t strides;
+        size_t candidates;
+        const std::vector<Range> ranges = read_ranges(index, query, log, format == log_reader::Format::Text, strides, candidates);
+
+        std::vector<std::string> parts(ranges.size());
+        log_reader::run_parallel(std::min<unsigned>(threads, std::max<size_t>(ranges.size(), 1u)), [&](unsigned part) {
+            for (size_t range = part; range < ranges.size(); range += threads)
+            {
+                search_range(log.substr(ranges[range].begin, ranges[range].end - ranges[range].begin), format, log_path, query, parts[range]);
+            }
+        });
+
+        size_t read = 0u;
+        for (size_t range = 0u; range < ranges.size(); range++)
+        {
+            read += ranges[range].end - ranges[range].begin;
+            std::fwrite(parts[range].data(), 1u, parts[range].size(), stdout);
+        }
+        std::fprintf(stderr, "%s: %zu of %zu strides may hold the words, read %zu of %zu bytes\n", log_path.c_str(), candidates, strides, read, log.size());
+        total += log.size();
+        total_read += read;
+    }
+    std::fflush(stdout);
+
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::fprintf(stderr, "total   %zu of %zu bytes read (%.1f%%) in %.1f ms\n", total_read, total,
+                 (total > 0u) ? (100.0 * static_cast<double>(total_read) / static_cast<double>(total)) : 0.0, ms);
+
+    return ret;
+}
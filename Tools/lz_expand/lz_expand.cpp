@@ -0,0 +1,231 @@
+/**
+ * @brief Host expander for compressed logs (LOGxxxxx.LZB, Core/COMPRESS)
+ *
+ * Usage: lz_expand <LOGxxxxx.LZB> [output, default stdout]
+ *
+ * Frame layout (little endian): magic "LZ" (0x5a4c), raw length (16 bit), payload length (16 bit), flags, check byte
+ * (sum of the 7 bytes before it), then the payload: an LZ4 block, or the raw bytes when flag 0x01 is set.
+ * Flag 0x02 marks a block compressed at ingest, its matches reach back into the static dictionary (id in the high nibble).
+ * Frames expand on their own, a damaged frame is reported and skipped up to the next valid header.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "compress_dict.h"
+
+namespace
+{
+constexpr uint16_t FRAME_MAGIC = 0x5a4cu;
+constexpr uint8_t FRAME_STORED = 0x01u;
+constexpr uint8_t FRAME_DICTIONARY = 0x02u;
+constexpr unsigned FRAME_DICT_SHIFT = 4u;
+constexpr size_t DICTIONARY_SIZE = sizeof(COMPRESS_DICTIONARY) - 1u;
+constexpr size_t FRAME_HEADER = 8u;
+constexpr size_t MIN_MATCH = 4u;
+constexpr uint32_t RUN_MASK = 15u;
+
+uint16_t get16(const uint8_t* src)
+{
+    return static_cast<uint16_t>(src[0] | (src[1] << 8u));
+}
+
+bool read_file(const char* path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool valid_header(const uint8_t* header)
+{
+    uint8_t check = 0u;
+    for (size_t index = 0u; index < FRAME_HEADER - 1u; index++)
+    {
+        check = static_cast<uint8_t>(check + header[index]);
+    }
+    return (get16(header) == FRAME_MAGIC) && (header[FRAME_HEADER - 1u] == check);
+}
+
+/* Length continuation bytes after a full token nibble */
+bool get_length(const uint8_t*& src, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (src >= end)
+        {
+            return false;
+        }
+        byte = *src++;
+        length += byte;
+    } while (byte == 255u);
+    return true;
+}
+
+/* LZ4 block appended to out, matches refer back into the same block or into the history right before start */
+bool expand_block(const uint8_t* src, size_t length, std::vector<uint8_t>& out, size_t start, size_t raw_length)
+{
+    const uint8_t* end = src + length;
+
+    while (src < end)
+    {
+        const uint8_t token = *src++;
+
+        size_t literals = token >> 4u;
+        if ((literals == RUN_MASK) && !get_length(src, end, literals))
+        {
+            return false;
+        }
+        if (literals > static_cast<size_t>(end - src))
+        {
+            return false;
+        }
+        out.insert(out.end(), src, src + literals);
+        src += literals;
+
+        if (src == end)
+        {
+            break; // Last sequence has no match
+        }
+
+        if (end - src < 2)
+        {
+            return false;
+        }
+        const size_t offset = get16(src);
+        src += 2;
+
+        size_t match = token & RUN_MASK;
+        if ((match == RUN_MASK) && !get_length(src, end, match))
+        {
+            return false;
+        }
+        match += MIN_MATCH;
+
+        if ((offset == 0u) || (offset > out.size()))
+        {
+            return false;
+        }
+        for (size_t index = 0u; index < match; index++) // Overlapping copy, byte by byte
+        {
+            out.push_back(out[out.size() - offset]);
+        }
+    }
+
+    return out.size() - start == raw_length;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if ((argc < 2) || (argc > 3))
+    {
+        std::cerr << "usage: " << argv[0] << " <LOGxxxxx.LZB> [output, default stdout]\n";
+        return 2;
+    }
+
+    std::vector<uint8_t> data;
+    if (!read_file(argv[1], data))
+    {
+        std::cerr << "cannot read " << argv[1] << "\n";
+        return 1;
+    }
+
+    std::vector<uint8_t> out;
+    size_t pos = 0u;
+    size_t frames = 0u;
+    size_t damaged = 0u;
+    size_t skipped = 0u;
+    while (pos + FRAME_HEADER <= data.size())
+    {
+        const uint8_t* header = &data[pos];
+        if (!valid_header(header))
+        {
+            pos++;
+            skipped++;
+            continue;
+        }
+
+        const size_t raw_length = get16(&header[2]);
+        const size_t packed_length = get16(&header[4]);
+        if (pos + FRAME_HEADER + packed_length > data.size())
+        {
+            std::fprintf(stderr, "frame at %zu truncated\n", pos);
+            damaged++;
+            break;
+        }
+
+        const uint8_t* payload = header + FRAME_HEADER;
+        bool ok;
+        if ((header[6] & FRAME_STORED) != 0u)
+        {
+            ok = (packed_length == raw_length);
+            if (ok)
+            {
+                out.insert(out.end(), payload, payload + packed_length);
+            }
+        }
+        else if ((header[6] & FRAME_DICTIONARY) != 0u)
+        {
+            /* Expand behind a copy of the dictionary, then keep only the block */
+            std::vector<uint8_t> block(COMPRESS_DICTIONARY, COMPRESS_DICTIONARY + DICTIONARY_SIZE);
+            ok = ((header[6] >> FRAME_DICT_SHIFT) == COMPRESS_DICTIONARY_ID) && expand_block(payload, packed_length, block, DICTIONARY_SIZE, raw_length);
+            if (ok)
+            {
+                out.insert(out.end(), block.begin() + DICTIONARY_SIZE, block.end());
+            }
+        }
+        else
+        {
+            std::vector<uint8_t> block;
+            ok = expand_block(payload, packed_length, block, 0u, raw_length);
+            if (ok)
+            {
+                out.insert(out.end(), block.begin(), block.end());
+            }
+        }
+
+        if (!ok)
+        {
+            std::fprintf(stderr, "frame at %zu damaged\n", pos);
+            damaged++;
+            pos++;
+            continue;
+        }
+
+        frames++;
+        pos += FRAME_HEADER + packed_length;
+    }
+
+    if (argc == 3)
+    {
+        std::ofstream file(argv[2], std::ios::binary);
+        if (!file || !file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size())))
+        {
+            std::cerr << "cannot write " << argv[2] << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    }
+
+    std::fprintf(stderr, "%zu frames, %zu -> %zu bytes", frames, data.size(), out.size());
+    if (skipped != 0u)
+    {
+        std::fprintf(stderr, ", %zu bytes skipped", skipped);
+    }
+    std::fprintf(stderr, "\n");
+
+    return (damaged != 0u) ? 1 : 0;
+}
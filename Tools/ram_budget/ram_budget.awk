@@ -0,0 +1,216 @@
+# RAM budget per subsystem from a GNU ld map file, run by the Makefile after every link
+#
+# Usage: awk -f ram_budget.awk build/SD_Logger_Test.map
+#
+# Every input section of .data, .bss and the arena output sections is charged to a subsystem: arena slices by their
+# section name (.arena_sram1.ingest), everything else by object file. Code copied to SRAM (.ramfunc) is "hot code".
+# Regions come from the memory configuration.
+
+function hex(text,    value, digit, index_)
+{
+    value = 0
+    text = tolower(text)
+    sub(/^0x/, "", text)
+    for (index_ = 1; index_ <= length(text); index_++)
+    {
+        digit = index("0123456789abcdef", substr(text, index_, 1))
+        if (digit == 0)
+        {
+            break
+        }
+        value = value * 16 + digit - 1
+    }
+    return value
+}
+
+function subsystem(section, file,    name)
+{
+    if (output == ".ramfunc")
+    {
+        return "hot code"
+    }
+    if (section == "._user_heap_stack")
+    {
+        return "msp stack + newlib heap"
+    }
+    if (section ~ /^\.arena_sram[0-9]\./)
+    {
+        sub(/^\.arena_sram[0-9]\./, "", section)
+        return "arena " section
+    }
+    if (file == "")
+    {
+        return "(alignment)"
+    }
+    if (file ~ /\.a\(/)
+    {
+        return "libc"
+    }
+
+    name = file
+    sub(/^.*\//, "", name)
+    sub(/\.o$/, "", name)
+    name = tolower(name)
+
+    if (name == "heap_4")
+    {
+        return "rtos heap"
+    }
+    if (name ~ /^(tasks|queue|list|timers|port|cmsis_os2|event_groups|stream_buffer|freertos)$/)
+    {
+        return "freertos"
+    }
+    if (name ~ /^(sd|ff|fatfs|diskio|ff_gen_drv|syscall|ccsbcs|user_diskio.*)$/)
+    {
+        return "fatfs"
+    }
+    if (name ~ /^(usb|usbd).*/)
+    {
+        return "usb"
+    }
+    if (name ~ /^(stm32l4xx_.*|system_stm32l4xx)$/)
+    {
+        return "hal"
+    }
+    if (name == "logger_app")
+    {
+        return "app"
+    }
+    return name
+}
+
+function region(addr,    index_)
+{
+    for (index_ = 1; index_ <= region_count; index_++)
+    {
+        if ((addr >= region_origin[index_]) && (addr < region_origin[index_] + region_length[index_]))
+        {
+            return region_name[index_]
+        }
+    }
+    return ""
+}
+
+function charge(section, addr, size, file,    name, area)
+{
+    area = region(addr)
+    if ((size == 0) || (area == ""))
+    {
+        return
+    }
+    name = subsystem(section, file)
+    if (!(name in seen))
+    {
+        seen[name] = 1
+        order[++names] = name
+    }
+    used[name, area] += size
+    total[area] += size
+}
+
+BEGIN {
+    in_memory = 0
+    in_map = 0
+    counted = 0
+    pending = ""
+}
+
+/^Memory Configuration/ { in_memory = 1; next }
+
+in_memory && /^Linker script and memory map/ { in_memory = 0; in_map = 1; next }
+
+in_memory && ($2 ~ /^0x/) && ($1 != "*default*") {
+    region_name[++region_count] = $1
+    region_origin[region_count] = hex($2)
+    region_length[region_count] = hex($3)
+    next
+}
+
+/^Cross Reference Table/ { in_map = 0 }
+
+!in_map { next }
+
+# Output section, counted ones are the RAM images. ._user_heap_stack only reserves the MSP stack and the newlib heap.
+/^\./ {
+    output = $1
+    counted = (output ~ /^\.(data|bss|ramfunc|arena_sram[0-9])$/)
+    pending = (output == "._user_heap_stack") ? output : ""
+    if ((pending != "") && (NF >= 3))
+    {
+        charge(pending, hex($2), hex($3), "")
+        pending = ""
+    }
+    next
+}
+
+pending == "._user_heap_stack" && /^ +0x/ {
+    charge(pending, hex($1), hex($2), "")
+    pending = ""
+    next
+}
+
+!counted { next }
+
+# Input section with address, size and file on the next line when its name is long
+pending != "" && /^ +0x/ {
+    charge(pending, hex($1), hex($2), $3)
+    pending = ""
+    next
+}
+
+/^ (\.|COMMON)/ {
+    if (NF == 1)
+    {
+        pending = $1
+    }
+    else if ($2 ~ /^0x/)
+    {
+        charge($1, hex($2), hex($3), $4)
+    }
+    next
+}
+
+/^ \*fill\*/ {
+    charge("", hex($2), hex($3), "")
+    next
+}
+
+END {
+    printf "%-26s", "RAM budget (bytes)"
+    for (index_ = 1; index_ <= region_count; index_++)
+    {
+        if (region_name[index_] != "FLASH")
+        {
+            printf "%10s", region_name[index_]
+        }
+    }
+    printf "\n"
+
+    for (item = 1; item <= names; item++)
+    {
+        printf "  %-24s", order[item]
+        for (index_ = 1; index_ <= region_count; index_++)
+        {
+            if (region_name[index_] != "FLASH")
+            {
+                printf "%10d", used[order[item], region_name[index_]]
+            }
+        }
+        printf "\n"
+    }
+
+    split("used free size", rows, " ")
+    for (row = 1; row <= 3; row++)
+    {
+        printf "%-26s", rows[row]
+        for (index_ = 1; index_ <= region_count; index_++)
+        {
+            if (region_name[index_] != "FLASH")
+            {
+                value = (row == 1) ? total[region_name[index_]] : (row == 2) ? region_length[index_] - total[region_name[index_]] : region_length[index_]
+                printf "%10d", value
+            }
+        }
+        printf "\n"
+    }
+}
@@ -0,0 +1,238 @@
+/**
+ * @brief Host benchmark of the line timestamp stage (timestamps=text, Core/STAMP)
+ *
+ * Usage: stamp_bench [megabytes of generated log, default 16] [chunk bytes, default 64]
+ *
+ * Runs the target's stamp.c on generated log lines fed in DMA sized chunks, each chunk 1 ms later than the one before,
+ * against a byte loop with snprintf prefixes. Both outputs have to match. The line break scan and the prefix formatter
+ * are also timed on their own against their byte loop and printf counterparts.
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+extern "C"
+{
+#include "stamp.h"
+}
+
+namespace
+{
+constexpr uint64_t CHUNK_US = 1000u;
+constexpr uint32_t FORMAT_RUNS = 1000000u;
+
+std::vector<uint8_t> sink;
+
+void sink_emit(const uint8_t* data, uint32_t length)
+{
+    sink.insert(sink.end(), data, data + length);
+}
+
+/* Log-like lines of 8 to 160 bytes from a fixed seed, so runs compare */
+std::vector<uint8_t> generate(size_t size)
+{
+    static const char words[] = "INFO WARN DBG ERR sensor=0x3f retry tx rx ok crc fail voltage 3.30V temp=24.5C ack nak id ";
+    std::vector<uint8_t> text;
+    text.reserve(size);
+    uint32_t seed = 12345u;
+
+    while (text.size() < size)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const size_t length = 8u + (seed >> 16u) % 153u;
+        for (size_t index = 0u; (index < length) && (text.size() < size); index++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            text.push_back(static_cast<uint8_t>(words[(seed >> 16u) % (sizeof(words) - 1u)]));
+        }
+        if (text.size() < size)
+        {
+            text.push_back('\n');
+        }
+    }
+
+    return text;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* What the stage replaces: a byte at a time, the prefix printed for every line */
+void reference(const std::vector<uint8_t>& text, size_t chunk)
+{
+    bool line_start = true;
+    uint64_t us = 0u;
+    char prefix[32];
+
+    for (size_t offset = 0u; offset < text.size(); offset += chunk, us += CHUNK_US)
+    {
+        const size_t end = (offset + chunk < text.size()) ? offset + chunk : text.size();
+        for (size_t index = offset; index < end; index++)
+        {
+            if (line_start)
+            {
+                const int length = std::snprintf(prefix, sizeof(prefix), "[%6" PRIu64 ".%06" PRIu64 "] ", us / 1000000u, us % 1000000u);
+                sink_emit(reinterpret_cast<const uint8_t*>(prefix), static_cast<uint32_t>(length));
+            }
+            sink_emit(&text[index], 1u);
+            line_start = text[index] == '\n';
+        }
+    }
+}
+
+void staged(const std::vector<uint8_t>& text, size_t chunk)
+{
+    uint64_t us = 0u;
+
+    stamp_init(sink_emit);
+    for (size_t offset = 0u; offset < text.size(); offset += chunk, us += CHUNK_US)
+    {
+        const size_t length = (offset + chunk < text.size()) ? chunk : text.size() - offset;
+        stamp_time(us);
+        stamp_feed(&text[offset], static_cast<uint32_t>(length));
+    }
+}
+
+template <typename FIND>
+size_t count_lines(const std::vector<uint8_t>& text, size_t chunk, FIND find)
+{
+    size_t lines = 0u;
+
+    for (size_t offset = 0u; offset < text.size(); offset += chunk)
+    {
+        const uint8_t* data = &text[offset];
+        uint32_t length = static_cast<uint32_t>((offset + chunk < text.size()) ? chunk : text.size() - offset);
+        while (length > 0u)
+        {
+            const uint32_t newline = find(data, length);
+            if (newline == length)
+            {
+                break;
+            }
+            lines++;
+            data += newline + 1u;
+            length -= newline + 1u;
+        }
+    }
+
+    return lines;
+}
+
+uint32_t find_bytewise(const uint8_t* data, uint32_t length)
+{
+    uint32_t index = 0u;
+    while ((index < length) && (data[index] != '\n'))
+    {
+        index++;
+    }
+    return index;
+}
+
+uint32_t find_memchr(const uint8_t* data, uint32_t length)
+{
+    const void* newline = std::memchr(data, '\n', length);
+    return (newline != nullptr) ? static_cast<uint32_t>(static_cast<const uint8_t*>(newline) - data) : length;
+}
+
+void report(const char* name, double seconds, size_t bytes)
+{
+    std::printf("%-24s %8.3f ms %10.1f MB/s\n", name, seconds * 1e3, static_cast<double>(bytes) / seconds / 1e6);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const size_t megabytes = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 16u;
+    const size_t chunk = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 64u;
+    if ((argc > 3) || (megabytes == 0u) || (chunk == 0u))
+    {
+        std::cerr << "usage: " << argv[0] << " [megabytes, default 16] [chunk bytes, default 64]\n";
+        return 2;
+    }
+
+    const std::vector<uint8_t> text = generate(megabytes << 20u);
+    std::printf("%zu bytes in %zu byte chunks\n", text.size(), chunk);
+
+    /* Whole stage */
+    sink.reserve(text.size() * 2u);
+    auto start = std::chrono::steady_clock::now();
+    reference(text, chunk);
+    report("byte loop + snprintf", seconds_since(start), text.size());
+    const std::vector<uint8_t> expected = sink;
+
+    sink.clear();
+    start = std::chrono::steady_clock::now();
+    staged(text, chunk);
+    report("stamp_feed", seconds_since(start), text.size());
+    if (sink != expected)
+    {
+        std::cerr << "stamp_feed output differs from the reference\n";
+        return 1;
+    }
+
+    /* Line break scan */
+    size_t lines[3];
+    start = std::chrono::steady_clock::now();
+    lines[0] = count_lines(text, chunk, find_bytewise);
+    report("scan byte loop", seconds_since(start), text.size());
+    start = std::chrono::steady_clock::now();
+    lines[1] = count_lines(text, chunk, find_memchr);
+    report("scan memchr", seconds_since(start), text.size());
+    start = std::chrono::steady_clock::now();
+    lines[2] = count_lines(text, chunk, stamp_find_newline);
+    report("scan stamp_find_newline", seconds_since(start), text.size());
+    if ((lines[0] != lines[1]) || (lines[0] != lines[2]))
+    {
+        std::cerr << "line counts differ: " << lines[0] << " " << lines[1] << " " << lines[2] << "\n";
+        return 1;
+    }
+
+    /* Prefix formatter, over seconds of every width */
+    char expected_prefix[32];
+    char prefix[STAMP_PREFIX_MAX];
+    size_t checksum[2] = { 0u, 0u };
+    start = std::chrono::steady_clock::now();
+    for (uint32_t run = 0u; run < FORMAT_RUNS; run++)
+    {
+        const uint64_t us = static_cast<uint64_t>(run) * 7919u * 104729u;
+        checksum[0] += static_cast<size_t>(std::snprintf(expected_prefix, sizeof(expected_prefix), "[%6" PRIu64 ".%06" PRIu64 "] ", us / 1000000u, us % 1000000u));
+        checksum[0] += static_cast<uint8_t>(expected_prefix[7]);
+    }
+    const double printf_seconds = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    for (uint32_t run = 0u; run < FORMAT_RUNS; run++)
+    {
+        const uint64_t us = static_cast<uint64_t>(run) * 7919u * 104729u;
+        checksum[1] += stamp_format(prefix, us);
+        checksum[1] += static_cast<uint8_t>(prefix[7]);
+    }
+    const double format_seconds = seconds_since(start);
+    std::printf("%-24s %8.1f ns\n%-24s %8.1f ns\n", "format snprintf", printf_seconds * 1e9 / FORMAT_RUNS, "format stamp_format",
+                format_seconds * 1e9 / FORMAT_RUNS);
+
+    for (uint32_t run = 0u; run < FORMAT_RUNS; run += 997u)
+    {
+        const uint64_t us = static_cast<uint64_t>(run) * 7919u * 104729u;
+        const int length = std::snprintf(expected_prefix, sizeof(expected_prefix), "[%6" PRIu64 ".%06" PRIu64 "] ", us / 1000000u, us % 1000000u);
+        if ((stamp_format(prefix, us) != static_cast<uint32_t>(length)) || (std::memcmp(prefix, expected_prefix, static_cast<size_t>(length)) != 0))
+        {
+            std::cerr << "stamp_format differs at " << us << " us\n";
+            return 1;
+        }
+    }
+    if (checksum[0] != checksum[1])
+    {
+        std::cerr << "stamp_format output differs from snprintf\n";
+        return 1;
+    }
+
+    return 0;
+}
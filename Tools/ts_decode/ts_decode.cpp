@@ -0,0 +1,227 @@
+/**
+ * @brief Host decoder for timestamped logs (timestamps=records, LOGxxxxx.TSR or an expanded LOGxxxxx.LZB)
+ *
+ * Usage: ts_decode [-s <unix seconds at boot>] [-r] [log, default stdin]
+ *
+ * Record layout (Core/INGEST/ingest_record.h, little endian): magic 0xf5, epoch (wraps of the 32-bit counter, low byte),
+ * data length (16 bit), microseconds since boot (32 bit), then the data. The stamp is the arrival of the last byte of
+ * the chunk. Every line is printed behind the time of the record it starts in: wall-clock time with -s, otherwise
+ * seconds since boot. The counter restarts at every boot; a stamp going back starts a new session, which is printed
+ * relative to its own boot since the logger has no calendar clock. -r lists the records instead.
+ * Bytes that do not start a valid record are skipped, so a capture window cut anywhere still decodes.
+ */
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "ingest_record.h"
+
+namespace
+{
+constexpr size_t RECORD_HEADER = sizeof(INGEST_RECORD_T);
+constexpr uint64_t EPOCH_US = 1ull << 32u;
+
+uint16_t get16(const uint8_t* src)
+{
+    return static_cast<uint16_t>(src[0] | (src[1] << 8u));
+}
+
+uint32_t get32(const uint8_t* src)
+{
+    return static_cast<uint32_t>(src[0]) | (static_cast<uint32_t>(src[1]) << 8u) | (static_cast<uint32_t>(src[2]) << 16u) |
+           (static_cast<uint32_t>(src[3]) << 24u);
+}
+
+bool read_file(const char* path, std::vector<uint8_t>& data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/* A header counts when its data fits and the next record (or the end) follows right after it */
+bool valid_record(const std::vector<uint8_t>& data, size_t pos)
+{
+    if ((pos + RECORD_HEADER > data.size()) || (data[pos] != INGEST_RECORD_MAGIC))
+    {
+        return false;
+    }
+    const size_t next = pos + RECORD_HEADER + get16(&data[pos + 2u]);
+    return (next == data.size()) || ((next < data.size()) && (data[next] == INGEST_RECORD_MAGIC));
+}
+
+/* Microseconds since boot from the low epoch byte and the counter, extended against the previous record */
+class Clock
+{
+public:
+    /* Returns true when the stamp went back: the logger rebooted and its counter starts over in epoch 0 */
+    bool update(uint8_t epoch, uint32_t stamp)
+    {
+        const uint64_t last_wraps = last_ / EPOCH_US;
+        const uint8_t last_epoch = static_cast<uint8_t>(last_wraps);
+        const bool restart = started_ && (epoch == 0u) && ((last_epoch == 0u) ? (stamp < static_cast<uint32_t>(last_)) : (last_epoch != 0xffu));
+
+        if (restart)
+        {
+            last_ = stamp;
+            session_++;
+        }
+        else
+        {
+            uint64_t wraps = (last_wraps & ~0xffull) | epoch;
+            if (wraps < last_wraps)
+            {
+                wraps += 0x100u;
+            }
+            last_ = wraps * EPOCH_US + stamp;
+        }
+        started_ = true;
+        return restart;
+    }
+
+    uint64_t now() const
+    {
+        return last_;
+    }
+
+    unsigned session() const
+    {
+        return session_;
+    }
+
+private:
+    uint64_t last_ = 0u;
+    unsigned session_ = 1u;
+    bool started_ = false;
+};
+
+void print_time(uint64_t us, unsigned session, bool wall, int64_t boot_s)
+{
+    if (wall && (session == 1u))
+    {
+        const time_t seconds = static_cast<time_t>(boot_s + static_cast<int64_t>(us / 1000000u));
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char text[32];
+        std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+        std::printf("[%s.%06" PRIu64 "] ", text, us % 1000000u);
+    }
+    else
+    {
+        std::printf("[%6" PRIu64 ".%06" PRIu64 "] ", us / 1000000u, us % 1000000u);
+    }
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool wall = false;
+    bool list = false;
+    int64_t boot_s = 0;
+    const char* path = nullptr;
+
+    for (int index = 1; index < argc; index++)
+    {
+        if ((std::strcmp(argv[index], "-s") == 0) && (index + 1 < argc))
+        {
+            boot_s = std::strtoll(argv[++index], nullptr, 10);
+            wall = true;
+        }
+        else if (std::strcmp(argv[index], "-r") == 0)
+        {
+            list = true;
+        }
+        else if ((argv[index][0] != '-') && (path == nullptr))
+        {
+            path = argv[index];
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [-s <unix seconds at boot>] [-r] [LOGxxxxx.TSR, default stdin]\n";
+            return 2;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    if (path != nullptr)
+    {
+        if (!read_file(path, data))
+        {
+            std::cerr << "cannot read " << path << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    }
+
+    Clock clock;
+    bool line_start = true;
+    size_t pos = 0u;
+    size_t records = 0u;
+    size_t skipped = 0u;
+    while (pos < data.size())
+    {
+        if (!valid_record(data, pos))
+        {
+            pos++;
+            skipped++;
+            continue;
+        }
+
+        const uint8_t* header = &data[pos];
+        const size_t length = get16(&header[2]);
+        if (clock.update(header[1], get32(&header[4])))
+        {
+            if (!line_start)
+            {
+                std::printf("\n");
+                line_start = true;
+            }
+            std::printf("--- restart, session %u ---\n", clock.session());
+        }
+
+        const uint8_t* text = header + RECORD_HEADER;
+        if (list)
+        {
+            std::printf("%u,%" PRIu64 ",%zu\n", clock.session(), clock.now(), length);
+        }
+        else
+        {
+            for (size_t index = 0u; index < length; index++)
+            {
+                if (line_start)
+                {
+                    print_time(clock.now(), clock.session(), wall, boot_s);
+                }
+                std::putchar(text[index]);
+                line_start = (text[index] == '\n');
+            }
+        }
+
+        records++;
+        pos += RECORD_HEADER + length;
+    }
+
+    std::fprintf(stderr, "%zu records", records);
+    if (skipped != 0u)
+    {
+        std::fprintf(stderr, ", %zu bytes skipped", skipped);
+    }
+    std::fprintf(stderr, "\n");
+
+    return 0;
+}
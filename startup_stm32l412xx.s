@@ -61,6 +61,18 @@ defined in linker script */
 Reset_Handler:
   ldr   sp, =_estack    /* Set stack pointer */
 
+/* Start the cycle counter, ingest_boot_latency_us() counts from the first instruction */
+  ldr r0, =0xE000EDFC   /* CoreDebug->DEMCR */
+  ldr r1, [r0]
+  orr r1, r1, #0x01000000 /* TRCENA */
+  str r1, [r0]
+  ldr r0, =0xE0001000   /* DWT->CTRL */
+  movs r1, #0
+  str r1, [r0, #4]      /* DWT->CYCCNT */
+  ldr r1, [r0]
+  orr r1, r1, #1        /* CYCCNTENA */
+  str r1, [r0]
+
 /* Call the clock system initialization function.*/
     bl  SystemInit
 
@@ -81,6 +93,26 @@ LoopCopyDataInit:
   cmp r4, r1
   bcc CopyDataInit
   
+/* Copy the hot code (.ramfunc) from flash to SRAM2, nothing to do when it is linked to run from flash */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  cmp r0, r2
+  beq RamFuncDone
+  movs r3, #0
+  b LoopCopyRamFunc
+
+CopyRamFunc:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamFunc:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamFunc
+
+RamFuncDone:
 /* Zero fill the bss segment. */
   ldr r2, =_sbss
   ldr r4, =_ebss